@@ -30,6 +30,7 @@
 #include <Box2D/Common/b2Settings.h>
 #include <Box2D/Common/b2Draw.h>
 #include <Box2D/Common/b2Stat.h>
+#include <Box2D/Common/b2TaskScheduler.h>
 #include <Box2D/Common/b2Timer.h>
 
 #include <Box2D/Collision/Shapes/b2CircleShape.h>
@@ -64,5 +65,6 @@
 
 #include <Box2D/Particle/b2Particle.h>
 #include <Box2D/Particle/b2ParticleGroup.h>
+#include <Box2D/Particle/b2ParticleEmitter.h>
 
 #endif
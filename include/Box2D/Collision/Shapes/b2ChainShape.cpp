@@ -148,6 +148,13 @@ void b2ChainShape::ComputeDistance(const b2Transform& xf, const b2Vec2& p, float
 	edge.ComputeDistance(xf, p, distance, normal, 0);
 }
 
+void b2ChainShape::ComputeDistanceBatch(const b2Transform& xf, const b2Vec2* points, int32 count, float32* distances, b2Vec2* normals, int32 childIndex) const
+{
+	b2EdgeShape edge;
+	GetChildEdge(&edge, childIndex);
+	edge.ComputeDistanceBatch(xf, points, count, distances, normals, 0);
+}
+
 bool b2ChainShape::TestPoint(const b2Transform& xf, const b2Vec2& p) const
 {
 	B2_NOT_USED(xf);
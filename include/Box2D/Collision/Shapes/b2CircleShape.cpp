@@ -18,6 +18,7 @@
 */
 
 #include <Box2D/Collision/Shapes/b2CircleShape.h>
+#include <Box2D/Collision/Shapes/b2ShapeSimd.h>
 #include <new>
 
 b2Shape* b2CircleShape::Clone(b2BlockAllocator* allocator) const
@@ -51,6 +52,38 @@ void b2CircleShape::ComputeDistance(const b2Transform& transform, const b2Vec2&
 	*normal = 1 / d1 * d;
 }
 
+void b2CircleShape::ComputeDistanceBatch(const b2Transform& transform, const b2Vec2* points, int32 count, float32* distances, b2Vec2* normals, int32 childIndex) const
+{
+	B2_NOT_USED(childIndex);
+
+	b2Vec2 center = transform.p + b2Mul(transform.q, m_p);
+	int32 i = 0;
+#if defined(B2_SIMD_SSE2)
+	const __m128 centerX = _mm_set1_ps(center.x);
+	const __m128 centerY = _mm_set1_ps(center.y);
+	const __m128 radius = _mm_set1_ps(m_radius);
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x, y;
+		b2LoadVec2x4(points + i, &x, &y);
+		x = _mm_sub_ps(x, centerX);
+		y = _mm_sub_ps(y, centerY);
+		__m128 d1 = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+		_mm_storeu_ps(distances + i, _mm_sub_ps(d1, radius));
+		__m128 invD1 = _mm_div_ps(one, d1);
+		b2StoreVec2x4(_mm_mul_ps(invD1, x), _mm_mul_ps(invD1, y), normals + i);
+	}
+#endif // defined(B2_SIMD_SSE2)
+	for (; i < count; ++i)
+	{
+		b2Vec2 d = points[i] - center;
+		float32 d1 = d.Length();
+		distances[i] = d1 - m_radius;
+		normals[i] = 1 / d1 * d;
+	}
+}
+
 // Collision Detection in Interactive 3D Environments by Gino van den Bergen
 // From Section 3.1.2
 // x = s + a * r
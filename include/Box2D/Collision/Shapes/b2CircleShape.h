@@ -40,6 +40,9 @@ public:
 	// @see b2Shape::ComputeDistance
 	void ComputeDistance(const b2Transform& xf, const b2Vec2& p, float32* distance, b2Vec2* normal, int32 childIndex) const;
 
+	// @see b2Shape::ComputeDistanceBatch
+	void ComputeDistanceBatch(const b2Transform& xf, const b2Vec2* points, int32 count, float32* distances, b2Vec2* normals, int32 childIndex) const;
+
 	/// Implement b2Shape.
 	bool RayCast(b2RayCastOutput* output, const b2RayCastInput& input,
 				const b2Transform& transform, int32 childIndex) const;
@@ -18,6 +18,7 @@
 */
 
 #include <Box2D/Collision/Shapes/b2EdgeShape.h>
+#include <Box2D/Collision/Shapes/b2ShapeSimd.h>
 #include <new>
 
 void b2EdgeShape::Set(const b2Vec2& v1, const b2Vec2& v2)
@@ -77,6 +78,70 @@ void b2EdgeShape::ComputeDistance(const b2Transform& xf, const b2Vec2& p, float3
 
 }
 
+void b2EdgeShape::ComputeDistanceBatch(const b2Transform& xf, const b2Vec2* points, int32 count, float32* distances, b2Vec2* normals, int32 childIndex) const
+{
+	B2_NOT_USED(childIndex);
+
+	b2Vec2 v1 = b2Mul(xf, m_vertex1);
+	b2Vec2 v2 = b2Mul(xf, m_vertex2);
+	b2Vec2 s = v2 - v1;
+	float32 s2 = b2Dot(s, s);
+	int32 i = 0;
+#if defined(B2_SIMD_SSE2)
+	const __m128 v1X = _mm_set1_ps(v1.x);
+	const __m128 v1Y = _mm_set1_ps(v1.y);
+	const __m128 v2X = _mm_set1_ps(v2.x);
+	const __m128 v2Y = _mm_set1_ps(v2.y);
+	const __m128 sX = _mm_set1_ps(s.x);
+	const __m128 sY = _mm_set1_ps(s.y);
+	const __m128 simdS2 = _mm_set1_ps(s2);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 pX, pY;
+		b2LoadVec2x4(points + i, &pX, &pY);
+		__m128 dX = _mm_sub_ps(pX, v1X);
+		__m128 dY = _mm_sub_ps(pY, v1Y);
+		__m128 ds = _mm_add_ps(_mm_mul_ps(dX, sX), _mm_mul_ps(dY, sY));
+
+		// Nearest to the segment's interior, or to its second vertex.
+		__m128 t = _mm_div_ps(ds, simdS2);
+		__m128 interiorX = _mm_sub_ps(dX, _mm_mul_ps(t, sX));
+		__m128 interiorY = _mm_sub_ps(dY, _mm_mul_ps(t, sY));
+		__m128 beyond = _mm_cmpgt_ps(ds, simdS2);
+		__m128 along = _mm_cmpgt_ps(ds, zero);
+		dX = b2Select4(along, b2Select4(beyond, _mm_sub_ps(pX, v2X), interiorX), dX);
+		dY = b2Select4(along, b2Select4(beyond, _mm_sub_ps(pY, v2Y), interiorY), dY);
+
+		__m128 d1 = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dX, dX), _mm_mul_ps(dY, dY)));
+		_mm_storeu_ps(distances + i, d1);
+		__m128 invD1 = _mm_and_ps(_mm_cmpgt_ps(d1, zero), _mm_div_ps(one, d1));
+		b2StoreVec2x4(_mm_mul_ps(invD1, dX), _mm_mul_ps(invD1, dY), normals + i);
+	}
+#endif // defined(B2_SIMD_SSE2)
+	for (; i < count; ++i)
+	{
+		b2Vec2 d = points[i] - v1;
+		float32 ds = b2Dot(d, s);
+		if (ds > 0)
+		{
+			if (ds > s2)
+			{
+				d = points[i] - v2;
+			}
+			else
+			{
+				d -= ds / s2 * s;
+			}
+		}
+
+		float32 d1 = d.Length();
+		distances[i] = d1;
+		normals[i] = d1 > 0 ? 1 / d1 * d : b2Vec2_zero;
+	}
+}
+
 // p = p1 + t * d
 // v = v1 + s * e
 // p1 + t * d = v1 + s * e
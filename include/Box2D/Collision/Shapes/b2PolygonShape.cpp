@@ -18,6 +18,7 @@
 */
 
 #include <Box2D/Collision/Shapes/b2PolygonShape.h>
+#include <Box2D/Collision/Shapes/b2ShapeSimd.h>
 #include <new>
 
 b2Shape* b2PolygonShape::Clone(b2BlockAllocator* allocator) const
@@ -301,6 +302,84 @@ void b2PolygonShape::ComputeDistance(const b2Transform& xf, const b2Vec2& p, flo
 	}
 }
 
+void b2PolygonShape::ComputeDistanceBatch(const b2Transform& xf, const b2Vec2* points, int32 count, float32* distances, b2Vec2* normals, int32 childIndex) const
+{
+	int32 i = 0;
+#if defined(B2_SIMD_SSE2)
+	// Same steps as ComputeDistance(), for four points at a time. Both the
+	// face and the vertex results are computed and the right one picked.
+	const __m128 c = _mm_set1_ps(xf.q.c);
+	const __m128 s = _mm_set1_ps(xf.q.s);
+	const __m128 px = _mm_set1_ps(xf.p.x);
+	const __m128 py = _mm_set1_ps(xf.p.y);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 epsilon = _mm_set1_ps(b2_epsilon);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x, y;
+		b2LoadVec2x4(points + i, &x, &y);
+		x = _mm_sub_ps(x, px);
+		y = _mm_sub_ps(y, py);
+		__m128 localX = _mm_add_ps(_mm_mul_ps(c, x), _mm_mul_ps(s, y));
+		__m128 localY = _mm_sub_ps(_mm_mul_ps(c, y), _mm_mul_ps(s, x));
+
+		__m128 maxDistance = _mm_set1_ps(-FLT_MAX);
+		__m128 normalX = localX;
+		__m128 normalY = localY;
+		for (int32 j = 0; j < m_count; ++j)
+		{
+			__m128 nx = _mm_set1_ps(m_normals[j].x);
+			__m128 ny = _mm_set1_ps(m_normals[j].y);
+			__m128 dot = _mm_add_ps(
+				_mm_mul_ps(nx, _mm_sub_ps(localX, _mm_set1_ps(m_vertices[j].x))),
+				_mm_mul_ps(ny, _mm_sub_ps(localY, _mm_set1_ps(m_vertices[j].y))));
+			__m128 greater = _mm_cmpgt_ps(dot, maxDistance);
+			maxDistance = b2Select4(greater, dot, maxDistance);
+			normalX = b2Select4(greater, nx, normalX);
+			normalY = b2Select4(greater, ny, normalY);
+		}
+
+		// Outside the polygon, a vertex may be nearer than the face.
+		__m128 minDistanceX = normalX;
+		__m128 minDistanceY = normalY;
+		__m128 minDistance2 = _mm_mul_ps(maxDistance, maxDistance);
+		for (int32 j = 0; j < m_count; ++j)
+		{
+			__m128 dx = _mm_sub_ps(localX, _mm_set1_ps(m_vertices[j].x));
+			__m128 dy = _mm_sub_ps(localY, _mm_set1_ps(m_vertices[j].y));
+			__m128 distance2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+			__m128 nearer = _mm_cmpgt_ps(minDistance2, distance2);
+			minDistance2 = b2Select4(nearer, distance2, minDistance2);
+			minDistanceX = b2Select4(nearer, dx, minDistanceX);
+			minDistanceY = b2Select4(nearer, dy, minDistanceY);
+		}
+		__m128 outside = _mm_cmpgt_ps(maxDistance, zero);
+		_mm_storeu_ps(distances + i, b2Select4(
+			outside, _mm_sqrt_ps(minDistance2), maxDistance));
+		__m128 localNormalX = b2Select4(outside, minDistanceX, normalX);
+		__m128 localNormalY = b2Select4(outside, minDistanceY, normalY);
+		__m128 worldNormalX = _mm_sub_ps(_mm_mul_ps(c, localNormalX),
+										 _mm_mul_ps(s, localNormalY));
+		__m128 worldNormalY = _mm_add_ps(_mm_mul_ps(s, localNormalX),
+										 _mm_mul_ps(c, localNormalY));
+
+		// Only the vertex result is normalized.
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(
+			_mm_mul_ps(worldNormalX, worldNormalX),
+			_mm_mul_ps(worldNormalY, worldNormalY)));
+		__m128 normalize = _mm_andnot_ps(_mm_cmplt_ps(length, epsilon), outside);
+		__m128 invLength = b2Select4(normalize, _mm_div_ps(one, length), one);
+		b2StoreVec2x4(_mm_mul_ps(worldNormalX, invLength),
+					  _mm_mul_ps(worldNormalY, invLength), normals + i);
+	}
+#endif // defined(B2_SIMD_SSE2)
+	for (; i < count; ++i)
+	{
+		ComputeDistance(xf, points[i], &distances[i], &normals[i], childIndex);
+	}
+}
+
 bool b2PolygonShape::RayCast(b2RayCastOutput* output, const b2RayCastInput& input,
 								const b2Transform& xf, int32 childIndex) const
 {
@@ -77,6 +77,15 @@ public:
 	/// @param normal returns the direction in which the distance increases.
 	virtual void ComputeDistance(const b2Transform& xf, const b2Vec2& p, float32* distance, b2Vec2* normal, int32 childIndex) const= 0;
 
+	/// Compute the distance from the current shape to each of the specified
+	/// points, with the same results as ComputeDistance().
+	/// @param xf the shape world transform.
+	/// @param points count points in world coordinates.
+	/// @param count the number of points.
+	/// @param distances returns count distances from the current shape.
+	/// @param normals returns count directions in which the distance increases.
+	virtual void ComputeDistanceBatch(const b2Transform& xf, const b2Vec2* points, int32 count, float32* distances, b2Vec2* normals, int32 childIndex) const;
+
 	/// Cast a ray against a child shape.
 	/// @param output the ray-cast results.
 	/// @param input the ray-cast input parameters.
@@ -106,4 +115,12 @@ inline b2Shape::Type b2Shape::GetType() const
 	return m_type;
 }
 
+inline void b2Shape::ComputeDistanceBatch(const b2Transform& xf, const b2Vec2* points, int32 count, float32* distances, b2Vec2* normals, int32 childIndex) const
+{
+	for (int32 i = 0; i < count; ++i)
+	{
+		ComputeDistance(xf, points[i], &distances[i], &normals[i], childIndex);
+	}
+}
+
 #endif
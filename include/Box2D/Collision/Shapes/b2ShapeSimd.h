@@ -0,0 +1,55 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef B2_SHAPE_SIMD_H
+#define B2_SHAPE_SIMD_H
+
+// Helpers for the SSE2 b2Shape::ComputeDistanceBatch() implementations.
+// Four points are processed at once as four x and four y components.
+
+#include <Box2D/Common/b2Math.h>
+
+#if defined(B2_SIMD_SSE2)
+
+#include <emmintrin.h>
+
+/// Load points[0..3] as four x and four y components.
+inline void b2LoadVec2x4(const b2Vec2* points, __m128* x, __m128* y)
+{
+	const __m128 a = _mm_loadu_ps(&points[0].x);
+	const __m128 b = _mm_loadu_ps(&points[2].x);
+	*x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+	*y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+/// Store four x and four y components to vectors[0..3].
+inline void b2StoreVec2x4(__m128 x, __m128 y, b2Vec2* vectors)
+{
+	_mm_storeu_ps(&vectors[0].x, _mm_unpacklo_ps(x, y));
+	_mm_storeu_ps(&vectors[2].x, _mm_unpackhi_ps(x, y));
+}
+
+/// Lanes of a where mask is set, lanes of b elsewhere.
+inline __m128 b2Select4(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+#endif // defined(B2_SIMD_SSE2)
+
+#endif
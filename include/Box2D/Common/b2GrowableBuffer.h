@@ -78,6 +78,22 @@ public:
 		if (capacity >= newCapacity)
 			return;
 
+		SetCapacity(newCapacity);
+	}
+
+	/// Reallocate to exactly newCapacity, which must hold the current
+	/// elements. A capacity of 0 frees the buffer.
+	void SetCapacity(int32 newCapacity)
+	{
+		b2Assert(newCapacity >= count);
+		if (newCapacity == capacity)
+			return;
+		if (newCapacity == 0)
+		{
+			Free();
+			return;
+		}
+
 		// Reallocate and copy.
 		T* newData = (T*) allocator->Allocate(sizeof(T) * newCapacity);
 		if (data)
@@ -164,6 +164,40 @@ typedef unsigned long long uint64;
 #define B2_USE_16_BIT_PARTICLE_INDICES
 #endif
 
+/// Define B2_USE_COMPACT_PARTICLES to shrink b2ParticleContact from 24 to 16
+/// bytes, and b2ParticlePair and b2ParticleTriad a little, so the contact
+/// solver streams through less memory. Particle indices are 16 bits, which
+/// limits each particle system to b2_maxParticleIndex + 1 particles, and the
+/// contact normal is stored as 16-bit fixed point.
+#if !defined(B2_USE_16_BIT_PARTICLE_INDICES) && defined(B2_USE_COMPACT_PARTICLES)
+#define B2_USE_16_BIT_PARTICLE_INDICES
+#endif
+
+/// On x86, use the SSE4.1 / AVX2 particle routines in
+/// b2ParticleAssembly.sse.cpp. The instruction set is chosen at runtime, so
+/// this is safe to enable for any x86 target. Define LIQUIDFUN_SIMD_NONE to
+/// always use the reference implementation.
+#if !defined(LIQUIDFUN_SIMD_NEON) && !defined(LIQUIDFUN_SIMD_SSE) && \
+	!defined(LIQUIDFUN_SIMD_NONE) && \
+	(defined(__x86_64__) || defined(__i386__) || \
+	 defined(_M_X64) || defined(_M_IX86))
+#define LIQUIDFUN_SIMD_SSE
+#endif
+
+#if defined(LIQUIDFUN_SIMD_NEON) || defined(LIQUIDFUN_SIMD_SSE)
+#define LIQUIDFUN_SIMD_ENABLED 1
+#else
+#define LIQUIDFUN_SIMD_ENABLED 0
+#endif
+
+/// b2Shape::ComputeDistanceBatch() uses SSE2, which every x86-64 target
+/// has, so there is no runtime check. LIQUIDFUN_SIMD_NONE turns it off too.
+#if !defined(LIQUIDFUN_SIMD_NONE) && \
+	(defined(__SSE2__) || defined(_M_X64) || \
+	 (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define B2_SIMD_SSE2
+#endif
+
 /// A symbolic constant that stands for particle allocation error.
 #define b2_invalidParticleIndex		(-1)
 
@@ -0,0 +1,51 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#ifndef B2_TASK_SCHEDULER_H
+#define B2_TASK_SCHEDULER_H
+
+#include <Box2D/Common/b2Settings.h>
+
+/// A loop body that can be split into independent ranges.
+class b2RangeTask
+{
+public:
+	virtual ~b2RangeTask() {}
+
+	/// Process the items in [begin, end).
+	/// May be called concurrently from several threads, with ranges that
+	/// never overlap.
+	virtual void Execute(int32 begin, int32 end) = 0;
+};
+
+/// Interface to the host application's job system. Implement this and pass
+/// it to b2ParticleSystem::SetTaskScheduler() to run the particle solver on
+/// several threads.
+class b2TaskScheduler
+{
+public:
+	virtual ~b2TaskScheduler() {}
+
+	/// Call task->Execute() on ranges that exactly cover [0, count).
+	/// Ranges should hold at least grainSize items, except possibly the last.
+	/// Must not return until every range has been executed. The calling
+	/// thread may execute ranges itself.
+	virtual void ParallelFor(b2RangeTask* task, int32 count,
+							 int32 grainSize) = 0;
+};
+
+#endif
@@ -264,6 +264,13 @@ void b2Body::DestroyFixture(b2Fixture* fixture)
 		}
 	}
 
+	for (b2ParticleSystem* p = m_world->m_particleSystemList; p;
+		 p = p->GetNext())
+	{
+		p->DestroyStaticFields(fixture);
+		p->DestroyBodyContacts(fixture);
+	}
+
 	b2BlockAllocator* allocator = &m_world->m_blockAllocator;
 
 	if (m_flags & e_activeFlag)
@@ -161,6 +161,10 @@ public:
 	/// @param p a point in world coordinates.
 	void ComputeDistance(const b2Vec2& p, float32* distance, b2Vec2* normal, int32 childIndex) const;
 
+	/// Compute the distance from this fixture to each of count points.
+	/// @param points count points in world coordinates.
+	void ComputeDistanceBatch(const b2Vec2* points, int32 count, float32* distances, b2Vec2* normals, int32 childIndex) const;
+
 	/// Cast a ray against this shape.
 	/// @param output the ray-cast results.
 	/// @param input the ray-cast input parameters.
@@ -336,6 +340,11 @@ inline void b2Fixture::ComputeDistance(const b2Vec2& p, float32* d, b2Vec2* n, i
 	m_shape->ComputeDistance(m_body->GetTransform(), p, d, n, childIndex);
 }
 
+inline void b2Fixture::ComputeDistanceBatch(const b2Vec2* points, int32 count, float32* distances, b2Vec2* normals, int32 childIndex) const
+{
+	m_shape->ComputeDistanceBatch(m_body->GetTransform(), points, count, distances, normals, childIndex);
+}
+
 inline bool b2Fixture::RayCast(b2RayCastOutput* output, const b2RayCastInput& input, int32 childIndex) const
 {
 	return m_shape->RayCast(output, input, m_body->GetTransform(), childIndex);
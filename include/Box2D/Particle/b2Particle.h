@@ -318,6 +318,60 @@ struct b2ParticleDef
 
 };
 
+/// A particle batch definition holds the arrays needed to create many
+/// particles at once with b2ParticleSystem::CreateParticles(). Only
+/// positionData is required; a property whose array is NULL is set from
+/// the single value that applies to every particle.
+struct b2ParticleBatchDef
+{
+	b2ParticleBatchDef()
+	{
+		count = 0;
+		positionData = NULL;
+		velocityData = NULL;
+		colorData = NULL;
+		flagsData = NULL;
+		flags = 0;
+		color = b2ParticleColor_zero;
+		lifetime = 0.0f;
+		userData = NULL;
+		group = NULL;
+	}
+
+	/// The number of particles to create.
+	int32 count;
+
+	/// The world positions of the count particles.
+	const b2Vec2* positionData;
+
+	/// The linear velocities of the count particles in world co-ordinates.
+	/// If NULL, the particles are created at rest.
+	const b2Vec2* velocityData;
+
+	/// The colors of the count particles. If NULL, color is used instead.
+	const b2ParticleColor* colorData;
+
+	/// The types of the count particles (see #b2ParticleFlag). If NULL,
+	/// flags is used instead.
+	const uint32* flagsData;
+
+	/// The type of every particle when flagsData is NULL.
+	uint32 flags;
+
+	/// The color of every particle when colorData is NULL.
+	b2ParticleColor color;
+
+	/// Lifetime of every particle in seconds.  A value <= 0.0f indicates
+	/// particles with infinite lifetime.
+	float32 lifetime;
+
+	/// Application-specific data stored with every particle.
+	void* userData;
+
+	/// An existing particle group to which the particles will be added.
+	b2ParticleGroup* group;
+};
+
 /// A helper function to calculate the optimal number of iterations.
 int32 b2CalculateParticleIterations(
 	float32 gravity, float32 radius, float32 timeStep);
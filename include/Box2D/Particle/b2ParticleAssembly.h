@@ -24,10 +24,17 @@
 
 struct b2ParticleContact;
 
+#if defined(LIQUIDFUN_SIMD_NEON)
+// b2ParticleAssembly.neon.s loads the check indices as 16-bit values.
+typedef uint16 FindContactIndex;
+#else
+typedef uint32 FindContactIndex;
+#endif
+
 struct FindContactCheck
 {
-    uint16 particleIndex;
-    uint16 comparatorIndex;
+    FindContactIndex particleIndex;
+    FindContactIndex comparatorIndex;
 };
 
 struct FindContactInput
@@ -56,6 +63,12 @@ extern void FindContactsFromChecks_Simd(
   const uint32* flags,
 	b2GrowableBuffer<b2ParticleContact>& contacts);
 
+#if defined(LIQUIDFUN_SIMD_SSE)
+// Returns nonzero if the CPU supports the instructions required by the
+// x86 implementations of the functions above.
+extern int IsSupported_Simd();
+#endif // defined(LIQUIDFUN_SIMD_SSE)
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
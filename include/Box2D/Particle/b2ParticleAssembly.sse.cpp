@@ -0,0 +1,444 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#include <Box2D/Particle/b2ParticleAssembly.h>
+#include <Box2D/Particle/b2ParticleSystem.h>
+
+#if defined(LIQUIDFUN_SIMD_SSE)
+
+// x86 counterpart of b2ParticleAssembly.neon.s.
+//
+// Each routine has an SSE4.1 and an AVX2 version. Both are compiled into
+// every x86 build using per-function target attributes, and the fastest
+// version supported by the CPU is picked the first time a routine is called.
+// b2ParticleSystem falls back to its reference implementation when
+// IsSupported_Simd() returns 0.
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC allows any intrinsic in any function, so no target attribute needed.
+#define B2_TARGET_SSE41
+#define B2_TARGET_AVX2
+#else
+#define B2_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define B2_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Must match the constants at the top of b2ParticleSystem.cpp.
+// See computeTag().
+static const float k_xScale = 256.0f;        // 1 << xShift
+static const float k_xOffset = 524288.0f;    // xScale * (1 << (xTruncBits - 1))
+static const float k_yOffset = 2048.0f;      // 1 << (yTruncBits - 1)
+static const int k_yShift = 20;              // tagBits - yTruncBits
+
+// Smallest squared distance passed to the reciprocal square root. Keeps the
+// normal finite (zero) for particles that sit exactly on top of each other,
+// as b2InvSqrt() does in the reference implementation.
+static const float k_minDistanceSq = FLT_MIN;
+
+enum CpuLevel
+{
+	e_cpuLevelNone,
+	e_cpuLevelSse41,
+	e_cpuLevelAvx2,
+};
+
+static CpuLevel DetectCpuLevel()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+	if (maxLeaf < 1)
+	{
+		return e_cpuLevelNone;
+	}
+	__cpuid(info, 1);
+	const bool sse41 = (info[2] & (1 << 19)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (!sse41)
+	{
+		return e_cpuLevelNone;
+	}
+	if (maxLeaf >= 7 && osxsave && avx &&
+		(_xgetbv(0) & 0x6) == 0x6)
+	{
+		__cpuidex(info, 7, 0);
+		if (info[1] & (1 << 5))
+		{
+			return e_cpuLevelAvx2;
+		}
+	}
+	return e_cpuLevelSse41;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return e_cpuLevelAvx2;
+	}
+	if (__builtin_cpu_supports("sse4.1"))
+	{
+		return e_cpuLevelSse41;
+	}
+	return e_cpuLevelNone;
+#endif
+}
+
+static CpuLevel GetCpuLevel()
+{
+	static const CpuLevel level = DetectCpuLevel();
+	return level;
+}
+
+// Reciprocal square root, refined with one Newton-Raphson iteration to
+// match the precision of b2InvSqrt().
+B2_TARGET_SSE41
+static inline __m128 InvSqrt4(__m128 x)
+{
+	const __m128 y = _mm_rsqrt_ps(x);
+	const __m128 xhalf = _mm_mul_ps(_mm_set1_ps(0.5f), x);
+	return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f),
+		_mm_mul_ps(xhalf, _mm_mul_ps(y, y))));
+}
+
+B2_TARGET_AVX2
+static inline __m256 InvSqrt8(__m256 x)
+{
+	const __m256 y = _mm256_rsqrt_ps(x);
+	const __m256 xhalf = _mm256_mul_ps(_mm256_set1_ps(0.5f), x);
+	return _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f),
+		_mm256_mul_ps(xhalf, _mm256_mul_ps(y, y))));
+}
+
+// Load the positions of four consecutive FindContactInputs, and transpose
+// them into an x vector and a y vector.
+B2_TARGET_SSE41
+static inline void LoadPositions4(const FindContactInput* in,
+                                  __m128* x, __m128* y)
+{
+	// FindContactInput is {index, x, y}, so four of them fill three
+	// registers:
+	//   v0 = (i0, x0, y0, i1)
+	//   v1 = (x1, y1, i2, x2)
+	//   v2 = (y2, i3, x3, y3)
+	const float* f = reinterpret_cast<const float*>(in);
+	const __m128 v0 = _mm_loadu_ps(f);
+	const __m128 v1 = _mm_loadu_ps(f + 4);
+	const __m128 v2 = _mm_loadu_ps(f + 8);
+	// t0 = (x0, y0, x1, y1)
+	const __m128 t0 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 0, 2, 1));
+	// t1 = (x2, x1, x3, y3)
+	const __m128 t1 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(3, 2, 0, 3));
+	*x = _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0));
+	*y = _mm_shuffle_ps(t0, v2, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+// Append the contacts flagged in 'mask' between the particle at 'particle'
+// and the comparators starting at 'comparators'. Lane i of the arrays
+// corresponds to comparators[i].
+static inline void AppendContacts(
+	const FindContactInput& particle,
+	const FindContactInput* comparators,
+	int mask,
+	const float* weights,
+	const float* normalsX,
+	const float* normalsY,
+	const uint32* flags,
+	b2GrowableBuffer<b2ParticleContact>& contacts)
+{
+	const int32 a = (int32)particle.proxyIndex;
+	const uint32 flagsA = flags[a];
+	for (int i = 0; mask; ++i, mask >>= 1)
+	{
+		if (mask & 1)
+		{
+			const int32 b = (int32)comparators[i].proxyIndex;
+			b2ParticleContact& contact = contacts.Append();
+			contact.SetIndices(a, b);
+			contact.SetFlags(flagsA | flags[b]);
+			contact.SetWeight(weights[i]);
+			contact.SetNormal(b2Vec2(normalsX[i], normalsY[i]));
+		}
+	}
+}
+
+B2_TARGET_SSE41
+static void CalculateTags_Sse41(const b2Vec2* positions, int count,
+                                float inverseDiameter, uint32* outTags)
+{
+	const __m128 invD = _mm_set1_ps(inverseDiameter);
+	const __m128 xScale = _mm_set1_ps(k_xScale);
+	const __m128 xOffset = _mm_set1_ps(k_xOffset);
+	const __m128 yOffset = _mm_set1_ps(k_yOffset);
+	const float* p = reinterpret_cast<const float*>(positions);
+	int i = 0;
+	for (; i + 4 <= count; i += 4, p += 8)
+	{
+		// Deinterleave (x0, y0, x1, y1), (x2, y2, x3, y3).
+		const __m128 lo = _mm_loadu_ps(p);
+		const __m128 hi = _mm_loadu_ps(p + 4);
+		const __m128 x = _mm_mul_ps(
+			_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)), invD);
+		const __m128 y = _mm_mul_ps(
+			_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)), invD);
+		const __m128i tx = _mm_cvttps_epi32(
+			_mm_add_ps(_mm_mul_ps(xScale, x), xOffset));
+		const __m128i ty = _mm_cvttps_epi32(_mm_add_ps(y, yOffset));
+		const __m128i tag = _mm_add_epi32(_mm_slli_epi32(ty, k_yShift), tx);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(outTags + i), tag);
+	}
+	for (; i < count; ++i)
+	{
+		const float x = positions[i].x * inverseDiameter;
+		const float y = positions[i].y * inverseDiameter;
+		outTags[i] = ((uint32)(int32)(y + k_yOffset) << k_yShift) +
+		             (uint32)(int32)(k_xScale * x + k_xOffset);
+	}
+}
+
+B2_TARGET_AVX2
+static void CalculateTags_Avx2(const b2Vec2* positions, int count,
+                               float inverseDiameter, uint32* outTags)
+{
+	const __m256 invD = _mm256_set1_ps(inverseDiameter);
+	const __m256 xScale = _mm256_set1_ps(k_xScale);
+	const __m256 xOffset = _mm256_set1_ps(k_xOffset);
+	const __m256 yOffset = _mm256_set1_ps(k_yOffset);
+	const float* p = reinterpret_cast<const float*>(positions);
+	int i = 0;
+	for (; i + 8 <= count; i += 8, p += 16)
+	{
+		const __m256 lo = _mm256_loadu_ps(p);
+		const __m256 hi = _mm256_loadu_ps(p + 8);
+		// The in-lane shuffles give (0, 1, 4, 5, 2, 3, 6, 7) ordering;
+		// the 64-bit permute restores (0, 1, 2, 3, 4, 5, 6, 7).
+		const __m256 xs = _mm256_castpd_ps(_mm256_permute4x64_pd(
+			_mm256_castps_pd(
+				_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))),
+			_MM_SHUFFLE(3, 1, 2, 0)));
+		const __m256 ys = _mm256_castpd_ps(_mm256_permute4x64_pd(
+			_mm256_castps_pd(
+				_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))),
+			_MM_SHUFFLE(3, 1, 2, 0)));
+		const __m256 x = _mm256_mul_ps(xs, invD);
+		const __m256 y = _mm256_mul_ps(ys, invD);
+		const __m256i tx = _mm256_cvttps_epi32(
+			_mm256_add_ps(_mm256_mul_ps(xScale, x), xOffset));
+		const __m256i ty = _mm256_cvttps_epi32(_mm256_add_ps(y, yOffset));
+		const __m256i tag = _mm256_add_epi32(
+			_mm256_slli_epi32(ty, k_yShift), tx);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(outTags + i), tag);
+	}
+	CalculateTags_Sse41(positions + i, count - i, inverseDiameter,
+	                    outTags + i);
+}
+
+// Check one particle against the NUM_V32_SLOTS comparators that follow
+// 'comparatorIndex' in proxy-order.
+B2_TARGET_SSE41
+static inline void FindContactsFromCheck_Sse41(
+	const FindContactInput* reordered,
+	const FindContactCheck& check,
+	__m128 diameterSq,
+	__m128 diameterInv,
+	const uint32* flags,
+	b2GrowableBuffer<b2ParticleContact>& contacts)
+{
+	const FindContactInput& particle = reordered[check.particleIndex];
+	const FindContactInput* comparators = &reordered[check.comparatorIndex];
+	__m128 x, y;
+	LoadPositions4(comparators, &x, &y);
+	const __m128 dx = _mm_sub_ps(x, _mm_set1_ps(particle.position.x));
+	const __m128 dy = _mm_sub_ps(y, _mm_set1_ps(particle.position.y));
+	const __m128 distSq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+	const int mask = _mm_movemask_ps(_mm_cmplt_ps(distSq, diameterSq));
+	if (!mask)
+	{
+		return;
+	}
+
+	// weight = 1 - distBtParticles / diameter
+	// normal = d / distBtParticles
+	const __m128 clampedSq = _mm_max_ps(distSq, _mm_set1_ps(k_minDistanceSq));
+	const __m128 invDist = InvSqrt4(clampedSq);
+	const __m128 weight = _mm_sub_ps(_mm_set1_ps(1.0f),
+		_mm_mul_ps(_mm_mul_ps(clampedSq, invDist), diameterInv));
+	float weights[NUM_V32_SLOTS];
+	float normalsX[NUM_V32_SLOTS];
+	float normalsY[NUM_V32_SLOTS];
+	_mm_storeu_ps(weights, weight);
+	_mm_storeu_ps(normalsX, _mm_mul_ps(dx, invDist));
+	_mm_storeu_ps(normalsY, _mm_mul_ps(dy, invDist));
+	AppendContacts(particle, comparators, mask, weights, normalsX, normalsY,
+	               flags, contacts);
+}
+
+B2_TARGET_SSE41
+static void FindContactsFromChecks_Sse41(
+	const FindContactInput* reordered,
+	const FindContactCheck* checks,
+	int numChecks,
+	float particleDiameterSq,
+	float particleDiameterInv,
+	const uint32* flags,
+	b2GrowableBuffer<b2ParticleContact>& contacts)
+{
+	const __m128 diameterSq = _mm_set1_ps(particleDiameterSq);
+	const __m128 diameterInv = _mm_set1_ps(particleDiameterInv);
+	for (int k = 0; k < numChecks; ++k)
+	{
+		FindContactsFromCheck_Sse41(reordered, checks[k], diameterSq,
+		                            diameterInv, flags, contacts);
+	}
+}
+
+// Same as the SSE4.1 version, but evaluates two checks (eight comparators)
+// per iteration. Lanes 0-3 belong to the first check and lanes 4-7 to the
+// second, so contacts are appended in the same order as the reference.
+B2_TARGET_AVX2
+static void FindContactsFromChecks_Avx2(
+	const FindContactInput* reordered,
+	const FindContactCheck* checks,
+	int numChecks,
+	float particleDiameterSq,
+	float particleDiameterInv,
+	const uint32* flags,
+	b2GrowableBuffer<b2ParticleContact>& contacts)
+{
+	const __m256 diameterSq = _mm256_set1_ps(particleDiameterSq);
+	const __m256 diameterInv = _mm256_set1_ps(particleDiameterInv);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 minDistanceSq = _mm256_set1_ps(k_minDistanceSq);
+	float weights[2 * NUM_V32_SLOTS];
+	float normalsX[2 * NUM_V32_SLOTS];
+	float normalsY[2 * NUM_V32_SLOTS];
+
+	int k = 0;
+	for (; k + 2 <= numChecks; k += 2)
+	{
+		const FindContactInput& p0 = reordered[checks[k].particleIndex];
+		const FindContactInput& p1 = reordered[checks[k + 1].particleIndex];
+		const FindContactInput* c0 = &reordered[checks[k].comparatorIndex];
+		const FindContactInput* c1 =
+			&reordered[checks[k + 1].comparatorIndex];
+
+		__m128 x0, y0, x1, y1;
+		LoadPositions4(c0, &x0, &y0);
+		LoadPositions4(c1, &x1, &y1);
+		const __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(x0),
+		                                      x1, 1);
+		const __m256 y = _mm256_insertf128_ps(_mm256_castps128_ps256(y0),
+		                                      y1, 1);
+		const __m256 px = _mm256_insertf128_ps(
+			_mm256_set1_ps(p0.position.x), _mm_set1_ps(p1.position.x), 1);
+		const __m256 py = _mm256_insertf128_ps(
+			_mm256_set1_ps(p0.position.y), _mm_set1_ps(p1.position.y), 1);
+
+		const __m256 dx = _mm256_sub_ps(x, px);
+		const __m256 dy = _mm256_sub_ps(y, py);
+		const __m256 distSq = _mm256_add_ps(_mm256_mul_ps(dx, dx),
+		                                    _mm256_mul_ps(dy, dy));
+		const int mask = _mm256_movemask_ps(
+			_mm256_cmp_ps(distSq, diameterSq, _CMP_LT_OQ));
+		if (!mask)
+		{
+			continue;
+		}
+
+		const __m256 clampedSq = _mm256_max_ps(distSq, minDistanceSq);
+		const __m256 invDist = InvSqrt8(clampedSq);
+		_mm256_storeu_ps(weights, _mm256_sub_ps(one, _mm256_mul_ps(
+			_mm256_mul_ps(clampedSq, invDist), diameterInv)));
+		_mm256_storeu_ps(normalsX, _mm256_mul_ps(dx, invDist));
+		_mm256_storeu_ps(normalsY, _mm256_mul_ps(dy, invDist));
+
+		AppendContacts(p0, c0, mask & 0xF, weights, normalsX, normalsY,
+		               flags, contacts);
+		AppendContacts(p1, c1, mask >> NUM_V32_SLOTS,
+		               weights + NUM_V32_SLOTS, normalsX + NUM_V32_SLOTS,
+		               normalsY + NUM_V32_SLOTS, flags, contacts);
+	}
+
+	if (k < numChecks)
+	{
+		FindContactsFromCheck_Sse41(reordered, checks[k],
+		                            _mm256_castps256_ps128(diameterSq),
+		                            _mm256_castps256_ps128(diameterInv),
+		                            flags, contacts);
+	}
+}
+
+extern "C" {
+
+int IsSupported_Simd()
+{
+	return GetCpuLevel() != e_cpuLevelNone;
+}
+
+int CalculateTags_Simd(const b2Vec2* positions,
+                       int count,
+                       const float& inverseDiameter,
+                       uint32* outTags)
+{
+	switch (GetCpuLevel())
+	{
+	case e_cpuLevelAvx2:
+		CalculateTags_Avx2(positions, count, inverseDiameter, outTags);
+		break;
+	case e_cpuLevelSse41:
+		CalculateTags_Sse41(positions, count, inverseDiameter, outTags);
+		break;
+	default:
+		b2Assert(false);
+		return 0;
+	}
+	return count;
+}
+
+void FindContactsFromChecks_Simd(
+	const FindContactInput* reordered,
+	const FindContactCheck* checks,
+	int numChecks,
+	const float& particleDiameterSq,
+	const float& particleDiameterInv,
+	const uint32* flags,
+	b2GrowableBuffer<b2ParticleContact>& contacts)
+{
+	switch (GetCpuLevel())
+	{
+	case e_cpuLevelAvx2:
+		FindContactsFromChecks_Avx2(reordered, checks, numChecks,
+		                            particleDiameterSq, particleDiameterInv,
+		                            flags, contacts);
+		break;
+	case e_cpuLevelSse41:
+		FindContactsFromChecks_Sse41(reordered, checks, numChecks,
+		                             particleDiameterSq, particleDiameterInv,
+		                             flags, contacts);
+		break;
+	default:
+		b2Assert(false);
+		break;
+	}
+}
+
+} // extern "C"
+
+#endif // defined(LIQUIDFUN_SIMD_SSE)
@@ -0,0 +1,114 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#include <Box2D/Particle/b2ParticleEmitter.h>
+#include <Box2D/Collision/Shapes/b2ChainShape.h>
+#include <Box2D/Collision/Shapes/b2EdgeShape.h>
+
+b2ParticleEmitter::b2ParticleEmitter()
+{
+
+	m_system = NULL;
+	m_prev = NULL;
+	m_next = NULL;
+
+	m_shape = NULL;
+	m_transform.SetIdentity();
+	m_emitRate = 0;
+	m_velocity = b2Vec2_zero;
+	m_flags = 0;
+	m_color = b2ParticleColor_zero;
+	m_lifetime = 0.0f;
+	m_userData = NULL;
+	m_recycleOldest = true;
+
+	m_emitRemainder = 0;
+	m_seed = 0;
+
+	m_indices = NULL;
+	m_capacity = 0;
+	m_firstIndex = 0;
+	m_count = 0;
+
+}
+
+b2ParticleEmitter::~b2ParticleEmitter()
+{
+}
+
+float32 b2ParticleEmitter::Random()
+{
+	// Numerical Recipes' linear congruential generator; the top 24 bits
+	// fill the mantissa.
+	m_seed = m_seed * 1664525 + 1013904223;
+	return (float32)(m_seed >> 8) * (1.0f / (1 << 24));
+}
+
+b2Vec2 b2ParticleEmitter::ComputeEmissionPoint()
+{
+	if (!m_shape)
+	{
+		return m_transform.p;
+	}
+	b2Vec2 local;
+	switch (m_shape->GetType())
+	{
+	case b2Shape::e_edge:
+	case b2Shape::e_chain:
+		{
+			// Pick an edge, then a point along it.
+			b2EdgeShape edge;
+			if (m_shape->GetType() == b2Shape::e_edge)
+			{
+				edge = *(b2EdgeShape*) m_shape;
+			}
+			else
+			{
+				const b2ChainShape* chain = (b2ChainShape*) m_shape;
+				const int32 childCount = chain->GetChildCount();
+				chain->GetChildEdge(&edge, b2Min(
+					(int32)(Random() * childCount), childCount - 1));
+			}
+			local = edge.m_vertex1 +
+				Random() * (edge.m_vertex2 - edge.m_vertex1);
+		}
+		break;
+	default:
+		{
+			// Rejection sample the bounding box. Circles and convex polygons
+			// accept most tries; if all of them miss, the last one is kept,
+			// which is still inside the bounding box.
+			b2Transform identity;
+			identity.SetIdentity();
+			b2AABB aabb;
+			m_shape->ComputeAABB(&aabb, identity, 0);
+			const b2Vec2 extent = aabb.upperBound - aabb.lowerBound;
+			const int32 k_maxTries = 8;
+			for (int32 i = 0; i < k_maxTries; i++)
+			{
+				local.Set(aabb.lowerBound.x + Random() * extent.x,
+						  aabb.lowerBound.y + Random() * extent.y);
+				if (m_shape->TestPoint(identity, local))
+				{
+					break;
+				}
+			}
+		}
+		break;
+	}
+	return b2Mul(m_transform, local);
+}
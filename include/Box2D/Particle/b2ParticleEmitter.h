@@ -0,0 +1,277 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#ifndef B2_PARTICLE_EMITTER
+#define B2_PARTICLE_EMITTER
+
+#include <Box2D/Particle/b2Particle.h>
+
+class b2Shape;
+class b2ParticleSystem;
+
+/// @file
+
+/// A particle emitter definition holds all the data needed to construct a
+/// particle emitter.  You can safely re-use these definitions.
+struct b2ParticleEmitterDef
+{
+	b2ParticleEmitterDef()
+	{
+		shape = NULL;
+		position = b2Vec2_zero;
+		angle = 0;
+		emitRate = 0;
+		velocity = b2Vec2_zero;
+		flags = 0;
+		color = b2ParticleColor_zero;
+		lifetime = 0.0f;
+		userData = NULL;
+		capacity = 0;
+		recycleOldest = true;
+		seed = 0;
+	}
+
+	/// The shape particles are emitted in, relative to position and angle.
+	/// Particles are spread uniformly over the area of circles and polygons
+	/// and along edges and chains. If NULL, every particle starts at
+	/// position. The emitter keeps a copy of the shape.
+	const b2Shape* shape;
+
+	/// The world position of the emitter.
+	b2Vec2 position;
+
+	/// The world angle of the emitter in radians.
+	float32 angle;
+
+	/// The number of particles emitted per second.
+	float32 emitRate;
+
+	/// The initial velocity of emitted particles in the emitter's frame, so
+	/// it turns with the emitter.
+	b2Vec2 velocity;
+
+	/// The particle-behavior flags (See #b2ParticleFlag). Flags that link
+	/// particles together, such as b2_springParticle, are not supported.
+	uint32 flags;
+
+	/// The color of the emitted particles.
+	b2ParticleColor color;
+
+	/// Lifetime of the emitted particles in seconds.  A value <= 0.0f
+	/// indicates infinite lifetime.
+	float32 lifetime;
+
+	/// Use this to store application-specific particle data.
+	void* userData;
+
+	/// The most particles of this emitter alive at once. It must be
+	/// positive.
+	int32 capacity;
+
+	/// Whether to reuse the slot of the emitter's oldest particle once it
+	/// has capacity particles, or the particle system is full. If false,
+	/// the emitter pauses until some of its particles are destroyed.
+	bool recycleOldest;
+
+	/// Seed of the random positions within shape.
+	uint32 seed;
+};
+
+/// A source of particles with a fixed budget.
+/// b2ParticleSystem::CreateParticleEmitter creates these.
+///
+/// Every b2World::Step() the emitter adds emitRate particles per second.
+/// It tracks its particles in a ring of capacity indices. Once the ring is
+/// full, each new particle overwrites the oldest one in place, so a steady
+/// stream costs neither buffer growth nor SolveZombie() compaction.
+/// Particles destroyed by other means leave the ring.
+class b2ParticleEmitter
+{
+
+public:
+
+	/// Get the next emitter from the list in b2ParticleSystem.
+	b2ParticleEmitter* GetNext();
+	const b2ParticleEmitter* GetNext() const;
+
+	/// Get the particle system that holds this emitter.
+	b2ParticleSystem* GetParticleSystem();
+	const b2ParticleSystem* GetParticleSystem() const;
+
+	/// Get the number of particles of this emitter that are alive.
+	int32 GetParticleCount() const;
+
+	/// Get the most particles of this emitter alive at once.
+	int32 GetCapacity() const;
+
+	/// Get the index of a particle of this emitter, from the oldest (0) to
+	/// the newest (GetParticleCount() - 1).
+	int32 GetParticleIndex(int32 i) const;
+
+	/// Set the number of particles emitted per second.
+	void SetEmitRate(float32 emitRate);
+
+	/// Get the number of particles emitted per second.
+	float32 GetEmitRate() const;
+
+	/// Set the position and angle of the emitter.
+	void SetTransform(const b2Vec2& position, float32 angle);
+
+	/// Get the position and rotation of the emitter.
+	const b2Transform& GetTransform() const;
+
+	/// Set the initial velocity of emitted particles, in the emitter's
+	/// frame.
+	void SetVelocity(const b2Vec2& velocity);
+
+	/// Get the initial velocity of emitted particles.
+	const b2Vec2& GetVelocity() const;
+
+	/// Get the user data pointer that was provided in the definition.
+	void* GetUserData() const;
+
+	/// Set the user data given to emitted particles.
+	void SetUserData(void* data);
+
+private:
+
+	friend class b2ParticleSystem;
+
+	b2ParticleSystem* m_system;
+	b2ParticleEmitter* m_prev;
+	b2ParticleEmitter* m_next;
+
+	b2Shape* m_shape;
+	b2Transform m_transform;
+	float32 m_emitRate;
+	b2Vec2 m_velocity;
+	uint32 m_flags;
+	b2ParticleColor m_color;
+	float32 m_lifetime;
+	void* m_userData;
+	bool m_recycleOldest;
+
+	/// Fraction of a particle carried over to the next step.
+	float32 m_emitRemainder;
+	/// State of the random number generator.
+	uint32 m_seed;
+
+	/// Indices of the emitter's particles, oldest first, starting at
+	/// m_indices[m_firstIndex] and wrapping around at m_capacity.
+	int32* m_indices;
+	int32 m_capacity;
+	int32 m_firstIndex;
+	int32 m_count;
+
+	b2ParticleEmitter();
+	~b2ParticleEmitter();
+
+	/// Get a random number in [0, 1).
+	float32 Random();
+
+	/// Get the point a new particle starts from, in world coordinates.
+	b2Vec2 ComputeEmissionPoint();
+
+	/// Reference to the i-th oldest entry of the ring.
+	int32& IndexAt(int32 i);
+};
+
+inline b2ParticleEmitter* b2ParticleEmitter::GetNext()
+{
+	return m_next;
+}
+
+inline const b2ParticleEmitter* b2ParticleEmitter::GetNext() const
+{
+	return m_next;
+}
+
+inline b2ParticleSystem* b2ParticleEmitter::GetParticleSystem()
+{
+	return m_system;
+}
+
+inline const b2ParticleSystem* b2ParticleEmitter::GetParticleSystem() const
+{
+	return m_system;
+}
+
+inline int32 b2ParticleEmitter::GetParticleCount() const
+{
+	return m_count;
+}
+
+inline int32 b2ParticleEmitter::GetCapacity() const
+{
+	return m_capacity;
+}
+
+inline int32& b2ParticleEmitter::IndexAt(int32 i)
+{
+	const int32 k = m_firstIndex + i;
+	return m_indices[k < m_capacity ? k : k - m_capacity];
+}
+
+inline int32 b2ParticleEmitter::GetParticleIndex(int32 i) const
+{
+	b2Assert(i >= 0 && i < m_count);
+	const int32 k = m_firstIndex + i;
+	return m_indices[k < m_capacity ? k : k - m_capacity];
+}
+
+inline void b2ParticleEmitter::SetEmitRate(float32 emitRate)
+{
+	m_emitRate = emitRate;
+}
+
+inline float32 b2ParticleEmitter::GetEmitRate() const
+{
+	return m_emitRate;
+}
+
+inline void b2ParticleEmitter::SetTransform(const b2Vec2& position,
+											float32 angle)
+{
+	m_transform.Set(position, angle);
+}
+
+inline const b2Transform& b2ParticleEmitter::GetTransform() const
+{
+	return m_transform;
+}
+
+inline void b2ParticleEmitter::SetVelocity(const b2Vec2& velocity)
+{
+	m_velocity = velocity;
+}
+
+inline const b2Vec2& b2ParticleEmitter::GetVelocity() const
+{
+	return m_velocity;
+}
+
+inline void* b2ParticleEmitter::GetUserData() const
+{
+	return m_userData;
+}
+
+inline void b2ParticleEmitter::SetUserData(void* data)
+{
+	m_userData = data;
+}
+
+#endif
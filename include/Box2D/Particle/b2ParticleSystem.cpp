@@ -17,9 +17,12 @@
 */
 #include <Box2D/Particle/b2ParticleSystem.h>
 #include <Box2D/Particle/b2ParticleGroup.h>
+#include <Box2D/Particle/b2ParticleEmitter.h>
 #include <Box2D/Particle/b2VoronoiDiagram.h>
 #include <Box2D/Particle/b2ParticleAssembly.h>
+#include <Box2D/Particle/b2TagSort.h>
 #include <Box2D/Common/b2BlockAllocator.h>
+#include <Box2D/Common/b2Timer.h>
 #include <Box2D/Dynamics/b2World.h>
 #include <Box2D/Dynamics/b2WorldCallbacks.h>
 #include <Box2D/Dynamics/b2Body.h>
@@ -27,6 +30,8 @@
 #include <Box2D/Collision/Shapes/b2Shape.h>
 #include <Box2D/Collision/Shapes/b2EdgeShape.h>
 #include <Box2D/Collision/Shapes/b2ChainShape.h>
+#include <Box2D/Collision/Shapes/b2CircleShape.h>
+#include <Box2D/Collision/Shapes/b2PolygonShape.h>
 #include <algorithm>
 
 // Define LIQUIDFUN_SIMD_TEST_VS_REFERENCE to run both SIMD and reference
@@ -391,7 +396,16 @@ b2ParticleSystem::b2ParticleSystem(const b2ParticleSystemDef* def,
 	m_contactBuffer(world->m_blockAllocator),
 	m_bodyContactBuffer(world->m_blockAllocator),
 	m_pairBuffer(world->m_blockAllocator),
-	m_triadBuffer(world->m_blockAllocator)
+	m_triadBuffer(world->m_blockAllocator),
+	m_expirationEntryBuffer(world->m_blockAllocator),
+	m_neighborPairBuffer(world->m_blockAllocator),
+	m_neighborPositionBuffer(world->m_blockAllocator),
+	m_sleepingContactBuffer(world->m_blockAllocator),
+	m_sleepRegionBuffer(world->m_blockAllocator),
+	m_awakeProxyBuffer(world->m_blockAllocator),
+	m_bodyImpulseBuffer(world->m_blockAllocator),
+	m_bodyContactImpulseBuffer(world->m_blockAllocator),
+	m_staticFieldBuffer(world->m_blockAllocator)
 {
 	b2Assert(def);
 	m_paused = false;
@@ -411,26 +425,50 @@ b2ParticleSystem::b2ParticleSystem(const b2ParticleSystemDef* def,
 
 	m_count = 0;
 	m_internalAllocatedCapacity = 0;
+	m_reservedCapacity = 0;
 	m_forceBuffer = NULL;
 	m_weightBuffer = NULL;
 	m_staticPressureBuffer = NULL;
 	m_accumulationBuffer = NULL;
 	m_accumulation2Buffer = NULL;
 	m_depthBuffer = NULL;
+	m_sleepTimeBuffer = NULL;
+	m_sleepStateBuffer = NULL;
 	m_groupBuffer = NULL;
 
 	m_groupCount = 0;
 	m_groupList = NULL;
 
+	m_emitterCount = 0;
+	m_emitterList = NULL;
+
 	b2Assert(def->lifetimeGranularity > 0.0f);
 	m_def = *def;
 
 	m_world = world;
 
+	m_taskScheduler = NULL;
+	m_contactColorOffsets[0] = 0;
+	m_contactColorOffsets[1] = 0;
+	m_contactColorCount = 0;
+	m_neighborListValid = false;
+	m_sleepingCount = 0;
+	m_stepsSinceSpatialReorder = 0;
+	m_indexGeneration = 0;
+	m_zombieCount = 0;
+	memset(&m_profile, 0, sizeof(m_profile));
+
 	m_stuckThreshold = 0;
 
 	m_timeElapsed = 0;
 	m_expirationTimeBufferRequiresSorting = false;
+	for (int32 i = 0; i < k_expirationWheelSize; i++)
+	{
+		m_expirationWheel[i] = -1;
+	}
+	m_freeExpirationEntry = -1;
+	m_expiredTime = 0;
+	m_expirationSortTimestamp = -1;
 
 	SetDestructionByAge(m_def.destroyByAge);
 }
@@ -441,6 +479,10 @@ b2ParticleSystem::~b2ParticleSystem()
 	{
 		DestroyParticleGroup(m_groupList);
 	}
+	while (m_emitterList)
+	{
+		DestroyParticleEmitter(m_emitterList);
+	}
 
 	FreeUserOverridableBuffer(&m_handleIndexBuffer);
 	FreeUserOverridableBuffer(&m_flagsBuffer);
@@ -459,7 +501,14 @@ b2ParticleSystem::~b2ParticleSystem()
 	FreeBuffer(&m_accumulationBuffer, m_internalAllocatedCapacity);
 	FreeBuffer(&m_accumulation2Buffer, m_internalAllocatedCapacity);
 	FreeBuffer(&m_depthBuffer, m_internalAllocatedCapacity);
+	FreeBuffer(&m_sleepTimeBuffer, m_internalAllocatedCapacity);
+	FreeBuffer(&m_sleepStateBuffer, m_internalAllocatedCapacity);
 	FreeBuffer(&m_groupBuffer, m_internalAllocatedCapacity);
+	for (int32 k = 0; k < m_staticFieldBuffer.GetCount(); k++)
+	{
+		StaticField& field = m_staticFieldBuffer[k];
+		FreeBuffer(&field.samples, field.width * field.height);
+	}
 }
 
 template <typename T> void b2ParticleSystem::FreeBuffer(T** b, int capacity)
@@ -485,12 +534,13 @@ template <typename T> void b2ParticleSystem::FreeUserOverridableBuffer(
 template <typename T> T* b2ParticleSystem::ReallocateBuffer(
 	T* oldBuffer, int32 oldCapacity, int32 newCapacity)
 {
-	b2Assert(newCapacity > oldCapacity);
+	b2Assert(newCapacity != oldCapacity);
 	T* newBuffer = (T*) m_world->m_blockAllocator.Allocate(
 		sizeof(T) * newCapacity);
 	if (oldBuffer)
 	{
-		memcpy(newBuffer, oldBuffer, sizeof(T) * oldCapacity);
+		memcpy(newBuffer, oldBuffer,
+			   sizeof(T) * b2Min(oldCapacity, newCapacity));
 		m_world->m_blockAllocator.Free(oldBuffer, sizeof(T) * oldCapacity);
 	}
 	return newBuffer;
@@ -501,7 +551,7 @@ template <typename T> T* b2ParticleSystem::ReallocateBuffer(
 	T* buffer, int32 userSuppliedCapacity, int32 oldCapacity,
 	int32 newCapacity, bool deferred)
 {
-	b2Assert(newCapacity > oldCapacity);
+	b2Assert(newCapacity != oldCapacity);
 	// A 'deferred' buffer is reallocated only if it is not NULL.
 	// If 'userSuppliedCapacity' is not zero, buffer is user supplied and must
 	// be kept.
@@ -518,7 +568,7 @@ template <typename T> T* b2ParticleSystem::ReallocateBuffer(
 	UserOverridableBuffer<T>* buffer, int32 oldCapacity, int32 newCapacity,
 	bool deferred)
 {
-	b2Assert(newCapacity > oldCapacity);
+	b2Assert(newCapacity != oldCapacity);
 	return ReallocateBuffer(buffer->data, buffer->userSuppliedCapacity,
 							oldCapacity, newCapacity, deferred);
 }
@@ -527,15 +577,19 @@ template <typename T> T* b2ParticleSystem::ReallocateBuffer(
 /// pool for handle allocation.
 void b2ParticleSystem::ReallocateHandleBuffers(int32 newCapacity)
 {
-	b2Assert(newCapacity > m_internalAllocatedCapacity);
+	b2Assert(newCapacity != m_internalAllocatedCapacity);
 	// Reallocate a new handle / index map buffer, copying old handle pointers
 	// is fine since they're kept around.
 	m_handleIndexBuffer.data = ReallocateBuffer(
 		&m_handleIndexBuffer, m_internalAllocatedCapacity, newCapacity,
 		true);
-	// Set the size of the next handle allocation.
-	m_handleAllocator.SetItemsPerSlab(newCapacity -
-									  m_internalAllocatedCapacity);
+	// Set the size of the next handle allocation. Handles already allocated
+	// stay put when the map shrinks.
+	if (newCapacity > m_internalAllocatedCapacity)
+	{
+		m_handleAllocator.SetItemsPerSlab(newCapacity -
+										  m_internalAllocatedCapacity);
+	}
 }
 
 template <typename T> T* b2ParticleSystem::RequestBuffer(T* buffer)
@@ -581,7 +635,21 @@ void b2ParticleSystem::ReallocateInternalAllocatedBuffers(int32 capacity)
 	capacity = LimitCapacity(capacity, m_velocityBuffer.userSuppliedCapacity);
 	capacity = LimitCapacity(capacity, m_colorBuffer.userSuppliedCapacity);
 	capacity = LimitCapacity(capacity, m_userDataBuffer.userSuppliedCapacity);
+#ifdef B2_USE_16_BIT_PARTICLE_INDICES
+	// Nor beyond what contacts, pairs and triads can index.
+	capacity = LimitCapacity(capacity, b2_maxParticleIndex + 1);
+#endif
 	if (m_internalAllocatedCapacity < capacity)
+	{
+		ResizeInternalAllocatedBuffers(capacity);
+	}
+}
+
+// Grow or shrink every internally allocated particle buffer to capacity.
+void b2ParticleSystem::ResizeInternalAllocatedBuffers(int32 capacity)
+{
+	b2Assert(capacity >= m_count);
+	if (m_internalAllocatedCapacity != capacity)
 	{
 		ReallocateHandleBuffers(capacity);
 		m_flagsBuffer.data = ReallocateBuffer(
@@ -618,6 +686,11 @@ void b2ParticleSystem::ReallocateInternalAllocatedBuffers(int32 capacity)
 			true);
 		m_depthBuffer = ReallocateBuffer(
 			m_depthBuffer, 0, m_internalAllocatedCapacity, capacity, true);
+		m_sleepTimeBuffer = ReallocateBuffer(
+			m_sleepTimeBuffer, 0, m_internalAllocatedCapacity, capacity, true);
+		m_sleepStateBuffer = ReallocateBuffer(
+			m_sleepStateBuffer, 0, m_internalAllocatedCapacity, capacity,
+			true);
 		m_colorBuffer.data = ReallocateBuffer(
 			&m_colorBuffer, m_internalAllocatedCapacity, capacity, true);
 		m_groupBuffer = ReallocateBuffer(
@@ -634,6 +707,85 @@ void b2ParticleSystem::ReallocateInternalAllocatedBuffers(int32 capacity)
 	}
 }
 
+// The capacity a buffer holding count elements in capacity is shrunk to.
+// Without compact, only a buffer less than a quarter full is shrunk, and to
+// twice its contents, so that a count that swings back and forth doesn't
+// reallocate every step.
+static int32 ComputeShrunkCapacity(int32 count, int32 capacity, bool compact)
+{
+	if (compact)
+	{
+		return count;
+	}
+	if (4 * count < capacity)
+	{
+		return b2Min(capacity,
+					 b2Max(2 * count, b2_minParticleSystemBufferCapacity));
+	}
+	return capacity;
+}
+
+template <typename T> static void ShrinkGrowableBuffer(
+	b2GrowableBuffer<T>& buffer, bool compact)
+{
+	buffer.SetCapacity(ComputeShrunkCapacity(
+		buffer.GetCount(), buffer.GetCapacity(), compact));
+}
+
+void b2ParticleSystem::ShrinkBuffers(bool compact)
+{
+	if (m_internalAllocatedCapacity > 0)
+	{
+		int32 capacity = ComputeShrunkCapacity(
+			m_count, m_internalAllocatedCapacity, compact);
+		capacity = b2Max(capacity, compact ? m_count : b2Max(m_reservedCapacity,
+			LimitCapacity(b2_minParticleSystemBufferCapacity,
+						  m_def.maxCount)));
+		if (capacity < m_internalAllocatedCapacity)
+		{
+			ResizeInternalAllocatedBuffers(capacity);
+		}
+	}
+
+	ShrinkGrowableBuffer(m_proxyBuffer, compact);
+	ShrinkGrowableBuffer(m_contactBuffer, compact);
+	ShrinkGrowableBuffer(m_bodyContactBuffer, compact);
+	ShrinkGrowableBuffer(m_pairBuffer, compact);
+	ShrinkGrowableBuffer(m_triadBuffer, compact);
+	ShrinkGrowableBuffer(m_stuckParticleBuffer, compact);
+	ShrinkGrowableBuffer(m_sleepingContactBuffer, compact);
+	ShrinkGrowableBuffer(m_sleepRegionBuffer, compact);
+	ShrinkGrowableBuffer(m_awakeProxyBuffer, compact);
+	ShrinkGrowableBuffer(m_bodyImpulseBuffer, compact);
+	ShrinkGrowableBuffer(m_bodyContactImpulseBuffer, compact);
+	ShrinkGrowableBuffer(m_neighborPairBuffer, compact);
+	ShrinkGrowableBuffer(m_neighborPositionBuffer, compact);
+	ShrinkGrowableBuffer(m_expirationEntryBuffer, compact);
+}
+
+void b2ParticleSystem::Reserve(int32 capacity)
+{
+	b2Assert(m_world->IsLocked() == false);
+	if (m_world->IsLocked())
+	{
+		return;
+	}
+	ReallocateInternalAllocatedBuffers(capacity);
+	m_proxyBuffer.Reserve(m_internalAllocatedCapacity);
+	m_reservedCapacity = capacity;
+}
+
+void b2ParticleSystem::Compact()
+{
+	b2Assert(m_world->IsLocked() == false);
+	if (m_world->IsLocked())
+	{
+		return;
+	}
+	m_reservedCapacity = 0;
+	ShrinkBuffers(true);
+}
+
 int32 b2ParticleSystem::CreateParticle(const b2ParticleDef& def)
 {
 	b2Assert(m_world->IsLocked() == false);
@@ -690,6 +842,10 @@ int32 b2ParticleSystem::CreateParticle(const b2ParticleDef& def)
 	{
 		m_depthBuffer[index] = 0;
 	}
+	if (m_sleepTimeBuffer)
+	{
+		m_sleepTimeBuffer[index] = 0;
+	}
 	if (m_colorBuffer.data || !def.color.IsZero())
 	{
 		m_colorBuffer.data = RequestBuffer(m_colorBuffer.data);
@@ -711,12 +867,19 @@ int32 b2ParticleSystem::CreateParticle(const b2ParticleDef& def)
 	const bool finiteLifetime = def.lifetime > 0;
 	if (m_expirationTimeBuffer.data || finiteLifetime)
 	{
+		// Clear the time a destroyed particle may have left in the slot, so
+		// SetParticleLifetime() queues the new one.
+		if (m_expirationTimeBuffer.data)
+		{
+			m_expirationTimeBuffer.data[index] = 0;
+		}
 		SetParticleLifetime(index, finiteLifetime ? def.lifetime :
 								ExpirationTimeToLifetime(
 									-GetQuantizedTimeElapsed()));
 		// Add a reference to the newly added particle to the end of the
 		// queue.
 		m_indexByExpirationTimeBuffer.data[index] = index;
+		m_expirationTimeBufferRequiresSorting = true;
 	}
 
 	proxy.index = index;
@@ -744,6 +907,212 @@ int32 b2ParticleSystem::CreateParticle(const b2ParticleDef& def)
 	return index;
 }
 
+// Make room for count more particles, growing the buffers at most once, and
+// return how many of them fit.
+int32 b2ParticleSystem::ReserveParticles(int32 count)
+{
+	if (m_count + count > m_internalAllocatedCapacity)
+	{
+		// Double the particle capacity, or more if the batch needs it.
+		ReallocateInternalAllocatedBuffers(b2Max(m_count + count,
+			m_count ? 2 * m_count : b2_minParticleSystemBufferCapacity));
+	}
+	const int32 excess = m_count + count - m_internalAllocatedCapacity;
+	if (excess > 0 && m_def.destroyByAge && m_count)
+	{
+		// Destroy the oldest particles *now* so that there is room for the
+		// new ones.
+		for (int32 i = 0; i < b2Min(excess, m_count); i++)
+		{
+			DestroyOldestParticle(i, false);
+		}
+		SolveZombie();
+	}
+	return b2Min(count, m_internalAllocatedCapacity - m_count);
+}
+
+int32 b2ParticleSystem::CreateParticles(const b2ParticleBatchDef& def)
+{
+	b2Assert(m_world->IsLocked() == false);
+	if (m_world->IsLocked())
+	{
+		return b2_invalidParticleIndex;
+	}
+	b2Assert(def.count == 0 || def.positionData);
+	const int32 count = def.count > 0 ? ReserveParticles(def.count) : 0;
+	if (count <= 0)
+	{
+		return b2_invalidParticleIndex;
+	}
+	return InitializeParticles(def, count);
+}
+
+// Append the first count particles of def. There must already be room for
+// them.
+int32 b2ParticleSystem::InitializeParticles(const b2ParticleBatchDef& def,
+											int32 count)
+{
+	b2Assert(m_count + count <= m_internalAllocatedCapacity);
+	b2ParticleGroup* group = def.group;
+	if (group && group->m_firstIndex < group->m_lastIndex)
+	{
+		// Move particles in the group just before the new particles.
+		RotateBuffer(group->m_firstIndex, group->m_lastIndex, m_count);
+		b2Assert(group->m_lastIndex == m_count);
+	}
+	const int32 firstIndex = m_count;
+	const int32 lastIndex = m_count + count;
+	m_count = lastIndex;
+
+	// Initialize the buffers the same way CreateParticle() does, one buffer
+	// at a time.
+	if (def.flagsData)
+	{
+		memcpy(&m_flagsBuffer.data[firstIndex], def.flagsData,
+			   sizeof(*def.flagsData) * count);
+	}
+	else
+	{
+		std::fill(&m_flagsBuffer.data[firstIndex],
+				  &m_flagsBuffer.data[lastIndex], def.flags);
+	}
+	if (m_lastBodyContactStepBuffer.data)
+	{
+		memset(&m_lastBodyContactStepBuffer.data[firstIndex], 0,
+			   sizeof(*m_lastBodyContactStepBuffer.data) * count);
+	}
+	if (m_bodyContactCountBuffer.data)
+	{
+		memset(&m_bodyContactCountBuffer.data[firstIndex], 0,
+			   sizeof(*m_bodyContactCountBuffer.data) * count);
+	}
+	if (m_consecutiveContactStepsBuffer.data)
+	{
+		memset(&m_consecutiveContactStepsBuffer.data[firstIndex], 0,
+			   sizeof(*m_consecutiveContactStepsBuffer.data) * count);
+	}
+	memcpy(&m_positionBuffer.data[firstIndex], def.positionData,
+		   sizeof(*def.positionData) * count);
+	if (def.velocityData)
+	{
+		memcpy(&m_velocityBuffer.data[firstIndex], def.velocityData,
+			   sizeof(*def.velocityData) * count);
+	}
+	else
+	{
+		std::fill(&m_velocityBuffer.data[firstIndex],
+				  &m_velocityBuffer.data[lastIndex], b2Vec2_zero);
+	}
+	memset(&m_weightBuffer[firstIndex], 0, sizeof(*m_weightBuffer) * count);
+	std::fill(&m_forceBuffer[firstIndex], &m_forceBuffer[lastIndex],
+			  b2Vec2_zero);
+	if (m_staticPressureBuffer)
+	{
+		memset(&m_staticPressureBuffer[firstIndex], 0,
+			   sizeof(*m_staticPressureBuffer) * count);
+	}
+	if (m_depthBuffer)
+	{
+		memset(&m_depthBuffer[firstIndex], 0, sizeof(*m_depthBuffer) * count);
+	}
+	if (m_sleepTimeBuffer)
+	{
+		memset(&m_sleepTimeBuffer[firstIndex], 0,
+			   sizeof(*m_sleepTimeBuffer) * count);
+	}
+	if (m_colorBuffer.data || def.colorData || !def.color.IsZero())
+	{
+		m_colorBuffer.data = RequestBuffer(m_colorBuffer.data);
+		if (def.colorData)
+		{
+			std::copy(def.colorData, def.colorData + count,
+					  &m_colorBuffer.data[firstIndex]);
+		}
+		else
+		{
+			std::fill(&m_colorBuffer.data[firstIndex],
+					  &m_colorBuffer.data[lastIndex], def.color);
+		}
+	}
+	if (m_userDataBuffer.data || def.userData)
+	{
+		m_userDataBuffer.data = RequestBuffer(m_userDataBuffer.data);
+		std::fill(&m_userDataBuffer.data[firstIndex],
+				  &m_userDataBuffer.data[lastIndex], def.userData);
+	}
+	if (m_handleIndexBuffer.data)
+	{
+		memset(&m_handleIndexBuffer.data[firstIndex], 0,
+			   sizeof(*m_handleIndexBuffer.data) * count);
+	}
+	m_proxyBuffer.Reserve(m_proxyBuffer.GetCount() + count);
+	for (int32 i = firstIndex; i < lastIndex; i++)
+	{
+		m_proxyBuffer.Append().index = i;
+	}
+
+	// If particle lifetimes are enabled or the lifetime is set in the batch
+	// definition, give every new particle the lifetime of the first one.
+	const bool finiteLifetime = def.lifetime > 0;
+	if (m_expirationTimeBuffer.data || finiteLifetime)
+	{
+		if (m_expirationTimeBuffer.data)
+		{
+			m_expirationTimeBuffer.data[firstIndex] = 0;
+		}
+		SetParticleLifetime(firstIndex, finiteLifetime ? def.lifetime :
+								ExpirationTimeToLifetime(
+									-GetQuantizedTimeElapsed()));
+		const int32 expirationTime = m_expirationTimeBuffer.data[firstIndex];
+		std::fill(&m_expirationTimeBuffer.data[firstIndex + 1],
+				  &m_expirationTimeBuffer.data[lastIndex], expirationTime);
+		// Add references to the newly added particles to the end of the
+		// queue.
+		for (int32 i = firstIndex; i < lastIndex; i++)
+		{
+			m_indexByExpirationTimeBuffer.data[i] = i;
+		}
+		for (int32 i = firstIndex + 1; i < lastIndex; i++)
+		{
+			QueueExpiration(i, expirationTime);
+		}
+		m_expirationTimeBufferRequiresSorting = true;
+	}
+
+	std::fill(&m_groupBuffer[firstIndex], &m_groupBuffer[lastIndex], group);
+	if (group)
+	{
+		if (group->m_firstIndex >= group->m_lastIndex)
+		{
+			// If the group is empty, reset the index range to start at the
+			// new particles.
+			group->m_firstIndex = firstIndex;
+		}
+		group->m_lastIndex = lastIndex;
+	}
+
+	// Account for the new flags the way SetParticleFlags() does.
+	uint32 newFlags = 0;
+	for (int32 i = firstIndex; i < lastIndex; i++)
+	{
+		newFlags |= m_flagsBuffer.data[i];
+		m_zombieCount += (m_flagsBuffer.data[i] & b2_zombieParticle) != 0;
+	}
+	if (~m_allParticleFlags & newFlags)
+	{
+		if (newFlags & b2_tensileParticle)
+		{
+			m_accumulation2Buffer = RequestBuffer(m_accumulation2Buffer);
+		}
+		if (newFlags & b2_colorMixingParticle)
+		{
+			m_colorBuffer.data = RequestBuffer(m_colorBuffer.data);
+		}
+		m_allParticleFlags |= newFlags;
+	}
+	return firstIndex;
+}
+
 /// Retrieve a handle to the particle at the specified index.
 const b2ParticleHandle* b2ParticleSystem::GetParticleHandleFromIndex(
 	const int32 index)
@@ -783,6 +1152,13 @@ void b2ParticleSystem::DestroyOldestParticle(
 	b2Assert(index >= 0 && index < particleCount);
 	// Make sure particle lifetime tracking is enabled.
 	b2Assert(m_indexByExpirationTimeBuffer.data);
+	// Sort at most once between steps. Particles created after that are at
+	// the end of the array, so they're taken as the oldest finite ones.
+	if (m_expirationSortTimestamp != m_timestamp)
+	{
+		SortIndexByExpirationTime();
+		m_expirationSortTimestamp = m_timestamp;
+	}
 	// Destroy the oldest particle (preferring to destroy finite
 	// lifetime particles first) to free a slot in the buffer.
 	const int32 oldestFiniteLifetimeParticle =
@@ -871,6 +1247,35 @@ int32 b2ParticleSystem::CreateParticleForGroup(
 	return CreateParticle(particleDef);
 }
 
+void b2ParticleSystem::CreateParticlesForGroup(
+	const b2ParticleGroupDef& groupDef, const b2Transform& xf,
+	const b2Vec2* positions, int32 count)
+{
+	b2Vec2* worldPositions = (b2Vec2*) m_world->m_stackAllocator.Allocate(
+		sizeof(b2Vec2) * count);
+	b2Vec2* velocities = (b2Vec2*) m_world->m_stackAllocator.Allocate(
+		sizeof(b2Vec2) * count);
+	for (int32 i = 0; i < count; i++)
+	{
+		worldPositions[i] = b2Mul(xf, positions[i]);
+		velocities[i] =
+			groupDef.linearVelocity +
+			b2Cross(groupDef.angularVelocity,
+					worldPositions[i] - groupDef.position);
+	}
+	b2ParticleBatchDef batchDef;
+	batchDef.count = count;
+	batchDef.positionData = worldPositions;
+	batchDef.velocityData = velocities;
+	batchDef.flags = groupDef.flags;
+	batchDef.color = groupDef.color;
+	batchDef.lifetime = groupDef.lifetime;
+	batchDef.userData = groupDef.userData;
+	CreateParticles(batchDef);
+	m_world->m_stackAllocator.Free(velocities);
+	m_world->m_stackAllocator.Free(worldPositions);
+}
+
 void b2ParticleSystem::CreateParticlesStrokeShapeForGroup(
 	const b2Shape *shape,
 	const b2ParticleGroupDef& groupDef, const b2Transform& xf)
@@ -906,8 +1311,62 @@ void b2ParticleSystem::CreateParticlesStrokeShapeForGroup(
 	}
 }
 
+// Find the range of x where the horizontal line at y crosses a circle or
+// polygon in its own frame. Edges and chains have no interior.
+static bool ComputeShapeSpan(
+	const b2Shape* shape, float32 y, float32* lower, float32* upper)
+{
+	switch (shape->GetType())
+	{
+	case b2Shape::e_circle:
+		{
+			const b2CircleShape* circle = (const b2CircleShape*) shape;
+			const float32 dy = y - circle->m_p.y;
+			const float32 dxSquared =
+				circle->m_radius * circle->m_radius - dy * dy;
+			if (dxSquared < 0)
+			{
+				return false;
+			}
+			const float32 dx = b2Sqrt(dxSquared);
+			*lower = circle->m_p.x - dx;
+			*upper = circle->m_p.x + dx;
+			return true;
+		}
+	case b2Shape::e_polygon:
+		{
+			// Intersect the half-planes dot(normal, p - vertex) <= 0 with the
+			// line.
+			const b2PolygonShape* polygon = (const b2PolygonShape*) shape;
+			*lower = -b2_maxFloat;
+			*upper = b2_maxFloat;
+			for (int32 i = 0; i < polygon->m_count; i++)
+			{
+				const b2Vec2& normal = polygon->m_normals[i];
+				const float32 c = b2Dot(normal, polygon->m_vertices[i]) -
+					normal.y * y;
+				if (normal.x > 0)
+				{
+					*upper = b2Min(*upper, c / normal.x);
+				}
+				else if (normal.x < 0)
+				{
+					*lower = b2Max(*lower, c / normal.x);
+				}
+				else if (c < 0)
+				{
+					return false;
+				}
+			}
+			return *lower <= *upper;
+		}
+	default:
+		return false;
+	}
+}
+
 void b2ParticleSystem::CreateParticlesFillShapeForGroup(
-	const b2Shape *shape,
+	const b2Shape* const* shapes, int32 shapeCount,
 	const b2ParticleGroupDef& groupDef, const b2Transform& xf)
 {
 	float32 stride = groupDef.stride;
@@ -918,20 +1377,105 @@ void b2ParticleSystem::CreateParticlesFillShapeForGroup(
 	b2Transform identity;
 	identity.SetIdentity();
 	b2AABB aabb;
-	b2Assert(shape->GetChildCount() == 1);
-	shape->ComputeAABB(&aabb, identity, 0);
-	for (float32 y = floorf(aabb.lowerBound.y / stride) * stride;
-		y < aabb.upperBound.y; y += stride)
+	aabb.lowerBound.Set(b2_maxFloat, b2_maxFloat);
+	aabb.upperBound.Set(-b2_maxFloat, -b2_maxFloat);
+	for (int32 i = 0; i < shapeCount; i++)
 	{
-		for (float32 x = floorf(aabb.lowerBound.x / stride) * stride;
-			x < aabb.upperBound.x; x += stride)
+		const int32 childCount = shapes[i]->GetChildCount();
+		for (int32 childIndex = 0; childIndex < childCount; childIndex++)
 		{
-			b2Vec2 p(x, y);
-			if (shape->TestPoint(identity, p))
+			b2AABB childAABB;
+			shapes[i]->ComputeAABB(&childAABB, identity, childIndex);
+			aabb.Combine(childAABB);
+		}
+	}
+
+	// The particles sit on a lattice aligned to multiples of the stride,
+	// limited to the columns and rows that start inside the AABB.
+	const float32 lowerX = floorf(aabb.lowerBound.x / stride) * stride;
+	const float32 lowerY = floorf(aabb.lowerBound.y / stride) * stride;
+	int32 columnCount = 0;
+	while (lowerX + columnCount * stride < aabb.upperBound.x)
+	{
+		columnCount++;
+	}
+
+	// Each shape is convex, so it covers one run of columns in a row. The
+	// run is found analytically and its ends are checked with TestPoint()
+	// so the lattice points are exactly those a full scan would find.
+	int32* spans = (int32*) m_world->m_stackAllocator.Allocate(
+		sizeof(int32) * 2 * b2Max(shapeCount, 1));
+	b2GrowableBuffer<b2Vec2> positions(m_world->m_blockAllocator);
+	for (int32 row = 0; lowerY + row * stride < aabb.upperBound.y; row++)
+	{
+		const float32 y = lowerY + row * stride;
+		int32 spanCount = 0;
+		for (int32 i = 0; i < shapeCount; i++)
+		{
+			const b2Shape* shape = shapes[i];
+			float32 lower, upper;
+			if (!ComputeShapeSpan(shape, y, &lower, &upper))
+			{
+				continue;
+			}
+			int32 first = b2Max((int32) ceilf((lower - lowerX) / stride), 0);
+			int32 last = b2Min((int32) floorf((upper - lowerX) / stride),
+							   columnCount - 1);
+			while (first <= last &&
+				   !shape->TestPoint(identity,
+									 b2Vec2(lowerX + first * stride, y)))
+			{
+				first++;
+			}
+			while (first > 0 &&
+				   shape->TestPoint(identity,
+									b2Vec2(lowerX + (first - 1) * stride, y)))
+			{
+				first--;
+			}
+			while (last >= first &&
+				   !shape->TestPoint(identity,
+									 b2Vec2(lowerX + last * stride, y)))
+			{
+				last--;
+			}
+			while (last + 1 < columnCount &&
+				   shape->TestPoint(identity,
+									b2Vec2(lowerX + (last + 1) * stride, y)))
 			{
-				CreateParticleForGroup(groupDef, xf, p);
+				last++;
 			}
+			if (first > last)
+			{
+				continue;
+			}
+			// Insert the span, keeping them sorted by their first column.
+			int32 k = spanCount++;
+			for (; k > 0 && spans[2 * (k - 1)] > first; k--)
+			{
+				spans[2 * k] = spans[2 * (k - 1)];
+				spans[2 * k + 1] = spans[2 * (k - 1) + 1];
+			}
+			spans[2 * k] = first;
+			spans[2 * k + 1] = last;
 		}
+		// Emit the union of the spans from left to right.
+		int32 next = 0;
+		for (int32 k = 0; k < spanCount; k++)
+		{
+			for (int32 column = b2Max(spans[2 * k], next);
+				 column <= spans[2 * k + 1]; column++)
+			{
+				positions.Append() = b2Vec2(lowerX + column * stride, y);
+			}
+			next = b2Max(next, spans[2 * k + 1] + 1);
+		}
+	}
+	m_world->m_stackAllocator.Free(spans);
+	if (positions.GetCount())
+	{
+		CreateParticlesForGroup(groupDef, xf, positions.Data(),
+								positions.GetCount());
 	}
 }
 
@@ -946,7 +1490,7 @@ void b2ParticleSystem::CreateParticlesWithShapeForGroup(
 		break;
 	case b2Shape::e_polygon:
 	case b2Shape::e_circle:
-		CreateParticlesFillShapeForGroup(shape, groupDef, xf);
+		CreateParticlesFillShapeForGroup(&shape, 1, groupDef, xf);
 		break;
 	default:
 		b2Assert(false);
@@ -954,92 +1498,6 @@ void b2ParticleSystem::CreateParticlesWithShapeForGroup(
 	}
 }
 
-void b2ParticleSystem::CreateParticlesWithShapesForGroup(
-	const b2Shape* const* shapes, int32 shapeCount,
-	const b2ParticleGroupDef& groupDef, const b2Transform& xf)
-{
-	class CompositeShape : public b2Shape
-	{
-	public:
-		CompositeShape(const b2Shape* const* shapes, int32 shapeCount)
-		{
-			m_shapes = shapes;
-			m_shapeCount = shapeCount;
-		}
-		b2Shape* Clone(b2BlockAllocator* allocator) const
-		{
-			b2Assert(false);
-			B2_NOT_USED(allocator);
-			return NULL;
-		}
-		int32 GetChildCount() const
-		{
-			return 1;
-		}
-		bool TestPoint(const b2Transform& xf, const b2Vec2& p) const
-		{
-			for (int32 i = 0; i < m_shapeCount; i++)
-			{
-				if (m_shapes[i]->TestPoint(xf, p))
-				{
-					return true;
-				}
-			}
-			return false;
-		}
-		void ComputeDistance(const b2Transform& xf, const b2Vec2& p,
-					float32* distance, b2Vec2* normal, int32 childIndex) const
-		{
-			b2Assert(false);
-			B2_NOT_USED(xf);
-			B2_NOT_USED(p);
-			B2_NOT_USED(distance);
-			B2_NOT_USED(normal);
-			B2_NOT_USED(childIndex);
-		}
-		bool RayCast(b2RayCastOutput* output, const b2RayCastInput& input,
-						const b2Transform& transform, int32 childIndex) const
-		{
-			b2Assert(false);
-			B2_NOT_USED(output);
-			B2_NOT_USED(input);
-			B2_NOT_USED(transform);
-			B2_NOT_USED(childIndex);
-			return false;
-		}
-		void ComputeAABB(
-				b2AABB* aabb, const b2Transform& xf, int32 childIndex) const
-		{
-			B2_NOT_USED(childIndex);
-			aabb->lowerBound.x = +FLT_MAX;
-			aabb->lowerBound.y = +FLT_MAX;
-			aabb->upperBound.x = -FLT_MAX;
-			aabb->upperBound.y = -FLT_MAX;
-			b2Assert(childIndex == 0);
-			for (int32 i = 0; i < m_shapeCount; i++)
-			{
-				int32 childCount = m_shapes[i]->GetChildCount();
-				for (int32 j = 0; j < childCount; j++)
-				{
-					b2AABB subaabb;
-					m_shapes[i]->ComputeAABB(&subaabb, xf, j);
-					aabb->Combine(subaabb);
-				}
-			}
-		}
-		void ComputeMass(b2MassData* massData, float32 density) const
-		{
-			b2Assert(false);
-			B2_NOT_USED(massData);
-			B2_NOT_USED(density);
-		}
-	private:
-		const b2Shape* const* m_shapes;
-		int32 m_shapeCount;
-	} compositeShape(shapes, shapeCount);
-	CreateParticlesFillShapeForGroup(&compositeShape, groupDef, xf);
-}
-
 b2ParticleGroup* b2ParticleSystem::CreateParticleGroup(
 	const b2ParticleGroupDef& groupDef)
 {
@@ -1058,17 +1516,14 @@ b2ParticleGroup* b2ParticleSystem::CreateParticleGroup(
 	}
 	if (groupDef.shapes)
 	{
-		CreateParticlesWithShapesForGroup(
+		CreateParticlesFillShapeForGroup(
 					groupDef.shapes, groupDef.shapeCount, groupDef, transform);
 	}
 	if (groupDef.particleCount)
 	{
 		b2Assert(groupDef.positionData);
-		for (int32 i = 0; i < groupDef.particleCount; i++)
-		{
-			b2Vec2 p = groupDef.positionData[i];
-			CreateParticleForGroup(groupDef, transform, p);
-		}
+		CreateParticlesForGroup(groupDef, transform, groupDef.positionData,
+								groupDef.particleCount);
 	}
 	int32 lastIndex = m_count;
 
@@ -1634,34 +2089,143 @@ void b2ParticleSystem::DestroyParticleGroup(b2ParticleGroup* group)
 
 	if (m_world->m_destructionListener)
 	{
-		m_world->m_destructionListener->SayGoodbye(group);
+		m_world->m_destructionListener->SayGoodbye(group);
+	}
+
+	SetGroupFlags(group, 0);
+	for (int32 i = group->m_firstIndex; i < group->m_lastIndex; i++)
+	{
+		m_groupBuffer[i] = NULL;
+	}
+
+	if (group->m_prev)
+	{
+		group->m_prev->m_next = group->m_next;
+	}
+	if (group->m_next)
+	{
+		group->m_next->m_prev = group->m_prev;
+	}
+	if (group == m_groupList)
+	{
+		m_groupList = group->m_next;
+	}
+
+	--m_groupCount;
+	group->~b2ParticleGroup();
+	m_world->m_blockAllocator.Free(group, sizeof(b2ParticleGroup));
+}
+
+b2ParticleEmitter* b2ParticleSystem::CreateParticleEmitter(
+	const b2ParticleEmitterDef& def)
+{
+	b2Assert(m_world->IsLocked() == false);
+	if (m_world->IsLocked())
+	{
+		return 0;
 	}
-
-	SetGroupFlags(group, 0);
-	for (int32 i = group->m_firstIndex; i < group->m_lastIndex; i++)
+	// Recycling a particle in place can't rebuild pairs and triads.
+	b2Assert(!(def.flags & (k_pairFlags | k_triadFlags)));
+	b2Assert(def.capacity > 0);
+
+	b2BlockAllocator* allocator = &m_world->m_blockAllocator;
+	void* mem = allocator->Allocate(sizeof(b2ParticleEmitter));
+	b2ParticleEmitter* emitter = new (mem) b2ParticleEmitter();
+	emitter->m_system = this;
+	emitter->m_shape = def.shape ? def.shape->Clone(allocator) : NULL;
+	emitter->m_transform.Set(def.position, def.angle);
+	emitter->m_emitRate = def.emitRate;
+	emitter->m_velocity = def.velocity;
+	emitter->m_flags = def.flags;
+	emitter->m_color = def.color;
+	emitter->m_lifetime = def.lifetime;
+	emitter->m_userData = def.userData;
+	emitter->m_recycleOldest = def.recycleOldest;
+	emitter->m_seed = def.seed;
+	emitter->m_capacity = def.capacity;
+	emitter->m_indices = (int32*) allocator->Allocate(
+		sizeof(int32) * def.capacity);
+
+	emitter->m_prev = NULL;
+	emitter->m_next = m_emitterList;
+	if (m_emitterList)
+	{
+		m_emitterList->m_prev = emitter;
+	}
+	m_emitterList = emitter;
+	++m_emitterCount;
+	return emitter;
+}
+
+void b2ParticleSystem::DestroyParticleEmitter(b2ParticleEmitter* emitter)
+{
+	b2Assert(m_world->IsLocked() == false);
+	if (m_world->IsLocked())
 	{
-		m_groupBuffer[i] = NULL;
+		return;
 	}
+	b2Assert(m_emitterCount > 0);
+	b2Assert(emitter && emitter->m_system == this);
 
-	if (group->m_prev)
+	if (emitter->m_prev)
 	{
-		group->m_prev->m_next = group->m_next;
+		emitter->m_prev->m_next = emitter->m_next;
 	}
-	if (group->m_next)
+	if (emitter->m_next)
 	{
-		group->m_next->m_prev = group->m_prev;
+		emitter->m_next->m_prev = emitter->m_prev;
 	}
-	if (group == m_groupList)
+	if (emitter == m_emitterList)
 	{
-		m_groupList = group->m_next;
+		m_emitterList = emitter->m_next;
 	}
+	--m_emitterCount;
 
-	--m_groupCount;
-	group->~b2ParticleGroup();
-	m_world->m_blockAllocator.Free(group, sizeof(b2ParticleGroup));
+	b2BlockAllocator* allocator = &m_world->m_blockAllocator;
+	allocator->Free(emitter->m_indices, sizeof(int32) * emitter->m_capacity);
+	b2Shape* shape = emitter->m_shape;
+	if (shape)
+	{
+		switch (shape->m_type)
+		{
+		case b2Shape::e_circle:
+			{
+				b2CircleShape* s = (b2CircleShape*)shape;
+				s->~b2CircleShape();
+				allocator->Free(s, sizeof(b2CircleShape));
+			}
+			break;
+		case b2Shape::e_edge:
+			{
+				b2EdgeShape* s = (b2EdgeShape*)shape;
+				s->~b2EdgeShape();
+				allocator->Free(s, sizeof(b2EdgeShape));
+			}
+			break;
+		case b2Shape::e_polygon:
+			{
+				b2PolygonShape* s = (b2PolygonShape*)shape;
+				s->~b2PolygonShape();
+				allocator->Free(s, sizeof(b2PolygonShape));
+			}
+			break;
+		case b2Shape::e_chain:
+			{
+				b2ChainShape* s = (b2ChainShape*)shape;
+				s->~b2ChainShape();
+				allocator->Free(s, sizeof(b2ChainShape));
+			}
+			break;
+		default:
+			b2Assert(false);
+			break;
+		}
+	}
+	emitter->~b2ParticleEmitter();
+	allocator->Free(emitter, sizeof(b2ParticleEmitter));
 }
 
-void b2ParticleSystem::ComputeWeight()
+void b2ParticleSystem::ComputeWeight(const b2TimeStep& step)
 {
 	// calculates the sum of contact-weights for each particle
 	// that means dimensionless density
@@ -1673,7 +2237,21 @@ void b2ParticleSystem::ComputeWeight()
 		float32 w = contact.weight;
 		m_weightBuffer[a] += w;
 	}
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+	ParallelForContacts(&b2ParticleSystem::ComputeContactWeights, step);
+	for (int32 k = 0; k < m_sleepingContactBuffer.GetCount(); k++)
+	{
+		const b2ParticleContact& contact = m_sleepingContactBuffer[k];
+		float32 w = contact.GetWeight();
+		m_weightBuffer[contact.GetIndexA()] += w;
+		m_weightBuffer[contact.GetIndexB()] += w;
+	}
+}
+
+void b2ParticleSystem::ComputeContactWeights(
+	const b2TimeStep& step, int32 begin, int32 end)
+{
+	B2_NOT_USED(step);
+	for (int32 k = begin; k < end; k++)
 	{
 		const b2ParticleContact& contact = m_contactBuffer[k];
 		int32 a = contact.GetIndexA();
@@ -1824,10 +2402,11 @@ inline void b2ParticleSystem::AddContact(int32 a, int32 b,
 }
 
 void b2ParticleSystem::FindContacts_Reference(
+	const b2GrowableBuffer<Proxy>& proxies,
 	b2GrowableBuffer<b2ParticleContact>& contacts) const
 {
-	const Proxy* beginProxy = m_proxyBuffer.Begin();
-	const Proxy* endProxy = m_proxyBuffer.End();
+	const Proxy* beginProxy = proxies.Begin();
+	const Proxy* endProxy = proxies.End();
 
 	contacts.SetCount(0);
 	for (const Proxy *a = beginProxy, *c = beginProxy; a < endProxy; a++)
@@ -1854,13 +2433,14 @@ void b2ParticleSystem::FindContacts_Reference(
 
 // Put the positions and indices in proxy-order. This allows us to process
 // particles with SIMD, since adjacent particles are adjacent in memory.
-void b2ParticleSystem::ReorderForFindContact(FindContactInput* reordered,
-	                                         int alignedCount) const
+void b2ParticleSystem::ReorderForFindContact(
+	const b2GrowableBuffer<Proxy>& proxies, FindContactInput* reordered,
+	int alignedCount) const
 {
 	int i = 0;
-	for (; i < m_count; ++i)
+	for (; i < proxies.GetCount(); ++i)
 	{
-		const int proxyIndex = m_proxyBuffer[i].index;
+		const int proxyIndex = proxies[i].index;
 		FindContactInput& r = reordered[i];
 		r.proxyIndex = proxyIndex;
 		r.position = m_positionBuffer.data[proxyIndex];
@@ -1882,6 +2462,7 @@ void b2ParticleSystem::ReorderForFindContact(FindContactInput* reordered,
 // indices NUM_V32_SLOTS at a time, because they are processed in groups
 // in the SIMD function.
 inline void b2ParticleSystem::GatherChecksOneParticle(
+	const b2GrowableBuffer<Proxy>& proxies,
 	const uint32 bound,
 	const int startIndex,
 	const int particleIndex,
@@ -1892,15 +2473,15 @@ inline void b2ParticleSystem::GatherChecksOneParticle(
 	// loop to iterate more than once. In almost all situations, it will
 	// iterate less than twice.
 	for (int comparatorIndex = startIndex;
-		 comparatorIndex < m_count;
+		 comparatorIndex < proxies.GetCount();
 	     comparatorIndex += NUM_V32_SLOTS)
 	{
-		if (m_proxyBuffer[comparatorIndex].tag > bound)
+		if (proxies[comparatorIndex].tag > bound)
 			break;
 
 		FindContactCheck& out = checks.Append();
-		out.particleIndex = (uint16)particleIndex;
-		out.comparatorIndex = (uint16)comparatorIndex;
+		out.particleIndex = (FindContactIndex)particleIndex;
+		out.comparatorIndex = (FindContactIndex)comparatorIndex;
 
 		// This is faster inside the 'for' since there are so few iterations.
 		if (nextUncheckedIndex != NULL)
@@ -1911,17 +2492,20 @@ inline void b2ParticleSystem::GatherChecksOneParticle(
 }
 
 void b2ParticleSystem::GatherChecks(
+	const b2GrowableBuffer<Proxy>& proxies,
 	b2GrowableBuffer<FindContactCheck>& checks) const
 {
+	const int count = proxies.GetCount();
 	int bottomLeftIndex = 0;
-	for (int particleIndex = 0; particleIndex < m_count; ++particleIndex)
+	for (int particleIndex = 0; particleIndex < count; ++particleIndex)
 	{
-		const uint32 particleTag = m_proxyBuffer[particleIndex].tag;
+		const uint32 particleTag = proxies[particleIndex].tag;
 
 		// Add checks for particles to the right.
 		const uint32 rightBound = particleTag + relativeTagRight;
 		int nextUncheckedIndex = particleIndex + 1;
-		GatherChecksOneParticle(rightBound,
+		GatherChecksOneParticle(proxies,
+								rightBound,
 								particleIndex + 1,
 								particleIndex,
 								&nextUncheckedIndex,
@@ -1929,16 +2513,17 @@ void b2ParticleSystem::GatherChecks(
 
 		// Find comparator index below and to left of particle.
 		const uint32 bottomLeftTag = particleTag + relativeTagBottomLeft;
-		for (; bottomLeftIndex < m_count; ++bottomLeftIndex)
+		for (; bottomLeftIndex < count; ++bottomLeftIndex)
 		{
-			if (bottomLeftTag <= m_proxyBuffer[bottomLeftIndex].tag)
+			if (bottomLeftTag <= proxies[bottomLeftIndex].tag)
 				break;
 		}
 
 		// Add checks for particles below.
 		const uint32 bottomRightBound = particleTag + relativeTagBottomRight;
 		const int bottomStartIndex = b2Max(bottomLeftIndex, nextUncheckedIndex);
-		GatherChecksOneParticle(bottomRightBound,
+		GatherChecksOneParticle(proxies,
+								bottomRightBound,
 								bottomStartIndex,
 								particleIndex,
 								NULL,
@@ -1946,28 +2531,29 @@ void b2ParticleSystem::GatherChecks(
 	}
 }
 
-#if defined(LIQUIDFUN_SIMD_NEON)
+#if LIQUIDFUN_SIMD_ENABLED
 void b2ParticleSystem::FindContacts_Simd(
+	const b2GrowableBuffer<Proxy>& proxies,
 	b2GrowableBuffer<b2ParticleContact>& contacts) const
 {
 	contacts.SetCount(0);
 
-	const int alignedCount = m_count + NUM_V32_SLOTS;
+	const int alignedCount = proxies.GetCount() + NUM_V32_SLOTS;
 	FindContactInput* reordered = (FindContactInput*)
 		m_world->m_stackAllocator.Allocate(
 			sizeof(FindContactInput) * alignedCount);
 
 	// Put positions and indices into proxy-order.
 	// This allows us to efficiently check for contacts using SIMD.
-	ReorderForFindContact(reordered, alignedCount);
+	ReorderForFindContact(proxies, reordered, alignedCount);
 
 	// Perform broad-band contact check using tags to approximate
 	// positions. This reduces the number of narrow-band contact checks
 	// that use actual positions.
 	static const int MAX_EXPECTED_CHECKS_PER_PARTICLE = 3;
 	b2GrowableBuffer<FindContactCheck> checks(m_world->m_blockAllocator);
-	checks.Reserve(MAX_EXPECTED_CHECKS_PER_PARTICLE * m_count);
-	GatherChecks(checks);
+	checks.Reserve(MAX_EXPECTED_CHECKS_PER_PARTICLE * proxies.GetCount());
+	GatherChecks(proxies, checks);
 
 	// Perform narrow-band contact checks using actual positions.
 	// Any particles whose centers are within one diameter of each other are
@@ -1978,22 +2564,45 @@ void b2ParticleSystem::FindContacts_Simd(
 
 	m_world->m_stackAllocator.Free(reordered);
 }
-#endif // defined(LIQUIDFUN_SIMD_NEON)
+#endif // LIQUIDFUN_SIMD_ENABLED
+
+// Returns true if the SIMD versions of FindContacts and UpdateProxies can
+// run on this machine. The x86 implementation depends on the CPU, so it is
+// checked at runtime.
+static LIQUIDFUN_SIMD_INLINE bool IsSimdAvailable()
+{
+	#if defined(LIQUIDFUN_SIMD_NEON)
+		return true;
+	#elif defined(LIQUIDFUN_SIMD_SSE)
+		static const bool available = IsSupported_Simd() != 0;
+		return available;
+	#else
+		return false;
+	#endif
+}
 
 LIQUIDFUN_SIMD_INLINE
 void b2ParticleSystem::FindContacts(
+	const b2GrowableBuffer<Proxy>& proxies,
 	b2GrowableBuffer<b2ParticleContact>& contacts) const
 {
-	#if defined(LIQUIDFUN_SIMD_NEON)
-		FindContacts_Simd(contacts);
+	#if LIQUIDFUN_SIMD_ENABLED
+		if (IsSimdAvailable())
+		{
+			FindContacts_Simd(proxies, contacts);
+		}
+		else
+		{
+			FindContacts_Reference(proxies, contacts);
+		}
 	#else
-		FindContacts_Reference(contacts);
+		FindContacts_Reference(proxies, contacts);
 	#endif
 
 	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
 		b2GrowableBuffer<b2ParticleContact>
 			reference(m_world->m_blockAllocator);
-		FindContacts_Reference(reference);
+		FindContacts_Reference(proxies, reference);
 
 		b2Assert(contacts.GetCount() == reference.GetCount());
 		for (int32 i = 0; i < contacts.GetCount(); ++i)
@@ -2003,6 +2612,109 @@ void b2ParticleSystem::FindContacts(
 	#endif // defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
 }
 
+// The neighbor list stays valid while no particle has moved more than half
+// the skin since it was built: two particles can then have closed at most
+// one skin on each other, so no pair outside the list can be in contact.
+bool b2ParticleSystem::NeighborListNeedsRebuild() const
+{
+	if (!m_neighborListValid || m_neighborPositionBuffer.GetCount() != m_count)
+	{
+		return true;
+	}
+	const float32 halfSkin = 0.5f * m_def.neighborListSkin;
+	const float32 maxDisplacementSquared = halfSkin * halfSkin;
+	const b2Vec2* positions = m_positionBuffer.data;
+	const b2Vec2* oldPositions = m_neighborPositionBuffer.Data();
+	for (int32 i = 0; i < m_count; i++)
+	{
+		if (b2DistanceSquared(positions[i], oldPositions[i]) >
+			maxDisplacementSquared)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Same walk over the sorted proxies as FindContacts_Reference, widened to
+// every row and column that can hold a particle within the list range.
+void b2ParticleSystem::RebuildNeighborList()
+{
+	const float32 range = m_particleDiameter + m_def.neighborListSkin;
+	const float32 squaredRange = range * range;
+	const int32 reach = (int32) ceilf(range * m_inverseDiameter);
+	const Proxy* beginProxy = m_proxyBuffer.Begin();
+	const Proxy* endProxy = m_proxyBuffer.End();
+	const b2Vec2* positions = m_positionBuffer.data;
+
+	// One cursor per row below the current proxy; the proxies are sorted
+	// by tag so each cursor only moves forward.
+	const Proxy** rows = (const Proxy**) m_world->m_stackAllocator.Allocate(
+		sizeof(const Proxy*) * reach);
+	for (int32 row = 0; row < reach; row++)
+	{
+		rows[row] = beginProxy;
+	}
+
+	m_neighborPairBuffer.SetCount(0);
+	for (const Proxy* a = beginProxy; a < endProxy; a++)
+	{
+		const b2Vec2 pa = positions[a->index];
+		uint32 rightTag = computeRelativeTag(a->tag, reach, 0);
+		for (const Proxy* b = a + 1; b < endProxy; b++)
+		{
+			if (rightTag < b->tag) break;
+			if (b2DistanceSquared(pa, positions[b->index]) < squaredRange)
+			{
+				NeighborPair& pair = m_neighborPairBuffer.Append();
+				pair.indexA = a->index;
+				pair.indexB = b->index;
+			}
+		}
+		for (int32 row = 0; row < reach; row++)
+		{
+			uint32 leftTag = computeRelativeTag(a->tag, -reach, row + 1);
+			const Proxy*& c = rows[row];
+			for (; c < endProxy; c++)
+			{
+				if (leftTag <= c->tag) break;
+			}
+			uint32 rightRowTag = computeRelativeTag(a->tag, reach, row + 1);
+			for (const Proxy* b = c; b < endProxy; b++)
+			{
+				if (rightRowTag < b->tag) break;
+				if (b2DistanceSquared(pa, positions[b->index]) < squaredRange)
+				{
+					NeighborPair& pair = m_neighborPairBuffer.Append();
+					pair.indexA = a->index;
+					pair.indexB = b->index;
+				}
+			}
+		}
+	}
+	m_world->m_stackAllocator.Free(rows);
+
+	m_neighborPositionBuffer.SetCount(0);
+	m_neighborPositionBuffer.Reserve(m_count);
+	m_neighborPositionBuffer.SetCount(m_count);
+	memcpy(m_neighborPositionBuffer.Data(), positions,
+		   sizeof(b2Vec2) * m_count);
+	m_neighborListValid = true;
+	m_profile.neighborListRebuilds++;
+}
+
+void b2ParticleSystem::FindContactsFromNeighborList(
+	b2GrowableBuffer<b2ParticleContact>& contacts) const
+{
+	contacts.SetCount(0);
+	const NeighborPair* pairs = m_neighborPairBuffer.Data();
+	const int32 pairCount = m_neighborPairBuffer.GetCount();
+	for (int32 k = 0; k < pairCount; k++)
+	{
+		AddContact(pairs[k].indexA, pairs[k].indexB, contacts);
+	}
+}
+
 static inline bool b2ParticleContactIsZombie(const b2ParticleContact& contact)
 {
 	return (contact.GetFlags() & b2_zombieParticle) == b2_zombieParticle;
@@ -2039,7 +2751,7 @@ void b2ParticleSystem::UpdateProxies_Reference(
 	}
 }
 
-#if defined(LIQUIDFUN_SIMD_NEON)
+#if LIQUIDFUN_SIMD_ENABLED
 // static
 void b2ParticleSystem::UpdateProxyTags(
 	const uint32* const tags,
@@ -2068,7 +2780,7 @@ void b2ParticleSystem::UpdateProxies_Simd(
 
 	m_world->m_stackAllocator.Free(tags);
 }
-#endif // defined(LIQUIDFUN_SIMD_NEON)
+#endif // LIQUIDFUN_SIMD_ENABLED
 
 // static
 bool b2ParticleSystem::ProxyBufferHasIndex(
@@ -2134,8 +2846,15 @@ void b2ParticleSystem::UpdateProxies(
 		b2GrowableBuffer<Proxy> reference(proxies);
 	#endif
 
-	#if defined(LIQUIDFUN_SIMD_NEON)
-		UpdateProxies_Simd(proxies);
+	#if LIQUIDFUN_SIMD_ENABLED
+		if (IsSimdAvailable())
+		{
+			UpdateProxies_Simd(proxies);
+		}
+		else
+		{
+			UpdateProxies_Reference(proxies);
+		}
 	#else
 		UpdateProxies_Reference(proxies);
 	#endif
@@ -2153,12 +2872,28 @@ void b2ParticleSystem::UpdateProxies(
 // immediately above and below it. This ordering makes collision computation
 // tractable.
 //
-// TODO OPT: The sort is a hot spot on the profiles. We could use SIMD to
-// speed this up. See http://www.vldb.org/pvldb/1/1454171.pdf for an excellent
-// explanation of a SIMD mergesort algorithm.
+// The proxies are still sorted by the tags of the previous iteration, and
+// particles move a small fraction of a diameter per iteration, so the array
+// is usually nearly sorted. Re-sort only the proxies that moved out of order
+// and fall back to a radix sort on the 32-bit tags when there are too many
+// of them (e.g. after particles are created).
 void b2ParticleSystem::SortProxies(b2GrowableBuffer<Proxy>& proxies) const
 {
-	std::sort(proxies.Begin(), proxies.End());
+	Proxy* const begin = proxies.Begin();
+	const int32 count = proxies.GetCount();
+	if (count < b2_minRadixSortCount)
+	{
+		std::sort(begin, begin + count);
+		return;
+	}
+	Proxy* temp = (Proxy*) m_world->m_stackAllocator.Allocate(
+		sizeof(Proxy) * count);
+	if (!b2ResortByTag(begin, temp, count,
+					   count / k_maxResortProxiesFraction))
+	{
+		b2RadixSortByTag(begin, temp, count);
+	}
+	m_world->m_stackAllocator.Free(temp);
 }
 
 class b2ParticleContactRemovePredicate
@@ -2263,7 +2998,39 @@ void b2ParticleSystem::UpdateContacts(bool exceptZombie)
 	b2ParticlePairSet particlePairs(&m_world->m_stackAllocator);
 	NotifyContactListenerPreContact(&particlePairs);
 
-	FindContacts(m_contactBuffer);
+	if (m_def.neighborListSkin > 0)
+	{
+		if (NeighborListNeedsRebuild())
+		{
+			RebuildNeighborList();
+		}
+		FindContactsFromNeighborList(m_contactBuffer);
+	}
+	else if (m_sleepingCount > 0)
+	{
+		// Particles in interior sleeping regions can only touch other
+		// sleeping particles, and those contacts are already in
+		// m_sleepingContactBuffer.
+		m_awakeProxyBuffer.SetCount(0);
+		m_awakeProxyBuffer.Reserve(m_proxyBuffer.GetCount());
+		for (const Proxy* proxy = m_proxyBuffer.Begin();
+			 proxy < m_proxyBuffer.End(); proxy++)
+		{
+			if (m_sleepStateBuffer[proxy->index] != e_particleAsleepInterior)
+			{
+				m_awakeProxyBuffer.Append() = *proxy;
+			}
+		}
+		FindContacts(m_awakeProxyBuffer, m_contactBuffer);
+	}
+	else
+	{
+		FindContacts(m_proxyBuffer, m_contactBuffer);
+	}
+	if (m_sleepingCount > 0)
+	{
+		RemoveSleepingContacts(m_contactBuffer);
+	}
 	FilterContacts(m_contactBuffer);
 
 	NotifyContactListenerPostContact(particlePairs);
@@ -2274,6 +3041,243 @@ void b2ParticleSystem::UpdateContacts(bool exceptZombie)
 	}
 }
 
+static inline uint32 computeSleepRegionTag(int32 x, int32 y)
+{
+	return ((uint32)(y + 0x8000) << 16) | ((uint32)(x + 0x8000) & 0xffff);
+}
+
+// Returns true if particles are allowed to fall asleep: sleeping particles
+// are only left out of the pressure and damping solve, so every other
+// contact stage has to be unused.
+bool b2ParticleSystem::CanSleep() const
+{
+	return m_def.allowSleep &&
+		!(m_allParticleFlags & ~k_sleepingParticleFlags) &&
+		!(m_allGroupFlags & (b2_rigidParticleGroup | b2_solidParticleGroup));
+}
+
+// Decide which particles sleep during this step. Particles are grouped into
+// square regions; a region's settled time is the smallest of its
+// particles', so a particle moving in from an awake region wakes it. The
+// regions are at least as wide as a particle can travel in one step, so
+// awake particles can only reach sleeping regions next to an awake one;
+// particles further inside are left out of the contact search.
+void b2ParticleSystem::UpdateSleep(const b2TimeStep& step)
+{
+	m_sleepingCount = 0;
+	if (!CanSleep())
+	{
+		if (m_sleepTimeBuffer)
+		{
+			memset(m_sleepTimeBuffer, 0, sizeof(*m_sleepTimeBuffer) * m_count);
+		}
+		return;
+	}
+	m_sleepTimeBuffer = RequestBuffer(m_sleepTimeBuffer);
+	m_sleepStateBuffer = RequestBuffer(m_sleepStateBuffer);
+	float32* sleepTimes = m_sleepTimeBuffer;
+	uint8* states = m_sleepStateBuffer;
+
+	// Mark particles that are moving, pushed by a force that will make them
+	// move or touching a body that moves. SolveCollision() leaves a force on
+	// every particle it stops at a body, so only count forces that change
+	// the velocity by more than sleepVelocity.
+	const float32 sleepVelocitySquared =
+		m_def.sleepVelocity * m_def.sleepVelocity;
+	const float32 velocityPerForce =
+		step.dt / step.particleIterations * GetParticleInvMass();
+	int32 movingCount = 0;
+	for (int32 i = 0; i < m_count; i++)
+	{
+		const b2Vec2& v = m_velocityBuffer.data[i];
+		states[i] = b2Dot(v, v) > sleepVelocitySquared;
+		if (m_hasForce && !states[i])
+		{
+			const b2Vec2 dv = velocityPerForce * m_forceBuffer[i];
+			states[i] = b2Dot(dv, dv) > sleepVelocitySquared;
+		}
+		movingCount += states[i];
+	}
+	if (movingCount == m_count)
+	{
+		// No region can settle, so there is nothing to group.
+		memset(sleepTimes, 0, sizeof(*sleepTimes) * m_count);
+		return;
+	}
+	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+	{
+		const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+		const b2Vec2 v = contact.body->GetLinearVelocityFromWorldPoint(
+			m_positionBuffer.data[contact.index]);
+		if (b2Dot(v, v) > sleepVelocitySquared)
+		{
+			states[contact.index] = 1;
+		}
+	}
+
+	// Sort the particles by region. The order is kept between steps, so
+	// usually only the particles that changed region have to move.
+	if (m_sleepRegionBuffer.GetCount() != m_count)
+	{
+		m_sleepRegionBuffer.SetCount(0);
+		m_sleepRegionBuffer.Reserve(m_count);
+		for (int32 i = 0; i < m_count; i++)
+		{
+			m_sleepRegionBuffer.Append().index = i;
+		}
+	}
+	const float32 regionSize = m_particleDiameter *
+		b2Max(k_sleepRegionDiameters, step.particleIterations + 1);
+	const float32 inverseRegionSize = 1 / regionSize;
+	Proxy* regionProxies = m_sleepRegionBuffer.Begin();
+	for (int32 k = 0; k < m_count; k++)
+	{
+		const b2Vec2& p = m_positionBuffer.data[regionProxies[k].index];
+		regionProxies[k].tag = computeSleepRegionTag(
+			(int32) floorf(p.x * inverseRegionSize),
+			(int32) floorf(p.y * inverseRegionSize));
+	}
+	// Settled water rarely changes region, so skip the sort when nothing did.
+	for (int32 k = 1; k < m_count; k++)
+	{
+		if (regionProxies[k].tag < regionProxies[k - 1].tag)
+		{
+			SortProxies(m_sleepRegionBuffer);
+			break;
+		}
+	}
+
+	// Advance each region's settled time.
+	uint32* regionTags = (uint32*) m_world->m_stackAllocator.Allocate(
+		sizeof(uint32) * m_count);
+	int32* regionEnds = (int32*) m_world->m_stackAllocator.Allocate(
+		sizeof(int32) * m_count);
+	int32 regionCount = 0;
+	for (int32 begin = 0, end = 0; begin < m_count; begin = end)
+	{
+		const uint32 tag = regionProxies[begin].tag;
+		bool moving = false;
+		float32 settledTime = b2_maxFloat;
+		for (; end < m_count && regionProxies[end].tag == tag; end++)
+		{
+			const int32 i = regionProxies[end].index;
+			moving = moving || states[i];
+			settledTime = b2Min(settledTime, sleepTimes[i]);
+		}
+		settledTime = moving ? 0 : settledTime + step.dt;
+		for (int32 k = begin; k < end; k++)
+		{
+			sleepTimes[regionProxies[k].index] = settledTime;
+		}
+		regionTags[regionCount] = tag;
+		regionEnds[regionCount] = end;
+		regionCount++;
+	}
+
+	// Regions that are still asleep keep the particles in the contact search
+	// only if an awake region is next to them.
+	for (int32 r = 0, begin = 0; r < regionCount; begin = regionEnds[r++])
+	{
+		const int32 end = regionEnds[r];
+		uint8 state = e_particleAwake;
+		if (sleepTimes[regionProxies[begin].index] >= m_def.sleepTime)
+		{
+			state = e_particleAsleepInterior;
+			const int32 x = (int32)(regionTags[r] & 0xffff) - 0x8000;
+			const int32 y = (int32)(regionTags[r] >> 16) - 0x8000;
+			for (int32 dy = -1; dy <= 1 && state != e_particleAsleepBorder;
+				 dy++)
+			{
+				for (int32 dx = -1; dx <= 1; dx++)
+				{
+					const uint32 tag = computeSleepRegionTag(x + dx, y + dy);
+					const uint32* found = std::lower_bound(
+						regionTags, regionTags + regionCount, tag);
+					if (found < regionTags + regionCount && *found == tag)
+					{
+						const int32 neighbor = (int32)(found - regionTags);
+						const int32 first =
+							neighbor ? regionEnds[neighbor - 1] : 0;
+						if (sleepTimes[regionProxies[first].index] <
+							m_def.sleepTime)
+						{
+							state = e_particleAsleepBorder;
+							break;
+						}
+					}
+				}
+			}
+			m_sleepingCount += end - begin;
+		}
+		for (int32 k = begin; k < end; k++)
+		{
+			states[regionProxies[k].index] = state;
+		}
+	}
+	m_world->m_stackAllocator.Free(regionEnds);
+	m_world->m_stackAllocator.Free(regionTags);
+
+	// Contacts between sleeping particles do not change until one of them
+	// wakes, so set them aside for the step.
+	m_sleepingContactBuffer.SetCount(0);
+	if (m_sleepingCount > 0)
+	{
+		for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+		{
+			const b2ParticleContact& contact = m_contactBuffer[k];
+			if (states[contact.GetIndexA()] != e_particleAwake &&
+				states[contact.GetIndexB()] != e_particleAwake)
+			{
+				m_sleepingContactBuffer.Append() = contact;
+			}
+		}
+		RemoveSleepingContacts(m_contactBuffer);
+	}
+}
+
+// Drop contacts between two sleeping particles; UpdateSleep() has kept them
+// in m_sleepingContactBuffer.
+void b2ParticleSystem::RemoveSleepingContacts(
+	b2GrowableBuffer<b2ParticleContact>& contacts)
+{
+	const uint8* states = m_sleepStateBuffer;
+	int32 kept = 0;
+	for (int32 k = 0; k < contacts.GetCount(); k++)
+	{
+		const b2ParticleContact& contact = contacts[k];
+		if (states[contact.GetIndexA()] == e_particleAwake ||
+			states[contact.GetIndexB()] == e_particleAwake)
+		{
+			contacts[kept++] = contact;
+		}
+	}
+	contacts.SetCount(kept);
+}
+
+// Put the contacts set aside by UpdateSleep() back at the end of the step,
+// so GetContacts() and the next UpdateSleep() see all of them.
+void b2ParticleSystem::RestoreSleepingContacts()
+{
+	const int32 count = m_sleepingContactBuffer.GetCount();
+	for (int32 k = 0; k < count; k++)
+	{
+		m_contactBuffer.Append() = m_sleepingContactBuffer[k];
+	}
+	m_sleepingContactBuffer.SetCount(0);
+}
+
+// Sleeping particles hold still like wall particles.
+void b2ParticleSystem::SolveSleep()
+{
+	for (int32 i = 0; i < m_count; i++)
+	{
+		if (m_sleepStateBuffer[i] != e_particleAwake)
+		{
+			m_velocityBuffer.data[i].SetZero();
+		}
+	}
+}
+
 void b2ParticleSystem::DetectStuckParticle(int32 particle)
 {
 	// Detect stuck particles
@@ -2511,8 +3515,8 @@ private:
 		return false;
 	}
 
-	// Receive a fixture and call ReportFixtureAndParticle() for each particle
-	// inside aabb of the fixture.
+	// Receive a fixture and call ReportFixtureAndParticles() for the
+	// particles inside aabb of each of its children.
 	bool ReportFixture(b2Fixture* fixture)
 	{
 		if (fixture->IsSensor())
@@ -2526,18 +3530,32 @@ private:
 			b2AABB aabb = fixture->GetAABB(childIndex);
 			b2ParticleSystem::InsideBoundsEnumerator enumerator =
 								m_system->GetInsideBoundsEnumerator(aabb);
-			int32 index;
-			while ((index = enumerator.GetNext()) >= 0)
-			{
-				ReportFixtureAndParticle(fixture, childIndex, index);
-			}
+			ReportFixtureAndParticles(fixture, childIndex, &enumerator);
 		}
 		return true;
 	}
 
+	// Receive a fixture child and the particles which may be overlapping it.
+	// Calls ReportFixtureAndParticle() for each particle unless overridden.
+	virtual void ReportFixtureAndParticles(
+		b2Fixture* fixture, int32 childIndex,
+		b2ParticleSystem::InsideBoundsEnumerator* enumerator)
+	{
+		int32 index;
+		while ((index = enumerator->GetNext()) >= 0)
+		{
+			ReportFixtureAndParticle(fixture, childIndex, index);
+		}
+	}
+
 	// Receive a fixture and a particle which may be overlapping.
 	virtual void ReportFixtureAndParticle(
-						b2Fixture* fixture, int32 childIndex, int32 index) = 0;
+						b2Fixture* fixture, int32 childIndex, int32 index)
+	{
+		B2_NOT_USED(fixture);
+		B2_NOT_USED(childIndex);
+		B2_NOT_USED(index);
+	}
 
 protected:
 	b2ParticleSystem* m_system;
@@ -2642,20 +3660,66 @@ void b2ParticleSystem::UpdateBodyContacts()
 				const uint32* const flags = m_system->GetFlagsBuffer();
 				if (flags[particleIndex] & b2_fixtureContactFilterParticle)
 				{
-					return m_contactFilter->ShouldCollide(fixture, m_system,
-														  particleIndex);
+					return m_contactFilter->ShouldCollide(fixture, m_system,
+														  particleIndex);
+				}
+			}
+			return true;
+		}
+
+		// Gather the particles near the fixture child and compute their
+		// distances in one call, so shapes can process several at once.
+		void ReportFixtureAndParticles(
+			b2Fixture* fixture, int32 childIndex,
+			b2ParticleSystem::InsideBoundsEnumerator* enumerator)
+		{
+			int32 count = 0;
+			int32 a;
+			while ((a = enumerator->GetNext()) >= 0)
+			{
+				// Zombies left for a later SolveZombie() don't touch bodies.
+				if (m_system->m_flagsBuffer.data[a] & b2_zombieParticle)
+				{
+					continue;
+				}
+				m_indices[count] = a;
+				m_positions[count] = m_system->m_positionBuffer.data[a];
+				count++;
+			}
+			if (count == 0)
+			{
+				return;
+			}
+			const StaticField* field = NULL;
+			if (m_system->m_def.staticDistanceFields &&
+				fixture->GetBody()->GetType() == b2_staticBody)
+			{
+				field = m_system->GetStaticField(fixture, childIndex);
+			}
+			if (field)
+			{
+				for (int32 k = 0; k < count; k++)
+				{
+					m_system->ComputeStaticFieldDistance(
+						*field, m_positions[k], &m_distances[k],
+						&m_normals[k]);
 				}
 			}
-			return true;
+			else
+			{
+				fixture->ComputeDistanceBatch(m_positions, count, m_distances,
+											  m_normals, childIndex);
+			}
+			for (int32 k = 0; k < count; k++)
+			{
+				AddContact(fixture, m_indices[k], m_positions[k],
+						   m_distances[k], m_normals[k]);
+			}
 		}
 
-		void ReportFixtureAndParticle(
-								b2Fixture* fixture, int32 childIndex, int32 a)
+		void AddContact(b2Fixture* fixture, int32 a, const b2Vec2& ap,
+						float32 d, const b2Vec2& n)
 		{
-			b2Vec2 ap = m_system->m_positionBuffer.data[a];
-			float32 d;
-			b2Vec2 n;
-			fixture->ComputeDistance(ap, &d, &n, childIndex);
 			if (d < m_system->m_particleDiameter && ShouldCollide(fixture, a))
 			{
 				b2Body* b = fixture->GetBody();
@@ -2685,28 +3749,407 @@ void b2ParticleSystem::UpdateBodyContacts()
 		}
 
 		b2ContactFilter* m_contactFilter;
+		// Scratch space for up to every particle, filled per fixture child.
+		int32* m_indices;
+		b2Vec2* m_positions;
+		float32* m_distances;
+		b2Vec2* m_normals;
 
 	public:
 		UpdateBodyContactsCallback(
-			b2ParticleSystem* system, b2ContactFilter* contactFilter):
+			b2ParticleSystem* system, b2ContactFilter* contactFilter,
+			int32* indices, b2Vec2* positions, float32* distances,
+			b2Vec2* normals):
 			b2FixtureParticleQueryCallback(system)
 		{
 			m_contactFilter = contactFilter;
+			m_indices = indices;
+			m_positions = positions;
+			m_distances = distances;
+			m_normals = normals;
 		}
-	} callback(this, GetFixtureContactFilter());
+	};
+
+	b2StackAllocator& allocator = m_world->m_stackAllocator;
+	int32* indices = (int32*) allocator.Allocate(sizeof(int32) * m_count);
+	b2Vec2* positions = (b2Vec2*) allocator.Allocate(sizeof(b2Vec2) * m_count);
+	float32* distances =
+		(float32*) allocator.Allocate(sizeof(float32) * m_count);
+	b2Vec2* normals = (b2Vec2*) allocator.Allocate(sizeof(b2Vec2) * m_count);
+	UpdateBodyContactsCallback callback(
+		this, GetFixtureContactFilter(), indices, positions, distances,
+		normals);
 
 	b2AABB aabb;
 	ComputeAABB(&aabb);
 	m_world->QueryAABB(&callback, aabb);
 
+	allocator.Free(normals);
+	allocator.Free(distances);
+	allocator.Free(positions);
+	allocator.Free(indices);
+
 	if (m_def.strictContactCheck)
 	{
 		RemoveSpuriousBodyContacts();
 	}
+	UpdateBodyImpulses();
 
 	NotifyBodyContactListenerPostContact(fixtureSet);
 }
 
+// Give every body in m_bodyContactBuffer an entry in m_bodyImpulseBuffer,
+// and record each contact's entry.
+void b2ParticleSystem::UpdateBodyImpulses()
+{
+	const int32 count = m_bodyContactBuffer.GetCount();
+	m_bodyImpulseBuffer.SetCount(0);
+	m_bodyContactImpulseBuffer.SetCount(0);
+	if (count == 0)
+	{
+		return;
+	}
+	b2Body** bodies = (b2Body**) m_world->m_stackAllocator.Allocate(
+		sizeof(b2Body*) * count);
+	for (int32 k = 0; k < count; k++)
+	{
+		bodies[k] = m_bodyContactBuffer[k].body;
+	}
+	std::sort(bodies, bodies + count);
+	b2Body** const bodiesEnd = std::unique(bodies, bodies + count);
+	m_bodyImpulseBuffer.Reserve((int32)(bodiesEnd - bodies));
+	for (b2Body** body = bodies; body < bodiesEnd; ++body)
+	{
+		BodyImpulse& impulse = m_bodyImpulseBuffer.Append();
+		impulse.body = *body;
+		impulse.linearVelocity.SetZero();
+		impulse.angularVelocity = 0;
+		impulse.awake = (*body)->IsAwake();
+	}
+	m_bodyContactImpulseBuffer.Reserve(count);
+	for (int32 k = 0; k < count; k++)
+	{
+		m_bodyContactImpulseBuffer.Append() = (int32)(std::lower_bound(
+			bodies, bodiesEnd, m_bodyContactBuffer[k].body) - bodies);
+	}
+	m_world->m_stackAllocator.Free(bodies);
+}
+
+// Same as ApplyLinearImpulse() on the body of the body contact, but the
+// velocity change is only recorded until ApplyBodyImpulses(). Stages add up
+// their impulses this way so each body is written once.
+inline void b2ParticleSystem::AddBodyImpulse(
+	int32 bodyContact, const b2Vec2& impulse, const b2Vec2& point, bool wake)
+{
+	BodyImpulse& entry =
+		m_bodyImpulseBuffer[m_bodyContactImpulseBuffer[bodyContact]];
+	const b2Body* body = entry.body;
+	if (body->m_type != b2_dynamicBody)
+	{
+		return;
+	}
+	entry.awake = entry.awake || wake;
+	if (entry.awake)
+	{
+		entry.linearVelocity += body->m_invMass * impulse;
+		entry.angularVelocity +=
+			body->m_invI * b2Cross(point - body->m_sweep.c, impulse);
+	}
+}
+
+// GetLinearVelocityFromWorldPoint() of the body of the body contact,
+// including the impulses recorded so far.
+inline b2Vec2 b2ParticleSystem::GetBodyContactVelocity(
+	int32 bodyContact, const b2Vec2& point) const
+{
+	const BodyImpulse& entry =
+		m_bodyImpulseBuffer[m_bodyContactImpulseBuffer[bodyContact]];
+	const b2Body* body = entry.body;
+	return body->m_linearVelocity + entry.linearVelocity +
+		b2Cross(body->m_angularVelocity + entry.angularVelocity,
+				point - body->m_sweep.c);
+}
+
+void b2ParticleSystem::ApplyBodyImpulses()
+{
+	for (int32 k = 0; k < m_bodyImpulseBuffer.GetCount(); k++)
+	{
+		BodyImpulse& entry = m_bodyImpulseBuffer[k];
+		b2Body* body = entry.body;
+		if (entry.awake && !body->IsAwake())
+		{
+			body->SetAwake(true);
+		}
+		body->m_linearVelocity += entry.linearVelocity;
+		body->m_angularVelocity += entry.angularVelocity;
+		entry.linearVelocity.SetZero();
+		entry.angularVelocity = 0;
+		entry.awake = body->IsAwake();
+	}
+}
+
+// Order of m_staticFieldBuffer.
+static inline bool StaticFieldLess(const b2Fixture* fixtureA,
+								   int32 childIndexA,
+								   const b2Fixture* fixtureB,
+								   int32 childIndexB)
+{
+	return fixtureA < fixtureB ||
+		(fixtureA == fixtureB && childIndexA < childIndexB);
+}
+
+// Find the field of a static fixture child, sampling it if the fixture is
+// new or its body has moved since.
+const b2ParticleSystem::StaticField* b2ParticleSystem::GetStaticField(
+	const b2Fixture* fixture, int32 childIndex)
+{
+	int32 lower = 0;
+	int32 upper = m_staticFieldBuffer.GetCount();
+	while (lower < upper)
+	{
+		const int32 middle = (lower + upper) / 2;
+		const StaticField& field = m_staticFieldBuffer[middle];
+		if (StaticFieldLess(field.fixture, field.childIndex,
+							fixture, childIndex))
+		{
+			lower = middle + 1;
+		}
+		else
+		{
+			upper = middle;
+		}
+	}
+	StaticField* field;
+	if (lower < m_staticFieldBuffer.GetCount() &&
+		m_staticFieldBuffer[lower].fixture == fixture &&
+		m_staticFieldBuffer[lower].childIndex == childIndex)
+	{
+		field = &m_staticFieldBuffer[lower];
+		const b2Transform& xf = fixture->GetBody()->GetTransform();
+		if (xf.p == field->transform.p && xf.q.s == field->transform.q.s &&
+			xf.q.c == field->transform.q.c)
+		{
+			return field->samples ? field : NULL;
+		}
+		FreeBuffer(&field->samples, field->width * field->height);
+	}
+	else
+	{
+		m_staticFieldBuffer.Append();
+		field = &m_staticFieldBuffer[lower];
+		memmove(field + 1, field,
+				sizeof(*field) * (m_staticFieldBuffer.GetCount() - 1 - lower));
+		field->fixture = fixture;
+		field->childIndex = childIndex;
+	}
+	SampleStaticField(field);
+	return field->samples ? field : NULL;
+}
+
+void b2ParticleSystem::SampleStaticField(StaticField* field)
+{
+	const b2Fixture* fixture = field->fixture;
+	const b2Shape::Type type = fixture->GetType();
+	field->transform = fixture->GetBody()->GetTransform();
+	field->samples = NULL;
+	field->width = 0;
+	field->height = 0;
+	if (type != b2Shape::e_polygon && type != b2Shape::e_edge &&
+		type != b2Shape::e_chain)
+	{
+		// The normal of a circle changes everywhere, so no sample would
+		// ever be used.
+		return;
+	}
+
+	// Particles are reported for the fixture's AABB grown by a diameter.
+	b2AABB aabb;
+	fixture->GetShape()->ComputeAABB(&aabb, field->transform,
+									 field->childIndex);
+	const float32 spacing = m_particleDiameter;
+	field->origin = aabb.lowerBound - b2Vec2(2 * spacing, 2 * spacing);
+	field->inverseSpacing = 1 / spacing;
+	const b2Vec2 extent = aabb.upperBound - field->origin;
+	const float32 width = extent.x * field->inverseSpacing + 3;
+	const float32 height = extent.y * field->inverseSpacing + 3;
+	if (width * height > k_maxStaticFieldSamples)
+	{
+		return;
+	}
+	field->width = (int32) width;
+	field->height = (int32) height;
+	field->samples = (StaticFieldSample*) m_world->m_blockAllocator.Allocate(
+		sizeof(StaticFieldSample) * field->width * field->height);
+	StaticFieldSample* sample = field->samples;
+	for (int32 y = 0; y < field->height; y++)
+	{
+		for (int32 x = 0; x < field->width; x++, sample++)
+		{
+			const b2Vec2 p = field->origin + spacing * b2Vec2(
+				(float32) x, (float32) y);
+			fixture->ComputeDistance(p, &sample->distance, &sample->normal,
+									 field->childIndex);
+		}
+	}
+}
+
+// Interpolate the distance to the fixture between the four samples around
+// p. Polygon and edge distances are linear wherever the same face is
+// nearest, which the samples agree on when their normals are equal;
+// anywhere else, including outside the grid, ask the fixture.
+void b2ParticleSystem::ComputeStaticFieldDistance(
+	const StaticField& field, const b2Vec2& p, float32* distance,
+	b2Vec2* normal) const
+{
+	const b2Vec2 g = field.inverseSpacing * (p - field.origin);
+	if (g.x >= 0 && g.y >= 0)
+	{
+		const int32 x = (int32) g.x;
+		const int32 y = (int32) g.y;
+		if (x < field.width - 1 && y < field.height - 1)
+		{
+			const StaticFieldSample* s00 =
+				field.samples + y * field.width + x;
+			const StaticFieldSample* s10 = s00 + 1;
+			const StaticFieldSample* s01 = s00 + field.width;
+			const StaticFieldSample* s11 = s01 + 1;
+			if (s00->normal == s10->normal && s00->normal == s01->normal &&
+				s00->normal == s11->normal)
+			{
+				const float32 fx = g.x - x;
+				const float32 fy = g.y - y;
+				const float32 d0 =
+					s00->distance + fx * (s10->distance - s00->distance);
+				const float32 d1 =
+					s01->distance + fx * (s11->distance - s01->distance);
+				*distance = d0 + fy * (d1 - d0);
+				*normal = s00->normal;
+				return;
+			}
+		}
+	}
+	field.fixture->ComputeDistance(p, distance, normal, field.childIndex);
+}
+
+// Called by b2Body and b2World before a fixture is destroyed, so a later
+// fixture allocated at the same address is sampled afresh.
+void b2ParticleSystem::DestroyStaticFields(const b2Fixture* fixture)
+{
+	int32 kept = 0;
+	for (int32 k = 0; k < m_staticFieldBuffer.GetCount(); k++)
+	{
+		StaticField& field = m_staticFieldBuffer[k];
+		if (field.fixture == fixture)
+		{
+			FreeBuffer(&field.samples, field.width * field.height);
+		}
+		else
+		{
+			m_staticFieldBuffer[kept++] = field;
+		}
+	}
+	m_staticFieldBuffer.SetCount(kept);
+}
+
+// Called by b2Body and b2World before a fixture is destroyed, so the next
+// UpdateSleep() doesn't read the fixture's body. Like b2World waking the
+// bodies that touched a destroyed one, the particles that touched the
+// fixture are woken along with every particle connected to them through
+// particle contacts; water resting on the fixture would otherwise stay
+// asleep in the air.
+void b2ParticleSystem::DestroyBodyContacts(const b2Fixture* fixture)
+{
+	float32* sleepTimes = m_def.allowSleep ? m_sleepTimeBuffer : NULL;
+	int32* stack = NULL;
+	uint8* visited = NULL;
+	int32 stackCount = 0;
+	int32 kept = 0;
+	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+	{
+		const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+		if (contact.fixture != fixture)
+		{
+			m_bodyContactBuffer[kept++] = contact;
+			continue;
+		}
+		if (!sleepTimes)
+		{
+			continue;
+		}
+		if (!stack)
+		{
+			stack = (int32*) m_world->m_stackAllocator.Allocate(
+				sizeof(int32) * m_count);
+			visited = (uint8*) m_world->m_stackAllocator.Allocate(
+				sizeof(uint8) * m_count);
+			memset(visited, 0, sizeof(uint8) * m_count);
+		}
+		if (!visited[contact.index])
+		{
+			visited[contact.index] = 1;
+			stack[stackCount++] = contact.index;
+		}
+	}
+	m_bodyContactBuffer.SetCount(kept);
+	if (!stack)
+	{
+		return;
+	}
+
+	// List each particle's neighbors, then walk the contact graph from the
+	// particles that touched the fixture.
+	const int32 contactCount = m_contactBuffer.GetCount();
+	int32* firstNeighbors = (int32*) m_world->m_stackAllocator.Allocate(
+		sizeof(int32) * (m_count + 1));
+	int32* neighbors = (int32*) m_world->m_stackAllocator.Allocate(
+		sizeof(int32) * 2 * contactCount);
+	memset(firstNeighbors, 0, sizeof(int32) * (m_count + 1));
+	for (int32 k = 0; k < contactCount; k++)
+	{
+		const b2ParticleContact& contact = m_contactBuffer[k];
+		firstNeighbors[contact.GetIndexA() + 1]++;
+		firstNeighbors[contact.GetIndexB() + 1]++;
+	}
+	for (int32 i = 0; i < m_count; i++)
+	{
+		firstNeighbors[i + 1] += firstNeighbors[i];
+	}
+	for (int32 k = 0; k < contactCount; k++)
+	{
+		const b2ParticleContact& contact = m_contactBuffer[k];
+		const int32 a = contact.GetIndexA();
+		const int32 b = contact.GetIndexB();
+		neighbors[firstNeighbors[a]++] = b;
+		neighbors[firstNeighbors[b]++] = a;
+	}
+	// Filling moved each start to the next particle's; shift them back.
+	for (int32 i = m_count; i > 0; i--)
+	{
+		firstNeighbors[i] = firstNeighbors[i - 1];
+	}
+	firstNeighbors[0] = 0;
+	while (stackCount > 0)
+	{
+		// A region's settled time is the smallest of its particles', so
+		// this wakes the particle's whole region in the next UpdateSleep().
+		const int32 i = stack[--stackCount];
+		sleepTimes[i] = 0;
+		for (int32 k = firstNeighbors[i]; k < firstNeighbors[i + 1]; k++)
+		{
+			const int32 j = neighbors[k];
+			if (!visited[j])
+			{
+				visited[j] = 1;
+				stack[stackCount++] = j;
+			}
+		}
+	}
+	m_world->m_stackAllocator.Free(neighbors);
+	m_world->m_stackAllocator.Free(firstNeighbors);
+	m_world->m_stackAllocator.Free(visited);
+	m_world->m_stackAllocator.Free(stack);
+}
+
 void b2ParticleSystem::RemoveSpuriousBodyContacts()
 {
 	// At this point we have a list of contact candidates based on AABB
@@ -2970,8 +4413,24 @@ void b2ParticleSystem::SolveBarrier(const b2TimeStep& step)
 	}
 }
 
+// Add the time since the timer was last reset to *total and reset it, so
+// consecutive calls time consecutive stages.
+static inline void AccumulateTime(b2Timer* timer, float32* total)
+{
+	*total += timer->GetMilliseconds();
+	timer->Reset();
+}
+
 void b2ParticleSystem::Solve(const b2TimeStep& step)
 {
+	memset(&m_profile, 0, sizeof(m_profile));
+	b2Timer solveTimer;
+	b2Timer timer;
+	if (m_emitterList && !m_paused)
+	{
+		EmitParticles(step);
+		AccumulateTime(&timer, &m_profile.emit);
+	}
 	if (m_count == 0)
 	{
 		return;
@@ -2980,10 +4439,14 @@ void b2ParticleSystem::Solve(const b2TimeStep& step)
 	if (m_expirationTimeBuffer.data)
 	{
 		SolveLifetimes(step);
+		AccumulateTime(&timer, &m_profile.lifetimes);
 	}
-	if (m_allParticleFlags & b2_zombieParticle)
+	if ((m_allParticleFlags & b2_zombieParticle) && NeedsZombieCompaction())
 	{
+		const int32 countBeforeZombie = m_count;
 		SolveZombie();
+		m_profile.zombiesRemoved = countBeforeZombie - m_count;
+		AccumulateTime(&timer, &m_profile.zombie);
 	}
 	if (m_needsUpdateAllParticleFlags)
 	{
@@ -2993,10 +4456,25 @@ void b2ParticleSystem::Solve(const b2TimeStep& step)
 	{
 		UpdateAllGroupFlags();
 	}
+	AccumulateTime(&timer, &m_profile.updateFlags);
 	if (m_paused)
 	{
+		UpdateProfileCounts();
+		m_profile.solve = solveTimer.GetMilliseconds();
 		return;
 	}
+	if (m_def.spatialReorderInterval > 0 &&
+		++m_stepsSinceSpatialReorder >= m_def.spatialReorderInterval)
+	{
+		ReorderParticlesSpatially();
+		m_stepsSinceSpatialReorder = 0;
+		AccumulateTime(&timer, &m_profile.reorder);
+	}
+	if (m_def.allowSleep)
+	{
+		UpdateSleep(step);
+		AccumulateTime(&timer, &m_profile.sleep);
+	}
 	for (m_iterationIndex = 0;
 		m_iterationIndex < step.particleIterations;
 		m_iterationIndex++)
@@ -3005,16 +4483,27 @@ void b2ParticleSystem::Solve(const b2TimeStep& step)
 		b2TimeStep subStep = step;
 		subStep.dt /= step.particleIterations;
 		subStep.inv_dt *= step.particleIterations;
-		UpdateContacts(false);
+		timer.Reset();
+		// Zombies left for a later SolveZombie() make no contacts.
+		UpdateContacts((m_allParticleFlags & b2_zombieParticle) != 0);
+		if (m_taskScheduler)
+		{
+			ColorContacts();
+		}
+		AccumulateTime(&timer, &m_profile.updateContacts);
 		UpdateBodyContacts();
-		ComputeWeight();
+		AccumulateTime(&timer, &m_profile.updateBodyContacts);
+		ComputeWeight(subStep);
+		AccumulateTime(&timer, &m_profile.computeWeight);
 		if (m_allGroupFlags & b2_particleGroupNeedsUpdateDepth)
 		{
 			ComputeDepth();
+			AccumulateTime(&timer, &m_profile.computeDepth);
 		}
 		if (m_allParticleFlags & b2_reactiveParticle)
 		{
 			UpdatePairsAndTriadsWithReactiveParticles();
+			AccumulateTime(&timer, &m_profile.reactive);
 		}
 		if (m_hasForce)
 		{
@@ -3022,7 +4511,7 @@ void b2ParticleSystem::Solve(const b2TimeStep& step)
 		}
 		if (m_allParticleFlags & b2_viscousParticle)
 		{
-			SolveViscous();
+			SolveViscous(subStep);
 		}
 		if (m_allParticleFlags & b2_repulsiveParticle)
 		{
@@ -3045,16 +4534,19 @@ void b2ParticleSystem::Solve(const b2TimeStep& step)
 			SolveColorMixing();
 		}
 		SolveGravity(subStep);
+		AccumulateTime(&timer, &m_profile.forces);
 		if (m_allParticleFlags & b2_staticPressureParticle)
 		{
 			SolveStaticPressure(subStep);
 		}
 		SolvePressure(subStep);
+		AccumulateTime(&timer, &m_profile.pressure);
 		SolveDamping(subStep);
 		if (m_allParticleFlags & k_extraDampingFlags)
 		{
 			SolveExtraDamping();
 		}
+		AccumulateTime(&timer, &m_profile.damping);
 		// SolveElastic and SolveSpring refer the current velocities for
 		// numerical stability, they should be called as late as possible.
 		if (m_allParticleFlags & b2_elasticParticle)
@@ -3065,33 +4557,228 @@ void b2ParticleSystem::Solve(const b2TimeStep& step)
 		{
 			SolveSpring(subStep);
 		}
+		AccumulateTime(&timer, &m_profile.elastic);
 		LimitVelocity(subStep);
+		AccumulateTime(&timer, &m_profile.limitVelocity);
 		if (m_allGroupFlags & b2_rigidParticleGroup)
 		{
 			SolveRigidDamping();
+			AccumulateTime(&timer, &m_profile.damping);
 		}
 		if (m_allParticleFlags & b2_barrierParticle)
 		{
 			SolveBarrier(subStep);
+			AccumulateTime(&timer, &m_profile.barrier);
 		}
 		// SolveCollision, SolveRigid and SolveWall should be called after
 		// other force functions because they may require particles to have
 		// specific velocities.
 		SolveCollision(subStep);
+		AccumulateTime(&timer, &m_profile.collision);
 		if (m_allGroupFlags & b2_rigidParticleGroup)
 		{
 			SolveRigid(subStep);
 		}
-		if (m_allParticleFlags & b2_wallParticle)
+		if (m_allParticleFlags & (b2_wallParticle | b2_zombieParticle))
 		{
 			SolveWall();
 		}
+		if (m_sleepingCount > 0)
+		{
+			SolveSleep();
+		}
+		AccumulateTime(&timer, &m_profile.rigid);
 		// The particle positions can be updated only at the end of substep.
-		for (int32 i = 0; i < m_count; i++)
+		ParallelForParticles(&b2ParticleSystem::IntegratePositions, subStep);
+		AccumulateTime(&timer, &m_profile.integrate);
+	}
+	if (m_sleepingCount > 0)
+	{
+		RestoreSleepingContacts();
+		m_profile.sleepingCount = m_sleepingCount;
+		m_sleepingCount = 0;
+	}
+	UpdateProfileCounts();
+	if (m_def.shrinkBuffers)
+	{
+		ShrinkBuffers(false);
+	}
+	m_profile.solve = solveTimer.GetMilliseconds();
+}
+
+void b2ParticleSystem::UpdateProfileCounts()
+{
+	m_profile.particleCount = m_count;
+	m_profile.contactCount = m_contactBuffer.GetCount();
+	m_profile.bodyContactCount = m_bodyContactBuffer.GetCount();
+	m_profile.pairCount = m_pairBuffer.GetCount();
+	m_profile.triadCount = m_triadBuffer.GetCount();
+	m_profile.memoryUsage = ComputeMemoryUsage();
+}
+
+void b2ParticleSystem::IntegratePositions(
+	const b2TimeStep& step, int32 begin, int32 end)
+{
+	for (int32 i = begin; i < end; i++)
+	{
+		m_positionBuffer.data[i] += step.dt * m_velocityBuffer.data[i];
+	}
+}
+
+class b2ParticleSystem::RangeTask : public b2RangeTask
+{
+public:
+	RangeTask(b2ParticleSystem* system, RangeFunction function,
+			  const b2TimeStep& step) :
+		m_system(system),
+		m_function(function),
+		m_step(step),
+		m_offset(0)
+	{
+	}
+
+	// Shift the ranges passed to Execute() by 'offset'.
+	void SetOffset(int32 offset)
+	{
+		m_offset = offset;
+	}
+
+	virtual void Execute(int32 begin, int32 end)
+	{
+		(m_system->*m_function)(m_step, m_offset + begin, m_offset + end);
+	}
+
+private:
+	b2ParticleSystem* m_system;
+	RangeFunction m_function;
+	const b2TimeStep& m_step;
+	int32 m_offset;
+};
+
+// Run 'function' over all particles, split across the task scheduler's
+// threads if there is one. 'function' must only write to the particles in
+// the range it is given.
+void b2ParticleSystem::ParallelForParticles(
+	RangeFunction function, const b2TimeStep& step)
+{
+	if (!m_taskScheduler || m_count < 2 * k_parallelGrainSize)
+	{
+		(this->*function)(step, 0, m_count);
+		return;
+	}
+	RangeTask task(this, function, step);
+	m_taskScheduler->ParallelFor(&task, m_count, k_parallelGrainSize);
+}
+
+// Run 'function' over all particle-particle contacts. With a task scheduler,
+// each color produced by ColorContacts() is run as one parallel batch. No two
+// contacts in a batch share a particle, so 'function' may update both
+// particles of a contact without synchronization, and the result does not
+// depend on how the batches are split.
+void b2ParticleSystem::ParallelForContacts(
+	RangeFunction function, const b2TimeStep& step)
+{
+	const int32 contactCount = m_contactBuffer.GetCount();
+	if (!m_taskScheduler || contactCount < 2 * k_parallelGrainSize)
+	{
+		(this->*function)(step, 0, contactCount);
+		return;
+	}
+	b2Assert(m_contactColorOffsets[m_contactColorCount + 1] == contactCount);
+	RangeTask task(this, function, step);
+	for (int32 c = 0; c < m_contactColorCount; c++)
+	{
+		const int32 begin = m_contactColorOffsets[c];
+		const int32 end = m_contactColorOffsets[c + 1];
+		if (end - begin < 2 * k_parallelGrainSize)
 		{
-			m_positionBuffer.data[i] += subStep.dt * m_velocityBuffer.data[i];
+			(this->*function)(step, begin, end);
 		}
+		else
+		{
+			task.SetOffset(begin);
+			m_taskScheduler->ParallelFor(&task, end - begin,
+										 k_parallelGrainSize);
+		}
+	}
+	// Contacts that could not be colored.
+	(this->*function)(step, m_contactColorOffsets[m_contactColorCount],
+					  m_contactColorOffsets[m_contactColorCount + 1]);
+}
+
+// Index of the only set bit in 'bit', without a branch per bit.
+static inline int32 LowestBitIndex(uint32 bit)
+{
+	// De Bruijn sequence lookup, see
+	// http://graphics.stanford.edu/~seander/bithacks.html
+	static const uint8 k_index[32] =
+	{
+		0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+		31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9,
+	};
+	return k_index[(uint32)(bit * 0x077CB531u) >> 27];
+}
+
+// Reorder m_contactBuffer so that it consists of batches of contacts that
+// share no particles, using a greedy coloring. Each contact gets the lowest
+// color that neither of its particles has been given yet. The ordering is
+// stable within a color so the result only depends on the contacts.
+void b2ParticleSystem::ColorContacts()
+{
+	const int32 contactCount = m_contactBuffer.GetCount();
+	int32 colorCounts[k_maxContactColors + 1];
+	memset(colorCounts, 0, sizeof(colorCounts));
+	uint32* particleColors = (uint32*) m_world->m_stackAllocator.Allocate(
+		sizeof(uint32) * m_count);
+	memset(particleColors, 0, sizeof(uint32) * m_count);
+	uint8* contactColors = (uint8*) m_world->m_stackAllocator.Allocate(
+		sizeof(uint8) * contactCount);
+	int32 colorCount = 0;
+	for (int32 k = 0; k < contactCount; k++)
+	{
+		const b2ParticleContact& contact = m_contactBuffer[k];
+		const int32 a = contact.GetIndexA();
+		const int32 b = contact.GetIndexB();
+		const uint32 available = ~(particleColors[a] | particleColors[b]);
+		int32 color = k_maxContactColors;
+		if (available)
+		{
+			const uint32 bit = available & (0u - available);
+			color = LowestBitIndex(bit);
+			particleColors[a] |= bit;
+			particleColors[b] |= bit;
+			colorCount = b2Max(colorCount, color + 1);
+		}
+		contactColors[k] = (uint8)color;
+		colorCounts[color]++;
+	}
+
+	// The uncolored contacts go after the last color that was used.
+	int32 offsets[k_maxContactColors + 1];
+	m_contactColorOffsets[0] = 0;
+	for (int32 c = 0; c < colorCount; c++)
+	{
+		offsets[c] = m_contactColorOffsets[c];
+		m_contactColorOffsets[c + 1] = offsets[c] + colorCounts[c];
 	}
+	offsets[k_maxContactColors] = m_contactColorOffsets[colorCount];
+	m_contactColorOffsets[colorCount + 1] =
+		offsets[k_maxContactColors] + colorCounts[k_maxContactColors];
+	m_contactColorCount = colorCount;
+
+	b2ParticleContact* colored = (b2ParticleContact*)
+		m_world->m_stackAllocator.Allocate(
+			sizeof(b2ParticleContact) * contactCount);
+	for (int32 k = 0; k < contactCount; k++)
+	{
+		colored[offsets[contactColors[k]]++] = m_contactBuffer[k];
+	}
+	memcpy(m_contactBuffer.Data(), colored,
+		   sizeof(b2ParticleContact) * contactCount);
+
+	m_world->m_stackAllocator.Free(colored);
+	m_world->m_stackAllocator.Free(contactColors);
+	m_world->m_stackAllocator.Free(particleColors);
 }
 
 void b2ParticleSystem::UpdateAllParticleFlags()
@@ -3193,12 +4880,39 @@ void b2ParticleSystem::SolveStaticPressure(const b2TimeStep& step)
 }
 
 void b2ParticleSystem::SolvePressure(const b2TimeStep& step)
+{
+	ParallelForParticles(&b2ParticleSystem::ComputePressures, step);
+	// applies pressure between each particles in contact
+	float32 criticalPressure = GetCriticalPressure(step);
+	float32 pressurePerWeight = m_def.pressureStrength * criticalPressure;
+	float32 velocityPerPressure = step.dt / (m_def.density * m_particleDiameter);
+	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+	{
+		const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+		int32 a = contact.index;
+		float32 w = contact.weight;
+		float32 m = contact.mass;
+		b2Vec2 n = contact.normal;
+		b2Vec2 p = m_positionBuffer.data[a];
+		float32 h = m_accumulationBuffer[a] + pressurePerWeight * w;
+		b2Vec2 f = velocityPerPressure * w * m * h * n;
+		m_velocityBuffer.data[a] -= GetParticleInvMass() * f;
+		// Sleeping particles still hold up awake bodies, but let settled
+		// bodies fall asleep.
+		AddBodyImpulse(k, f, p, !IsParticleAsleep(a));
+	}
+	ApplyBodyImpulses();
+	ParallelForContacts(&b2ParticleSystem::SolveContactPressures, step);
+}
+
+void b2ParticleSystem::ComputePressures(
+	const b2TimeStep& step, int32 begin, int32 end)
 {
 	// calculates pressure as a linear function of density
 	float32 criticalPressure = GetCriticalPressure(step);
 	float32 pressurePerWeight = m_def.pressureStrength * criticalPressure;
 	float32 maxPressure = b2_maxParticlePressure * criticalPressure;
-	for (int32 i = 0; i < m_count; i++)
+	for (int32 i = begin; i < end; i++)
 	{
 		float32 w = m_weightBuffer[i];
 		float32 h = pressurePerWeight * b2Max(0.0f, w - b2_minParticleWeight);
@@ -3207,7 +4921,7 @@ void b2ParticleSystem::SolvePressure(const b2TimeStep& step)
 	// ignores particles which have their own repulsive force
 	if (m_allParticleFlags & k_noPressureFlags)
 	{
-		for (int32 i = 0; i < m_count; i++)
+		for (int32 i = begin; i < end; i++)
 		{
 			if (m_flagsBuffer.data[i] & k_noPressureFlags)
 			{
@@ -3219,7 +4933,7 @@ void b2ParticleSystem::SolvePressure(const b2TimeStep& step)
 	if (m_allParticleFlags & b2_staticPressureParticle)
 	{
 		b2Assert(m_staticPressureBuffer);
-		for (int32 i = 0; i < m_count; i++)
+		for (int32 i = begin; i < end; i++)
 		{
 			if (m_flagsBuffer.data[i] & b2_staticPressureParticle)
 			{
@@ -3227,23 +4941,13 @@ void b2ParticleSystem::SolvePressure(const b2TimeStep& step)
 			}
 		}
 	}
-	// applies pressure between each particles in contact
+}
+
+void b2ParticleSystem::SolveContactPressures(
+	const b2TimeStep& step, int32 begin, int32 end)
+{
 	float32 velocityPerPressure = step.dt / (m_def.density * m_particleDiameter);
-	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
-	{
-		const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
-		int32 a = contact.index;
-		b2Body* b = contact.body;
-		float32 w = contact.weight;
-		float32 m = contact.mass;
-		b2Vec2 n = contact.normal;
-		b2Vec2 p = m_positionBuffer.data[a];
-		float32 h = m_accumulationBuffer[a] + pressurePerWeight * w;
-		b2Vec2 f = velocityPerPressure * w * m * h * n;
-		m_velocityBuffer.data[a] -= GetParticleInvMass() * f;
-		b->ApplyLinearImpulse(f, p, true);
-	}
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+	for (int32 k = begin; k < end; k++)
 	{
 		const b2ParticleContact& contact = m_contactBuffer[k];
 		int32 a = contact.GetIndexA();
@@ -3266,13 +4970,11 @@ void b2ParticleSystem::SolveDamping(const b2TimeStep& step)
 	{
 		const b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
 		int32 a = contact.index;
-		b2Body* b = contact.body;
 		float32 w = contact.weight;
 		float32 m = contact.mass;
 		b2Vec2 n = contact.normal;
 		b2Vec2 p = m_positionBuffer.data[a];
-		b2Vec2 v = b->GetLinearVelocityFromWorldPoint(p) -
-				   m_velocityBuffer.data[a];
+		b2Vec2 v = GetBodyContactVelocity(k, p) - m_velocityBuffer.data[a];
 		float32 vn = b2Dot(v, n);
 		if (vn < 0)
 		{
@@ -3280,10 +4982,19 @@ void b2ParticleSystem::SolveDamping(const b2TimeStep& step)
 				b2Max(linearDamping * w, b2Min(- quadraticDamping * vn, 0.5f));
 			b2Vec2 f = damping * m * vn * n;
 			m_velocityBuffer.data[a] += GetParticleInvMass() * f;
-			b->ApplyLinearImpulse(-f, p, true);
+			AddBodyImpulse(k, -f, p, !IsParticleAsleep(a));
 		}
 	}
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+	ApplyBodyImpulses();
+	ParallelForContacts(&b2ParticleSystem::SolveContactDamping, step);
+}
+
+void b2ParticleSystem::SolveContactDamping(
+	const b2TimeStep& step, int32 begin, int32 end)
+{
+	float32 linearDamping = m_def.dampingStrength;
+	float32 quadraticDamping = 1 / GetCriticalVelocity(step);
+	for (int32 k = begin; k < end; k++)
 	{
 		const b2ParticleContact& contact = m_contactBuffer[k];
 		int32 a = contact.GetIndexA();
@@ -3485,29 +5196,28 @@ void b2ParticleSystem::SolveExtraDamping()
 		int32 a = contact.index;
 		if (m_flagsBuffer.data[a] & k_extraDampingFlags)
 		{
-			b2Body* b = contact.body;
 			float32 m = contact.mass;
 			b2Vec2 n = contact.normal;
 			b2Vec2 p = m_positionBuffer.data[a];
-			b2Vec2 v =
-				b->GetLinearVelocityFromWorldPoint(p) -
-				m_velocityBuffer.data[a];
+			b2Vec2 v = GetBodyContactVelocity(k, p) - m_velocityBuffer.data[a];
 			float32 vn = b2Dot(v, n);
 			if (vn < 0)
 			{
 				b2Vec2 f = 0.5f * m * vn * n;
 				m_velocityBuffer.data[a] += GetParticleInvMass() * f;
-				b->ApplyLinearImpulse(-f, p, true);
+				AddBodyImpulse(k, -f, p, true);
 			}
 		}
 	}
+	ApplyBodyImpulses();
 }
 
+// Wall particles, and zombies left for a later SolveZombie(), hold still.
 void b2ParticleSystem::SolveWall()
 {
 	for (int32 i = 0; i < m_count; i++)
 	{
-		if (m_flagsBuffer.data[i] & b2_wallParticle)
+		if (m_flagsBuffer.data[i] & (b2_wallParticle | b2_zombieParticle))
 		{
 			m_velocityBuffer.data[i].SetZero();
 		}
@@ -3616,7 +5326,15 @@ void b2ParticleSystem::SolveTensile(const b2TimeStep& step)
 	{
 		m_accumulation2Buffer[i] = b2Vec2_zero;
 	}
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+	ParallelForContacts(&b2ParticleSystem::AccumulateTensileNormals, step);
+	ParallelForContacts(&b2ParticleSystem::SolveContactTensions, step);
+}
+
+void b2ParticleSystem::AccumulateTensileNormals(
+	const b2TimeStep& step, int32 begin, int32 end)
+{
+	B2_NOT_USED(step);
+	for (int32 k = begin; k < end; k++)
 	{
 		const b2ParticleContact& contact = m_contactBuffer[k];
 		if (contact.GetFlags() & b2_tensileParticle)
@@ -3630,13 +5348,18 @@ void b2ParticleSystem::SolveTensile(const b2TimeStep& step)
 			m_accumulation2Buffer[b] += weightedNormal;
 		}
 	}
+}
+
+void b2ParticleSystem::SolveContactTensions(
+	const b2TimeStep& step, int32 begin, int32 end)
+{
 	float32 criticalVelocity = GetCriticalVelocity(step);
 	float32 pressureStrength = m_def.surfaceTensionPressureStrength
 							 * criticalVelocity;
 	float32 normalStrength = m_def.surfaceTensionNormalStrength
 						   * criticalVelocity;
 	float32 maxVelocityVariation = b2_maxParticleForce * criticalVelocity;
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+	for (int32 k = begin; k < end; k++)
 	{
 		const b2ParticleContact& contact = m_contactBuffer[k];
 		if (contact.GetFlags() & b2_tensileParticle)
@@ -3657,7 +5380,7 @@ void b2ParticleSystem::SolveTensile(const b2TimeStep& step)
 	}
 }
 
-void b2ParticleSystem::SolveViscous()
+void b2ParticleSystem::SolveViscous(const b2TimeStep& step)
 {
 	float32 viscousStrength = m_def.viscousStrength;
 	for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
@@ -3666,18 +5389,25 @@ void b2ParticleSystem::SolveViscous()
 		int32 a = contact.index;
 		if (m_flagsBuffer.data[a] & b2_viscousParticle)
 		{
-			b2Body* b = contact.body;
 			float32 w = contact.weight;
 			float32 m = contact.mass;
 			b2Vec2 p = m_positionBuffer.data[a];
-			b2Vec2 v = b->GetLinearVelocityFromWorldPoint(p) -
-					   m_velocityBuffer.data[a];
+			b2Vec2 v = GetBodyContactVelocity(k, p) - m_velocityBuffer.data[a];
 			b2Vec2 f = viscousStrength * m * w * v;
 			m_velocityBuffer.data[a] += GetParticleInvMass() * f;
-			b->ApplyLinearImpulse(-f, p, true);
+			AddBodyImpulse(k, -f, p, true);
 		}
 	}
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+	ApplyBodyImpulses();
+	ParallelForContacts(&b2ParticleSystem::SolveContactViscosity, step);
+}
+
+void b2ParticleSystem::SolveContactViscosity(
+	const b2TimeStep& step, int32 begin, int32 end)
+{
+	B2_NOT_USED(step);
+	float32 viscousStrength = m_def.viscousStrength;
+	for (int32 k = begin; k < end; k++)
 	{
 		const b2ParticleContact& contact = m_contactBuffer[k];
 		if (contact.GetFlags() & b2_viscousParticle)
@@ -3795,9 +5525,24 @@ void b2ParticleSystem::SolveColorMixing()
 	}
 }
 
+// Whether the zombie particles have to be removed this step, rather than
+// left to hold still until b2ParticleSystemDef::zombieCompactionFraction of
+// the particles are zombies.
+bool b2ParticleSystem::NeedsZombieCompaction() const
+{
+	// Zombies flagged without SetParticleFlags(), e.g. written straight into
+	// the flags buffer, aren't counted, so a count of 0 can't be trusted.
+	return m_zombieCount <= 0 ||
+		m_zombieCount > m_def.zombieCompactionFraction * m_count ||
+		(m_allParticleFlags & (k_pairFlags | k_triadFlags |
+							   b2_destructionListenerParticle)) ||
+		(m_allGroupFlags & (b2_rigidParticleGroup | b2_solidParticleGroup));
+}
+
 void b2ParticleSystem::SolveZombie()
 {
 	// removes particles with zombie flag
+	m_indexGeneration++;
 	int32 newCount = 0;
 	int32* newIndices = (int32*) m_world->m_stackAllocator.Allocate(
 		sizeof(int32) * m_count);
@@ -3872,6 +5617,10 @@ void b2ParticleSystem::SolveZombie()
 				{
 					m_depthBuffer[newCount] = m_depthBuffer[i];
 				}
+				if (m_sleepTimeBuffer)
+				{
+					m_sleepTimeBuffer[newCount] = m_sleepTimeBuffer[i];
+				}
 				if (m_colorBuffer.data)
 				{
 					m_colorBuffer.data[newCount] = m_colorBuffer.data[i];
@@ -3914,6 +5663,10 @@ void b2ParticleSystem::SolveZombie()
 		{
 			return triad.indexA < 0 || triad.indexB < 0 || triad.indexC < 0;
 		}
+		static bool IsNeighborPairInvalid(const NeighborPair& pair)
+		{
+			return pair.indexA < 0 || pair.indexB < 0;
+		}
 	};
 
 	// update proxies
@@ -3960,6 +5713,32 @@ void b2ParticleSystem::SolveZombie()
 	}
 	m_triadBuffer.RemoveIf(Test::IsTriadInvalid);
 
+	// update the neighbor list unless particles were added since it was
+	// built, in which case it is rebuilt anyway
+	if (m_neighborPositionBuffer.GetCount() != m_count)
+	{
+		m_neighborListValid = false;
+	}
+	else if (m_neighborListValid)
+	{
+		for (int32 k = 0; k < m_neighborPairBuffer.GetCount(); k++)
+		{
+			NeighborPair& pair = m_neighborPairBuffer[k];
+			pair.indexA = newIndices[pair.indexA];
+			pair.indexB = newIndices[pair.indexB];
+		}
+		m_neighborPairBuffer.RemoveIf(Test::IsNeighborPairInvalid);
+		b2Vec2* oldPositions = m_neighborPositionBuffer.Data();
+		for (int32 i = 0; i < m_count; i++)
+		{
+			if (newIndices[i] != b2_invalidParticleIndex)
+			{
+				oldPositions[newIndices[i]] = oldPositions[i];
+			}
+		}
+		m_neighborPositionBuffer.SetCount(newCount);
+	}
+
 	// Update lifetime indices.
 	if (m_indexByExpirationTimeBuffer.data)
 	{
@@ -3973,6 +5752,32 @@ void b2ParticleSystem::SolveZombie()
 				m_indexByExpirationTimeBuffer.data[writeOffset++] = newIndex;
 			}
 		}
+		// Entries of destroyed particles are dropped when their slot is
+		// visited.
+		for (int32 k = 0; k < m_expirationEntryBuffer.GetCount(); k++)
+		{
+			ExpirationEntry& entry = m_expirationEntryBuffer[k];
+			if (entry.index != b2_invalidParticleIndex)
+			{
+				entry.index = newIndices[entry.index];
+			}
+		}
+	}
+
+	// update emitters, keeping each ring oldest first
+	for (b2ParticleEmitter* emitter = m_emitterList; emitter;
+		 emitter = emitter->GetNext())
+	{
+		int32 count = 0;
+		for (int32 i = 0; i < emitter->m_count; i++)
+		{
+			const int32 newIndex = newIndices[emitter->IndexAt(i)];
+			if (newIndex != b2_invalidParticleIndex)
+			{
+				emitter->IndexAt(count++) = newIndex;
+			}
+		}
+		emitter->m_count = count;
 	}
 
 	// update groups
@@ -4022,6 +5827,7 @@ void b2ParticleSystem::SolveZombie()
 	m_world->m_stackAllocator.Free(newIndices);
 	m_allParticleFlags = allParticleFlags;
 	m_needsUpdateAllParticleFlags = false;
+	m_zombieCount = 0;
 
 	// destroy bodies with no particles
 	for (b2ParticleGroup* group = m_groupList; group;)
@@ -4035,6 +5841,168 @@ void b2ParticleSystem::SolveZombie()
 	}
 }
 
+void b2ParticleSystem::EmitParticles(const b2TimeStep& step)
+{
+	for (b2ParticleEmitter* emitter = m_emitterList; emitter;
+		 emitter = emitter->GetNext())
+	{
+		// Carry the fraction of a particle over to the next step. More than
+		// a ring's worth in one step would only overwrite itself.
+		const float32 emitCount = emitter->m_emitRemainder +
+			b2Max(emitter->m_emitRate, 0.0f) * step.dt;
+		const float32 wholeCount = floorf(emitCount);
+		emitter->m_emitRemainder = emitCount - wholeCount;
+		const int32 count = (int32) b2Min(wholeCount,
+										  (float32) emitter->m_capacity);
+		if (count <= 0)
+		{
+			continue;
+		}
+
+		// Grow the ring while it has room and the particle system does too,
+		// then recycle the oldest particles for the rest.
+		int32 freshCount = b2Min(count,
+								 emitter->m_capacity - emitter->m_count);
+		if (freshCount > 0 &&
+			m_count + freshCount > m_internalAllocatedCapacity)
+		{
+			ReallocateInternalAllocatedBuffers(b2Max(m_count + freshCount,
+				m_count ? 2 * m_count : b2_minParticleSystemBufferCapacity));
+			freshCount = b2Max(0, b2Min(freshCount,
+				m_internalAllocatedCapacity - m_count));
+		}
+		const int32 recycleCount = emitter->m_recycleOldest ?
+			b2Min(count - freshCount, emitter->m_count) : 0;
+
+		// Spread the particles along their path by when they were due
+		// during the step, so they don't all start on top of each other.
+		const b2Vec2 velocity = b2Mul(emitter->m_transform.q,
+									  emitter->m_velocity);
+		const float32 ageStep = step.dt / (freshCount + recycleCount);
+		float32 age = step.dt - 0.5f * ageStep;
+		for (int32 i = 0; i < recycleCount; i++, age -= ageStep)
+		{
+			const int32 index = emitter->IndexAt(0);
+			emitter->m_firstIndex = emitter->m_firstIndex + 1 <
+				emitter->m_capacity ? emitter->m_firstIndex + 1 : 0;
+			// A particle destroyed since the last step has to reach
+			// SolveZombie() so its destruction listener is called; drop it
+			// from the ring rather than reuse its slot.
+			if (m_flagsBuffer.data[index] & b2_zombieParticle)
+			{
+				emitter->m_count--;
+				continue;
+			}
+			emitter->IndexAt(emitter->m_count - 1) = index;
+			RecycleParticle(index, *emitter,
+							emitter->ComputeEmissionPoint() + age * velocity,
+							velocity);
+		}
+		if (freshCount > 0)
+		{
+			b2Vec2* positions = (b2Vec2*) m_world->m_stackAllocator.Allocate(
+				sizeof(b2Vec2) * freshCount);
+			b2Vec2* velocities = (b2Vec2*) m_world->m_stackAllocator.Allocate(
+				sizeof(b2Vec2) * freshCount);
+			for (int32 i = 0; i < freshCount; i++, age -= ageStep)
+			{
+				positions[i] = emitter->ComputeEmissionPoint() + age * velocity;
+				velocities[i] = velocity;
+			}
+			b2ParticleBatchDef def;
+			def.count = freshCount;
+			def.positionData = positions;
+			def.velocityData = velocities;
+			def.flags = emitter->m_flags;
+			def.color = emitter->m_color;
+			def.lifetime = emitter->m_lifetime;
+			def.userData = emitter->m_userData;
+			const int32 firstIndex = InitializeParticles(def, freshCount);
+			for (int32 i = 0; i < freshCount; i++)
+			{
+				emitter->IndexAt(emitter->m_count++) = firstIndex + i;
+			}
+			m_world->m_stackAllocator.Free(velocities);
+			m_world->m_stackAllocator.Free(positions);
+		}
+	}
+}
+
+// Overwrite every per-particle buffer the way CreateParticle() initializes
+// them. The particle keeps its index, so nothing else has to be remapped.
+void b2ParticleSystem::RecycleParticle(
+	int32 index, const b2ParticleEmitter& emitter, const b2Vec2& position,
+	const b2Vec2& velocity)
+{
+	b2Assert(m_groupBuffer[index] == NULL);
+	b2Assert(!(m_flagsBuffer.data[index] & b2_zombieParticle));
+	m_indexGeneration++;
+	SetParticleFlags(index, emitter.m_flags);
+	if (m_lastBodyContactStepBuffer.data)
+	{
+		m_lastBodyContactStepBuffer.data[index] = 0;
+	}
+	if (m_bodyContactCountBuffer.data)
+	{
+		m_bodyContactCountBuffer.data[index] = 0;
+	}
+	if (m_consecutiveContactStepsBuffer.data)
+	{
+		m_consecutiveContactStepsBuffer.data[index] = 0;
+	}
+	m_positionBuffer.data[index] = position;
+	m_velocityBuffer.data[index] = velocity;
+	m_weightBuffer[index] = 0;
+	m_forceBuffer[index] = b2Vec2_zero;
+	if (m_staticPressureBuffer)
+	{
+		m_staticPressureBuffer[index] = 0;
+	}
+	if (m_depthBuffer)
+	{
+		m_depthBuffer[index] = 0;
+	}
+	if (m_sleepTimeBuffer)
+	{
+		m_sleepTimeBuffer[index] = 0;
+	}
+	if (m_colorBuffer.data || !emitter.m_color.IsZero())
+	{
+		m_colorBuffer.data = RequestBuffer(m_colorBuffer.data);
+		m_colorBuffer.data[index] = emitter.m_color;
+	}
+	if (m_userDataBuffer.data || emitter.m_userData)
+	{
+		m_userDataBuffer.data = RequestBuffer(m_userDataBuffer.data);
+		m_userDataBuffer.data[index] = emitter.m_userData;
+	}
+	// Handles name the old particle, which is gone.
+	if (m_handleIndexBuffer.data)
+	{
+		b2ParticleHandle * const handle = m_handleIndexBuffer.data[index];
+		if (handle)
+		{
+			handle->SetIndex(b2_invalidParticleIndex);
+			m_handleIndexBuffer.data[index] = NULL;
+			m_handleAllocator.Free(handle);
+		}
+	}
+	const bool finiteLifetime = emitter.m_lifetime > 0;
+	if (m_expirationTimeBuffer.data || finiteLifetime)
+	{
+		// Clear the old time so SetParticleLifetime() queues the new one;
+		// the old particle's wheel entry is then stale.
+		if (m_expirationTimeBuffer.data)
+		{
+			m_expirationTimeBuffer.data[index] = 0;
+		}
+		SetParticleLifetime(index, finiteLifetime ? emitter.m_lifetime :
+								ExpirationTimeToLifetime(
+									-GetQuantizedTimeElapsed()));
+		m_expirationTimeBufferRequiresSorting = true;
+	}
+}
+
 /// Destroy all particles which have outlived their lifetimes set by
 /// SetParticleLifetime().
 void b2ParticleSystem::SolveLifetimes(const b2TimeStep& step)
@@ -4047,32 +6015,81 @@ void b2ParticleSystem::SolveLifetimes(const b2TimeStep& step)
 	const int32 quantizedTimeElapsed = GetQuantizedTimeElapsed();
 
 	const int32* const expirationTimes = m_expirationTimeBuffer.data;
-	int32* const expirationTimeIndices = m_indexByExpirationTimeBuffer.data;
-	const int32 particleCount = GetParticleCount();
-	// Sort the lifetime buffer if it's required.
+	// Visit the slot of every quantized time that passed since the last
+	// step, or every slot once if the wheel went all the way round.
+	const int32 slotCount = b2Min(quantizedTimeElapsed - m_expiredTime,
+								  k_expirationWheelSize);
+	for (int32 i = 1; i <= slotCount; i++)
+	{
+		int32* link = &m_expirationWheel[
+			(m_expiredTime + i) & (k_expirationWheelSize - 1)];
+		while (*link >= 0)
+		{
+			ExpirationEntry& entry = m_expirationEntryBuffer[*link];
+			const bool stale = entry.index == b2_invalidParticleIndex ||
+				expirationTimes[entry.index] != entry.expirationTime;
+			if (!stale && quantizedTimeElapsed < entry.expirationTime)
+			{
+				// Due on a later turn of the wheel.
+				link = &entry.next;
+				continue;
+			}
+			if (!stale)
+			{
+				// Destroy this particle.
+				DestroyParticle(entry.index);
+			}
+			// Move the entry to the free list.
+			const int32 next = entry.next;
+			entry.index = b2_invalidParticleIndex;
+			entry.next = m_freeExpirationEntry;
+			m_freeExpirationEntry = *link;
+			*link = next;
+		}
+	}
+	m_expiredTime = quantizedTimeElapsed;
+}
+
+/// Queue a particle on the timing wheel to expire at expirationTime.
+/// Infinite lifetimes are not queued.
+void b2ParticleSystem::QueueExpiration(int32 index, int32 expirationTime)
+{
+	if (expirationTime <= 0)
+	{
+		return;
+	}
+	int32 k = m_freeExpirationEntry;
+	if (k >= 0)
+	{
+		m_freeExpirationEntry = m_expirationEntryBuffer[k].next;
+	}
+	else
+	{
+		k = m_expirationEntryBuffer.GetCount();
+		m_expirationEntryBuffer.Append();
+	}
+	ExpirationEntry& entry = m_expirationEntryBuffer[k];
+	int32& slot =
+		m_expirationWheel[expirationTime & (k_expirationWheelSize - 1)];
+	entry.index = index;
+	entry.expirationTime = expirationTime;
+	entry.next = slot;
+	slot = k;
+}
+
+/// Sort m_indexByExpirationTimeBuffer if lifetimes changed since it was
+/// last sorted.
+void b2ParticleSystem::SortIndexByExpirationTime()
+{
 	if (m_expirationTimeBufferRequiresSorting)
 	{
 		const ExpirationTimeComparator expirationTimeComparator(
-			expirationTimes);
-		std::sort(expirationTimeIndices,
-				  expirationTimeIndices + particleCount,
+			m_expirationTimeBuffer.data);
+		std::sort(m_indexByExpirationTimeBuffer.data,
+				  m_indexByExpirationTimeBuffer.data + GetParticleCount(),
 				  expirationTimeComparator);
 		m_expirationTimeBufferRequiresSorting = false;
 	}
-
-	// Destroy particles which have expired.
-	for (int32 i = particleCount - 1; i >= 0; --i)
-	{
-		const int32 particleIndex = expirationTimeIndices[i];
-		const int32 expirationTime = expirationTimes[particleIndex];
-		// If no particles need to be destroyed, skip this.
-		if (quantizedTimeElapsed < expirationTime || expirationTime <= 0)
-		{
-			break;
-		}
-		// Destroy this particle.
-		DestroyParticle(particleIndex);
-	}
 }
 
 void b2ParticleSystem::RotateBuffer(int32 start, int32 mid, int32 end)
@@ -4083,6 +6100,7 @@ void b2ParticleSystem::RotateBuffer(int32 start, int32 mid, int32 end)
 		return;
 	}
 	b2Assert(mid >= start && mid <= end);
+	m_indexGeneration++;
 	struct NewIndices
 	{
 		int32 operator[](int32 i) const
@@ -4109,6 +6127,8 @@ void b2ParticleSystem::RotateBuffer(int32 start, int32 mid, int32 end)
 	newIndices.start = start;
 	newIndices.mid = mid;
 	newIndices.end = end;
+	// The neighbor list is cheaper to rebuild than to permute here.
+	m_neighborListValid = false;
 
 	std::rotate(m_flagsBuffer.data + start, m_flagsBuffer.data + mid,
 				m_flagsBuffer.data + end);
@@ -4152,6 +6172,11 @@ void b2ParticleSystem::RotateBuffer(int32 start, int32 mid, int32 end)
 		std::rotate(m_depthBuffer + start, m_depthBuffer + mid,
 					m_depthBuffer + end);
 	}
+	if (m_sleepTimeBuffer)
+	{
+		std::rotate(m_sleepTimeBuffer + start, m_sleepTimeBuffer + mid,
+					m_sleepTimeBuffer + end);
+	}
 	if (m_colorBuffer.data)
 	{
 		std::rotate(m_colorBuffer.data + start,
@@ -4189,6 +6214,14 @@ void b2ParticleSystem::RotateBuffer(int32 start, int32 mid, int32 end)
 		{
 			indexByExpirationTime[i] = newIndices[indexByExpirationTime[i]];
 		}
+		for (int32 k = 0; k < m_expirationEntryBuffer.GetCount(); k++)
+		{
+			ExpirationEntry& entry = m_expirationEntryBuffer[k];
+			if (entry.index != b2_invalidParticleIndex)
+			{
+				entry.index = newIndices[entry.index];
+			}
+		}
 	}
 
 	// update proxies
@@ -4230,6 +6263,17 @@ void b2ParticleSystem::RotateBuffer(int32 start, int32 mid, int32 end)
 		triad.indexC = newIndices[triad.indexC];
 	}
 
+	// update emitters
+	for (b2ParticleEmitter* emitter = m_emitterList; emitter;
+		 emitter = emitter->GetNext())
+	{
+		for (int32 i = 0; i < emitter->m_count; i++)
+		{
+			int32& index = emitter->IndexAt(i);
+			index = newIndices[index];
+		}
+	}
+
 	// update groups
 	for (b2ParticleGroup* group = m_groupList; group; group = group->GetNext())
 	{
@@ -4238,6 +6282,220 @@ void b2ParticleSystem::RotateBuffer(int32 start, int32 mid, int32 end)
 	}
 }
 
+// Interleave the low 16 bits of x and y into a Z-order curve position.
+static inline uint32 computeMortonKey(uint32 x, uint32 y)
+{
+	x &= 0xffff;
+	y &= 0xffff;
+	x = (x | (x << 8)) & 0x00ff00ff;
+	x = (x | (x << 4)) & 0x0f0f0f0f;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+	y = (y | (y << 8)) & 0x00ff00ff;
+	y = (y | (y << 4)) & 0x0f0f0f0f;
+	y = (y | (y << 2)) & 0x33333333;
+	y = (y | (y << 1)) & 0x55555555;
+	return x | (y << 1);
+}
+
+// Set buffer[i] to the old buffer[oldIndices[i]] for every particle.
+template <typename T>
+static void ReorderParticleBuffer(T* buffer, const int32* oldIndices,
+								  int32 count, void* temp)
+{
+	T* copy = (T*) temp;
+	std::copy(buffer, buffer + count, copy);
+	for (int32 i = 0; i < count; i++)
+	{
+		buffer[i] = copy[oldIndices[i]];
+	}
+}
+
+void b2ParticleSystem::ReorderParticlesSpatially()
+{
+	// Sort the particles by the Z-order of the cell, one particle diameter
+	// wide, they are in. Groups need contiguous index ranges, so each group
+	// and each run of particles outside any group is sorted by itself.
+	Proxy* order = (Proxy*) m_world->m_stackAllocator.Allocate(
+		sizeof(Proxy) * m_count);
+	for (int32 i = 0; i < m_count; i++)
+	{
+		const b2Vec2& p = m_positionBuffer.data[i];
+		order[i].index = i;
+		order[i].tag = computeMortonKey(
+			(uint32)(int32) floorf(p.x * m_inverseDiameter) + 0x8000,
+			(uint32)(int32) floorf(p.y * m_inverseDiameter) + 0x8000);
+	}
+	for (int32 begin = 0, end = 0; begin < m_count; begin = end)
+	{
+		const b2ParticleGroup* group = m_groupBuffer[begin];
+		if (group)
+		{
+			end = group->m_lastIndex;
+		}
+		else
+		{
+			for (end = begin + 1; end < m_count && !m_groupBuffer[end]; end++)
+			{
+			}
+		}
+		std::stable_sort(order + begin, order + end);
+	}
+
+	int32* oldIndices = (int32*) m_world->m_stackAllocator.Allocate(
+		sizeof(int32) * m_count);
+	int32* newIndices = (int32*) m_world->m_stackAllocator.Allocate(
+		sizeof(int32) * m_count);
+	bool moved = false;
+	for (int32 i = 0; i < m_count; i++)
+	{
+		oldIndices[i] = order[i].index;
+		newIndices[order[i].index] = i;
+		moved = moved || order[i].index != i;
+	}
+	if (moved)
+	{
+		void* temp = m_world->m_stackAllocator.Allocate(
+			b2Max((int32) sizeof(b2Vec2), (int32) sizeof(void*)) * m_count);
+		ReorderParticleBuffer(m_flagsBuffer.data, oldIndices, m_count, temp);
+		if (m_lastBodyContactStepBuffer.data)
+		{
+			ReorderParticleBuffer(m_lastBodyContactStepBuffer.data,
+								  oldIndices, m_count, temp);
+		}
+		if (m_bodyContactCountBuffer.data)
+		{
+			ReorderParticleBuffer(m_bodyContactCountBuffer.data, oldIndices,
+								  m_count, temp);
+		}
+		if (m_consecutiveContactStepsBuffer.data)
+		{
+			ReorderParticleBuffer(m_consecutiveContactStepsBuffer.data,
+								  oldIndices, m_count, temp);
+		}
+		ReorderParticleBuffer(m_positionBuffer.data, oldIndices, m_count,
+							  temp);
+		ReorderParticleBuffer(m_velocityBuffer.data, oldIndices, m_count,
+							  temp);
+		if (m_hasForce)
+		{
+			ReorderParticleBuffer(m_forceBuffer, oldIndices, m_count, temp);
+		}
+		if (m_staticPressureBuffer)
+		{
+			ReorderParticleBuffer(m_staticPressureBuffer, oldIndices, m_count,
+								  temp);
+		}
+		if (m_depthBuffer)
+		{
+			ReorderParticleBuffer(m_depthBuffer, oldIndices, m_count, temp);
+		}
+		if (m_sleepTimeBuffer)
+		{
+			ReorderParticleBuffer(m_sleepTimeBuffer, oldIndices, m_count,
+								  temp);
+		}
+		if (m_colorBuffer.data)
+		{
+			ReorderParticleBuffer(m_colorBuffer.data, oldIndices, m_count,
+								  temp);
+		}
+		if (m_userDataBuffer.data)
+		{
+			ReorderParticleBuffer(m_userDataBuffer.data, oldIndices, m_count,
+								  temp);
+		}
+		if (m_handleIndexBuffer.data)
+		{
+			ReorderParticleBuffer(m_handleIndexBuffer.data, oldIndices,
+								  m_count, temp);
+			for (int32 i = 0; i < m_count; i++)
+			{
+				b2ParticleHandle * const handle = m_handleIndexBuffer.data[i];
+				if (handle) handle->SetIndex(i);
+			}
+		}
+		if (m_expirationTimeBuffer.data)
+		{
+			ReorderParticleBuffer(m_expirationTimeBuffer.data, oldIndices,
+								  m_count, temp);
+			int32* const indexByExpirationTime =
+				m_indexByExpirationTimeBuffer.data;
+			for (int32 i = 0; i < m_count; i++)
+			{
+				indexByExpirationTime[i] = newIndices[indexByExpirationTime[i]];
+			}
+			for (int32 k = 0; k < m_expirationEntryBuffer.GetCount(); k++)
+			{
+				ExpirationEntry& entry = m_expirationEntryBuffer[k];
+				if (entry.index != b2_invalidParticleIndex)
+				{
+					entry.index = newIndices[entry.index];
+				}
+			}
+		}
+		m_world->m_stackAllocator.Free(temp);
+
+		for (int32 k = 0; k < m_proxyBuffer.GetCount(); k++)
+		{
+			Proxy& proxy = m_proxyBuffer.Begin()[k];
+			proxy.index = newIndices[proxy.index];
+		}
+		if (m_sleepRegionBuffer.GetCount() == m_count)
+		{
+			for (int32 k = 0; k < m_count; k++)
+			{
+				Proxy& proxy = m_sleepRegionBuffer.Begin()[k];
+				proxy.index = newIndices[proxy.index];
+			}
+		}
+		for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+		{
+			b2ParticleContact& contact = m_contactBuffer[k];
+			contact.SetIndices(newIndices[contact.GetIndexA()],
+							   newIndices[contact.GetIndexB()]);
+		}
+		for (int32 k = 0; k < m_bodyContactBuffer.GetCount(); k++)
+		{
+			b2ParticleBodyContact& contact = m_bodyContactBuffer[k];
+			contact.index = newIndices[contact.index];
+		}
+		for (int32 k = 0; k < m_stuckParticleBuffer.GetCount(); k++)
+		{
+			int32& index = m_stuckParticleBuffer[k];
+			index = newIndices[index];
+		}
+		for (b2ParticleEmitter* emitter = m_emitterList; emitter;
+			 emitter = emitter->GetNext())
+		{
+			for (int32 i = 0; i < emitter->m_count; i++)
+			{
+				int32& index = emitter->IndexAt(i);
+				index = newIndices[index];
+			}
+		}
+		for (int32 k = 0; k < m_pairBuffer.GetCount(); k++)
+		{
+			b2ParticlePair& pair = m_pairBuffer[k];
+			pair.indexA = newIndices[pair.indexA];
+			pair.indexB = newIndices[pair.indexB];
+		}
+		for (int32 k = 0; k < m_triadBuffer.GetCount(); k++)
+		{
+			b2ParticleTriad& triad = m_triadBuffer[k];
+			triad.indexA = newIndices[triad.indexA];
+			triad.indexB = newIndices[triad.indexB];
+			triad.indexC = newIndices[triad.indexC];
+		}
+		// The neighbor list is cheaper to rebuild than to permute here.
+		m_neighborListValid = false;
+		m_indexGeneration++;
+	}
+	m_world->m_stackAllocator.Free(newIndices);
+	m_world->m_stackAllocator.Free(oldIndices);
+	m_world->m_stackAllocator.Free(order);
+}
+
 /// Set the lifetime (in seconds) of a particle relative to the current
 /// time.
 void b2ParticleSystem::SetParticleLifetime(const int32 index,
@@ -4270,6 +6528,7 @@ void b2ParticleSystem::SetParticleLifetime(const int32 index,
 	{
 		m_expirationTimeBuffer.data[index] = newExpirationTime;
 		m_expirationTimeBufferRequiresSorting = true;
+		QueueExpiration(index, newExpirationTime);
 	}
 }
 
@@ -4312,6 +6571,7 @@ const int32* b2ParticleSystem::GetIndexByExpirationTimeBuffer()
 	if (GetParticleCount())
 	{
 		SetParticleLifetime(0, GetParticleLifetime(0));
+		SortIndexByExpirationTime();
 	}
 	else
 	{
@@ -4391,6 +6651,14 @@ void b2ParticleSystem::SetParticleFlags(int32 index, uint32 newFlags)
 	{
 		// If any flags might be removed
 		m_needsUpdateAllParticleFlags = true;
+		if (*oldFlags & ~newFlags & b2_zombieParticle)
+		{
+			m_zombieCount--;
+		}
+	}
+	if (~*oldFlags & newFlags & b2_zombieParticle)
+	{
+		m_zombieCount++;
 	}
 	if (~m_allParticleFlags & newFlags)
 	{
@@ -4492,6 +6760,26 @@ void b2ParticleSystem::ParticleApplyForce(int32 index, const b2Vec2& force)
 	}
 }
 
+void b2ParticleSystem::ParticleApplyForces(const int32* indices,
+										   const b2Vec2* forces, int32 count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	PrepareForceBuffer();
+	const uint32* flags = m_flagsBuffer.data;
+	for (int32 i = 0; i < count; i++)
+	{
+		const int32 index = indices[i];
+		b2Assert(index >= 0 && index < m_count);
+		if (ForceCanBeApplied(flags[index]))
+		{
+			m_forceBuffer[index] += forces[i];
+		}
+	}
+}
+
 void b2ParticleSystem::ApplyLinearImpulse(int32 firstIndex, int32 lastIndex,
 										  const b2Vec2& impulse)
 {
@@ -4620,6 +6908,70 @@ float32 b2ParticleSystem::ComputeCollisionEnergy() const
 	return 0.5f * GetParticleMass() * sum_v2;
 }
 
+template <typename T> static int32 BufferMemory(const T* buffer,
+												int32 capacity)
+{
+	return buffer ? (int32) sizeof(T) * capacity : 0;
+}
+
+// B is a UserOverridableBuffer; user-supplied memory isn't the system's.
+template <typename B> static int32 OverridableBufferMemory(const B& buffer,
+														   int32 capacity)
+{
+	return buffer.userSuppliedCapacity ? 0 :
+		BufferMemory(buffer.data, capacity);
+}
+
+template <typename T> static int32 GrowableBufferMemory(
+	const b2GrowableBuffer<T>& buffer)
+{
+	return BufferMemory(buffer.Data(), buffer.GetCapacity());
+}
+
+int32 b2ParticleSystem::ComputeMemoryUsage() const
+{
+	const int32 capacity = m_internalAllocatedCapacity;
+	int32 bytes = 0;
+	bytes += OverridableBufferMemory(m_handleIndexBuffer, capacity);
+	bytes += OverridableBufferMemory(m_flagsBuffer, capacity);
+	bytes += OverridableBufferMemory(m_positionBuffer, capacity);
+	bytes += OverridableBufferMemory(m_velocityBuffer, capacity);
+	bytes += BufferMemory(m_forceBuffer, capacity);
+	bytes += BufferMemory(m_weightBuffer, capacity);
+	bytes += BufferMemory(m_staticPressureBuffer, capacity);
+	bytes += BufferMemory(m_accumulationBuffer, capacity);
+	bytes += BufferMemory(m_accumulation2Buffer, capacity);
+	bytes += BufferMemory(m_depthBuffer, capacity);
+	bytes += BufferMemory(m_sleepTimeBuffer, capacity);
+	bytes += BufferMemory(m_sleepStateBuffer, capacity);
+	bytes += OverridableBufferMemory(m_colorBuffer, capacity);
+	bytes += BufferMemory(m_groupBuffer, capacity);
+	bytes += OverridableBufferMemory(m_userDataBuffer, capacity);
+	bytes += OverridableBufferMemory(m_lastBodyContactStepBuffer, capacity);
+	bytes += OverridableBufferMemory(m_bodyContactCountBuffer, capacity);
+	bytes += OverridableBufferMemory(m_consecutiveContactStepsBuffer,
+									 capacity);
+	bytes += OverridableBufferMemory(m_expirationTimeBuffer, capacity);
+	bytes += OverridableBufferMemory(m_indexByExpirationTimeBuffer,
+									 capacity);
+
+	bytes += GrowableBufferMemory(m_stuckParticleBuffer);
+	bytes += GrowableBufferMemory(m_proxyBuffer);
+	bytes += GrowableBufferMemory(m_contactBuffer);
+	bytes += GrowableBufferMemory(m_bodyContactBuffer);
+	bytes += GrowableBufferMemory(m_pairBuffer);
+	bytes += GrowableBufferMemory(m_triadBuffer);
+	bytes += GrowableBufferMemory(m_expirationEntryBuffer);
+	bytes += GrowableBufferMemory(m_neighborPairBuffer);
+	bytes += GrowableBufferMemory(m_neighborPositionBuffer);
+	bytes += GrowableBufferMemory(m_sleepingContactBuffer);
+	bytes += GrowableBufferMemory(m_sleepRegionBuffer);
+	bytes += GrowableBufferMemory(m_awakeProxyBuffer);
+	bytes += GrowableBufferMemory(m_bodyImpulseBuffer);
+	bytes += GrowableBufferMemory(m_bodyContactImpulseBuffer);
+	return bytes;
+}
+
 void b2ParticleSystem::SetStuckThreshold(int32 steps)
 {
 	m_stuckThreshold = steps;
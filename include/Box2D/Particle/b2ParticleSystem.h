@@ -20,6 +20,7 @@
 
 #include <Box2D/Common/b2SlabAllocator.h>
 #include <Box2D/Common/b2GrowableBuffer.h>
+#include <Box2D/Common/b2TaskScheduler.h>
 #include <Box2D/Particle/b2Particle.h>
 #include <Box2D/Dynamics/b2TimeStep.h>
 
@@ -35,6 +36,8 @@ class b2World;
 class b2Body;
 class b2Shape;
 class b2ParticleGroup;
+class b2ParticleEmitter;
+struct b2ParticleEmitterDef;
 class b2BlockAllocator;
 class b2StackAllocator;
 class b2QueryCallback;
@@ -50,6 +53,13 @@ struct b2AABB;
 struct FindContactInput;
 struct FindContactCheck;
 
+/// The particle indices stored in contacts, pairs and triads.
+#ifdef B2_USE_16_BIT_PARTICLE_INDICES
+typedef int16 b2ParticleIndex;
+#else
+typedef int32 b2ParticleIndex;
+#endif
+
 struct b2ParticleContact
 {
 private:
@@ -58,12 +68,6 @@ private:
 	// b2ParticleSystem::Solve, so reducing the amount of data we churn
 	// through speeds things up. Also, FindContactsFromChecks_Simd takes
 	// advantage of the reduced size for specific optimizations.
-	#ifdef B2_USE_16_BIT_PARTICLE_INDICES
-		typedef int16 b2ParticleIndex;
-	#else
-		typedef int32 b2ParticleIndex;
-	#endif
-
 	/// Indices of the respective particles making contact.
 	b2ParticleIndex indexA, indexB;
 
@@ -72,8 +76,13 @@ private:
 	/// 1.0f ==> particles are perfectly on top of each other
 	float32 weight;
 
+#ifdef B2_USE_COMPACT_PARTICLES
+	/// The normalized direction from A to B, in units of 1 / 32767.
+	int16 normalX, normalY;
+#else
 	/// The normalized direction from A to B.
 	b2Vec2 normal;
+#endif
 
 	/// The logical sum of the particle behaviors that have been set.
 	/// See the b2ParticleFlag enum.
@@ -82,15 +91,24 @@ private:
 public:
 	void SetIndices(int32 a, int32 b);
 	void SetWeight(float32 w) { weight = w; }
-	void SetNormal(const b2Vec2& n) { normal = n; }
 	void SetFlags(uint32 f) { flags = f; }
 
 	int32 GetIndexA() const { return indexA; }
 	int32 GetIndexB() const { return indexB; }
 	float32 GetWeight() const { return weight; }
-	const b2Vec2& GetNormal() const { return normal; }
 	uint32 GetFlags() const { return flags; }
 
+#ifdef B2_USE_COMPACT_PARTICLES
+	void SetNormal(const b2Vec2& n);
+	b2Vec2 GetNormal() const
+	{
+		return b2Vec2(normalX * (1.0f / 0x7FFF), normalY * (1.0f / 0x7FFF));
+	}
+#else
+	void SetNormal(const b2Vec2& n) { normal = n; }
+	const b2Vec2& GetNormal() const { return normal; }
+#endif
+
 	bool operator==(const b2ParticleContact& rhs) const;
 	bool operator!=(const b2ParticleContact& rhs) const { return !operator==(rhs); }
 	bool ApproximatelyEqual(const b2ParticleContact& rhs) const;
@@ -121,7 +139,7 @@ struct b2ParticleBodyContact
 struct b2ParticlePair
 {
 	/// Indices of the respective particles making pair.
-	int32 indexA, indexB;
+	b2ParticleIndex indexA, indexB;
 
 	/// The logical sum of the particle flags. See the b2ParticleFlag enum.
 	uint32 flags;
@@ -137,7 +155,7 @@ struct b2ParticlePair
 struct b2ParticleTriad
 {
 	/// Indices of the respective particles making triad.
-	int32 indexA, indexB, indexC;
+	b2ParticleIndex indexA, indexB, indexC;
 
 	/// The logical sum of the particle flags. See the b2ParticleFlag enum.
 	uint32 flags;
@@ -150,6 +168,50 @@ struct b2ParticleTriad
 	float32 ka, kb, kc, s;
 };
 
+/// Per-stage timings and counters from the last b2ParticleSystem::Solve().
+/// Times are in milliseconds and summed over all particle iterations of the
+/// step; counts are taken at the end of the step.
+struct b2ParticleProfile
+{
+	float32 solve;				///< whole particle step
+	float32 emit;				///< EmitParticles
+	float32 lifetimes;			///< SolveLifetimes
+	float32 zombie;				///< SolveZombie
+	float32 updateFlags;		///< UpdateAllParticleFlags, UpdateAllGroupFlags
+	float32 reorder;			///< ReorderParticlesSpatially
+	float32 sleep;				///< UpdateSleep
+	float32 updateContacts;		///< UpdateContacts, ColorContacts
+	float32 updateBodyContacts;	///< UpdateBodyContacts
+	float32 computeWeight;		///< ComputeWeight
+	float32 computeDepth;		///< ComputeDepth
+	float32 reactive;			///< UpdatePairsAndTriadsWithReactiveParticles
+	float32 forces;				///< SolveForce, SolveGravity and the per-flag
+								///< viscous, repulsive, powder, tensile, solid
+								///< and color mixing stages
+	float32 pressure;			///< SolveStaticPressure, SolvePressure
+	float32 damping;			///< SolveDamping, SolveExtraDamping,
+								///< SolveRigidDamping
+	float32 elastic;			///< SolveElastic, SolveSpring
+	float32 limitVelocity;		///< LimitVelocity
+	float32 barrier;			///< SolveBarrier
+	float32 collision;			///< SolveCollision
+	float32 rigid;				///< SolveRigid, SolveWall
+	float32 integrate;			///< position integration
+
+	int32 particleCount;
+	int32 contactCount;
+	int32 bodyContactCount;
+	int32 pairCount;
+	int32 triadCount;
+	int32 zombiesRemoved;		///< particles destroyed by SolveZombie
+	int32 sleepingCount;		///< particles asleep during the step
+	int32 neighborListRebuilds;	///< particle iterations that rebuilt the
+								///< neighbor list; see
+								///< b2ParticleSystemDef::neighborListSkin
+	int32 memoryUsage;			///< bytes held by the system's buffers; see
+								///< b2ParticleSystem::ComputeMemoryUsage()
+};
+
 struct b2ParticleSystemDef
 {
 	b2ParticleSystemDef()
@@ -178,6 +240,14 @@ struct b2ParticleSystemDef
 		colorMixingStrength = 0.5f;
 		destroyByAge = true;
 		lifetimeGranularity = 1.0f / 60.0f;
+		neighborListSkin = 0.0f;
+		allowSleep = false;
+		sleepVelocity = 0.25f;
+		sleepTime = b2_timeToSleep;
+		staticDistanceFields = false;
+		spatialReorderInterval = 0;
+		zombieCompactionFraction = 0.0f;
+		shrinkBuffers = false;
 	}
 
 	/// Enable strict Particle/Body contact check.
@@ -275,6 +345,74 @@ struct b2ParticleSystemDef
 	/// With the value set to 1/60 the maximum lifetime or age of a particle is
 	/// 2.27 years.
 	float32 lifetimeGranularity;
+
+	/// When greater than zero, particle pairs closer than the particle
+	/// diameter plus this distance are kept in a neighbor list, and contacts
+	/// are found by re-checking that list instead of searching the proxies.
+	/// The list is rebuilt once any particle has moved more than half this
+	/// distance since the last rebuild, or when particles are added. Larger
+	/// values rebuild less often but re-check more pairs each iteration.
+	/// Around a quarter of the particle diameter suits most fluids.
+	float32 neighborListSkin;
+
+	/// Let regions of particles that have settled fall asleep. The world is
+	/// split into square regions several particle diameters across; once
+	/// every particle in a region has stayed slower than sleepVelocity for
+	/// sleepTime seconds, its particles stop moving and the contacts between
+	/// them are no longer solved. A region wakes when a particle in it speeds
+	/// up, is pushed by a force that would speed it up or touches a moving
+	/// body, or when a particle moves in from outside. Destroying a fixture
+	/// wakes the particles touching it and all the particles connected to
+	/// them. Only used while the particles are water, wall, zombie or color
+	/// mixing particles, optionally with the listener and filter flags, and
+	/// no group is rigid or solid. Moving a sleeping particle by setting its
+	/// position does not wake it; give it a velocity instead.
+	bool allowSleep;
+
+	/// Speed below which a particle counts as settled, in m/s.
+	float32 sleepVelocity;
+
+	/// Time in seconds a region has to stay settled before it falls asleep.
+	float32 sleepTime;
+
+	/// Sample the distance and normal of each polygon, edge and chain
+	/// fixture on a static body onto a grid the first time particles come
+	/// near it, and find particle-body contacts from the grid. Samples are
+	/// one particle diameter apart and only used where the four around a
+	/// particle share a normal, so the distance field is linear there and
+	/// the result matches b2Fixture::ComputeDistance(); near vertices the
+	/// fixture is asked directly. A field is re-sampled when its body
+	/// moves and dropped when its fixture is destroyed. Changing a shape
+	/// after its fixture is created is not detected.
+	bool staticDistanceFields;
+
+	/// Every this many steps, reorder the particles of each group, and each
+	/// run of particles outside any group, along a Z-order (Morton) curve
+	/// over their positions. Particles that are close in space then sit
+	/// close together in the particle buffers, which keeps the contact
+	/// solve in cache for large systems. Groups keep their index ranges and
+	/// particle handles follow their particles, but any other particle index
+	/// kept between steps becomes stale. 0 never reorders.
+	int32 spatialReorderInterval;
+
+	/// Fraction of the particles that may be destroyed (zombie) particles
+	/// before a step compacts the particle buffers to remove them, so a few
+	/// particles destroyed every step don't cost a full compaction each.
+	/// Until then zombies hold still, make no contacts and are still counted
+	/// by GetParticleCount(), so check b2_zombieParticle when reading the
+	/// buffers. Zombies with b2_destructionListenerParticle, spring, elastic
+	/// and barrier particles, and rigid or solid groups are always removed
+	/// on the next step. 0 removes zombies every step.
+	float32 zombieCompactionFraction;
+
+	/// Give memory back as the particle and contact counts fall. At the end
+	/// of each step, a buffer less than a quarter full is shrunk to twice
+	/// its contents, so it has to double again before it grows back. The
+	/// particle buffers keep room for b2_minParticleSystemBufferCapacity
+	/// particles, or what b2ParticleSystem::Reserve() asked for. Pointers
+	/// returned by the Get*Buffer() functions may then change in
+	/// b2World::Step() as well as when particles are created.
+	bool shrinkBuffers;
 };
 
 
@@ -290,6 +428,19 @@ public:
 	/// @return the index of the particle.
 	int32 CreateParticle(const b2ParticleDef& def);
 
+	/// Create the particles of a batch definition in one pass. The buffers
+	/// are grown at most once and every new particle joins def.group, so this
+	/// is much faster than calling CreateParticle() for each particle. To
+	/// fill a new group, create it first with CreateParticleGroup() and a
+	/// b2ParticleGroupDef without shapes or positions.
+	/// No reference to the definition is retained.
+	/// If the system is full, as many particles as fit are created, after
+	/// destroying the oldest ones if SetDestructionByAge() is enabled.
+	/// @warning This function is locked during callbacks.
+	/// @return the index of the first new particle, the others follow it;
+	/// b2_invalidParticleIndex if no particle was created.
+	int32 CreateParticles(const b2ParticleBatchDef& def);
+
 	/// Retrieve a handle to the particle at the specified index.
 	/// Please see #b2ParticleHandle for why you might want a handle.
 	const b2ParticleHandle* GetParticleHandleFromIndex(const int32 index);
@@ -373,12 +524,53 @@ public:
 	/// Get the number of particle groups.
 	int32 GetParticleGroupCount() const;
 
+	/// Create a particle emitter whose properties have been defined. No
+	/// reference to the definition is retained. Emitters add particles at
+	/// the start of each b2World::Step().
+	/// @warning This function is locked during callbacks.
+	b2ParticleEmitter* CreateParticleEmitter(const b2ParticleEmitterDef& def);
+
+	/// Destroy a particle emitter. The particles it emitted are kept.
+	/// @warning This function is locked during callbacks.
+	void DestroyParticleEmitter(b2ParticleEmitter* emitter);
+
+	/// Get the particle emitter list. With the returned emitter, use
+	/// b2ParticleEmitter::GetNext to get the next emitter in the list.
+	/// A NULL emitter indicates the end of the list.
+	b2ParticleEmitter* GetParticleEmitterList();
+	const b2ParticleEmitter* GetParticleEmitterList() const;
+
+	/// Get the number of particle emitters.
+	int32 GetParticleEmitterCount() const;
+
 	/// Get the number of particles.
 	int32 GetParticleCount() const;
 
+	/// Get a counter that changes whenever particles move to other indices
+	/// or an index is given to a new particle: when zombies are removed,
+	/// groups are rearranged, particles are reordered spatially or an
+	/// emitter recycles a particle. Data kept per index from before, such
+	/// as positions to interpolate from, no longer lines up when it has
+	/// changed. Particles created at the end leave it alone.
+	uint32 GetParticleIndexGeneration() const;
+
 	/// Get the maximum number of particles.
 	int32 GetMaxParticleCount() const;
 
+	/// Make room for capacity particles, so that creating them doesn't
+	/// reallocate the particle buffers, and keep it when
+	/// b2ParticleSystemDef::shrinkBuffers is set. The capacity is limited by
+	/// the maximum particle count and any user-supplied buffers.
+	/// @warning This function is locked during callbacks.
+	void Reserve(int32 capacity);
+
+	/// Shrink the particle buffers to fit the particles, and the contact and
+	/// other internal buffers to fit what they hold, dropping any capacity
+	/// asked for with Reserve(). Pointers returned by the Get*Buffer()
+	/// functions are invalidated.
+	/// @warning This function is locked during callbacks.
+	void Compact();
+
 	/// Set the maximum number of particles.
 	/// A value of 0 means there is no maximum. The particle buffers can
 	/// continue to grow while b2World's block allocator still has memory.
@@ -405,6 +597,22 @@ public:
 	/// Initially, true, then, the last value passed into SetPaused().
 	bool GetPaused() const;
 
+	/// Run the heaviest particle solver loops on the given job system.
+	/// Particle-particle contacts are colored so that no two contacts in the
+	/// same batch touch the same particle, which keeps results independent of
+	/// how the scheduler splits the work. Coloring changes the order of the
+	/// contacts returned by GetContacts().
+	/// @param scheduler is the job system to use, or NULL to run the solver
+	/// on the calling thread. It must outlive this particle system or be
+	/// reset to NULL.
+	void SetTaskScheduler(b2TaskScheduler* scheduler);
+
+	/// @return the job system passed to SetTaskScheduler(), or NULL.
+	b2TaskScheduler* GetTaskScheduler() const;
+
+	/// Get the stage timings and counters from the last b2World::Step().
+	const b2ParticleProfile& GetProfile() const;
+
 	/// Change the particle density.
 	/// Particle density affects the mass of the particles, which in turn
 	/// affects how the particles interact with b2Bodies. Note that the density
@@ -576,6 +784,13 @@ public:
 	/// Compute the kinetic energy that can be lost by damping force
 	float32 ComputeCollisionEnergy() const;
 
+	/// Compute the bytes held by the particle buffers and by the contact,
+	/// pair, triad and other internal buffers. User-supplied buffers,
+	/// particle groups, emitters, handles and static distance fields are
+	/// not counted. Divide by GetParticleCount() for the memory per
+	/// particle.
+	int32 ComputeMemoryUsage() const;
+
 	/// Set strict Particle/Body contact check.
 	/// This is an option that will help ensure correct behavior if there are
 	/// corners in the world model where Particle/Body contact is ambiguous.
@@ -621,7 +836,8 @@ public:
 	/// The oldest particle indexes are at the end of the array with the
 	/// newest at the start.  Particles with infinite lifetimes
 	/// (i.e expiration times less than or equal to 0) are placed at the start
-	///  of the array.
+	///  of the array.  The array is only sorted when it is requested, so
+	/// this costs a sort after lifetimes have changed.
 	/// ExpirationTimeToLifetime(GetExpirationTimeBuffer()[index])
 	/// is equivalent to GetParticleLifetime(index).
 	/// GetParticleCount() items are in the returned array.
@@ -661,6 +877,17 @@ public:
 	/// @param force the world force vector, usually in Newtons (N).
 	void ApplyForce(int32 firstIndex, int32 lastIndex, const b2Vec2& force);
 
+	/// Apply a separate force to the center of each of a set of particles.
+	/// Equivalent to calling ParticleApplyForce(indices[i], forces[i]) for
+	/// each i, but the force buffer is prepared once for the whole batch.
+	/// Wall particles are skipped.
+	/// @param indices the particles that will be modified.
+	/// @param forces the world force vector for each particle, usually in
+	///        Newtons (N).
+	/// @param count the number of entries in indices and forces.
+	void ParticleApplyForces(const int32* indices, const b2Vec2* forces,
+							 int32 count);
+
 	/// Get the next particle-system in the world's particle-system list.
 	b2ParticleSystem* GetNext();
 	const b2ParticleSystem* GetNext() const;
@@ -740,6 +967,7 @@ private:
 
 private:
 	friend class b2World;
+	friend class b2Body;
 	friend class b2ParticleGroup;
 	friend class b2ParticleBodyContactRemovePredicate;
 	friend class b2FixtureParticleQueryCallback;
@@ -779,6 +1007,48 @@ private:
 		}
 	};
 
+	/// Candidate contact kept in the neighbor list.
+	struct NeighborPair
+	{
+		int32 indexA, indexB;
+	};
+
+	/// Velocity change of one body from the particle-body contacts of a
+	/// solver stage, applied by ApplyBodyImpulses().
+	struct BodyImpulse
+	{
+		b2Body* body;
+		b2Vec2 linearVelocity;
+		float32 angularVelocity;
+		/// The body is awake, or an impulse of this stage woke it.
+		bool awake;
+	};
+
+	/// One grid point of a StaticField.
+	struct StaticFieldSample
+	{
+		b2Vec2 normal;
+		float32 distance;
+	};
+
+	/// Distances and normals sampled around one child of a fixture on a
+	/// static body. See b2ParticleSystemDef::staticDistanceFields.
+	struct StaticField
+	{
+		const b2Fixture* fixture;
+		int32 childIndex;
+		/// Body transform the samples were taken with.
+		b2Transform transform;
+		/// World position of the first sample.
+		b2Vec2 origin;
+		float32 inverseSpacing;
+		int32 width, height;
+		/// width * height samples, row by row. NULL when the fixture is not
+		/// sampled, either because of its shape or because the grid would
+		/// be too large.
+		StaticFieldSample* samples;
+	};
+
 	/// Class for filtering pairs or triads.
 	class ConnectionFilter
 	{
@@ -830,6 +1100,19 @@ private:
 		const Proxy* m_last;
 	};
 
+	/// A particle due to expire at a quantized time, linked into the slot of
+	/// m_expirationWheel for that time.
+	struct ExpirationEntry
+	{
+		/// Particle index, b2_invalidParticleIndex once destroyed.
+		int32 index;
+		/// Expiration time the entry was queued with. The entry is stale
+		/// if the particle's expiration time has changed since.
+		int32 expirationTime;
+		/// Next entry in the same slot or the free list, -1 at the end.
+		int32 next;
+	};
+
 	/// Node of linked lists of connected particles
 	struct ParticleListNode
 	{
@@ -855,9 +1138,56 @@ private:
 	static const int32 k_noPressureFlags =
 		b2_powderParticle |
 		b2_tensileParticle;
+	/// Particle types that can fall asleep: they only take part in the
+	/// contact solve through pressure and damping, which leave sleeping
+	/// particles out. See b2ParticleSystemDef::allowSleep.
+	static const int32 k_sleepingParticleFlags =
+		b2_wallParticle |
+		b2_zombieParticle |
+		b2_colorMixingParticle |
+		b2_fixtureContactListenerParticle |
+		b2_particleContactListenerParticle |
+		b2_fixtureContactFilterParticle |
+		b2_particleContactFilterParticle |
+		b2_destructionListenerParticle;
 	/// All particle types that apply extra damping force with bodies
 	static const int32 k_extraDampingFlags =
 		b2_staticPressureParticle;
+	/// Number of contact colors tracked per particle. Contacts that do not
+	/// fit into any color are solved serially after the colored batches.
+	static const int32 k_maxContactColors = 32;
+	/// Smallest number of particles or contacts handed to a single task.
+	static const int32 k_parallelGrainSize = 256;
+	/// SortProxies() radix sorts all proxies instead of re-sorting the
+	/// previous order when more than 1 / k_maxResortProxiesFraction of the
+	/// proxies are out of order.
+	static const int32 k_maxResortProxiesFraction = 8;
+	/// Smallest width of a sleep region, in particle diameters.
+	static const int32 k_sleepRegionDiameters = 8;
+	/// Fixtures whose StaticField would need more samples than this are
+	/// not sampled.
+	static const int32 k_maxStaticFieldSamples = 1 << 16;
+	/// Number of slots in m_expirationWheel, a power of two. Entries due
+	/// further ahead than this many lifetimeGranularity units stay queued
+	/// through the slot's earlier visits.
+	static const int32 k_expirationWheelSize = 256;
+
+	/// Values of m_sleepStateBuffer.
+	enum
+	{
+		e_particleAwake = 0,
+		/// Asleep in a region next to a region with awake particles, so
+		/// awake particles may reach it during the step.
+		e_particleAsleepBorder,
+		/// Asleep in a region surrounded by sleeping or empty regions.
+		e_particleAsleepInterior
+	};
+
+	/// Runs a member function over ranges of a solver loop on behalf of the
+	/// b2TaskScheduler.
+	class RangeTask;
+	typedef void (b2ParticleSystem::*RangeFunction)(
+		const b2TimeStep& step, int32 begin, int32 end);
 
 	b2ParticleSystem(const b2ParticleSystemDef* def, b2World* world);
 	~b2ParticleSystem();
@@ -880,21 +1210,27 @@ private:
 	void ReallocateHandleBuffers(int32 newCapacity);
 
 	void ReallocateInternalAllocatedBuffers(int32 capacity);
+	void ResizeInternalAllocatedBuffers(int32 capacity);
+	/// Shrink the buffers that are less than a quarter full, or all of them
+	/// to fit when compact is set.
+	void ShrinkBuffers(bool compact);
+	int32 ReserveParticles(int32 count);
+	int32 InitializeParticles(const b2ParticleBatchDef& def, int32 count);
 	int32 CreateParticleForGroup(
 		const b2ParticleGroupDef& groupDef,
 		const b2Transform& xf, const b2Vec2& position);
+	void CreateParticlesForGroup(
+		const b2ParticleGroupDef& groupDef, const b2Transform& xf,
+		const b2Vec2* positions, int32 count);
 	void CreateParticlesStrokeShapeForGroup(
 		const b2Shape* shape,
 		const b2ParticleGroupDef& groupDef, const b2Transform& xf);
 	void CreateParticlesFillShapeForGroup(
-		const b2Shape* shape,
+		const b2Shape* const* shapes, int32 shapeCount,
 		const b2ParticleGroupDef& groupDef, const b2Transform& xf);
 	void CreateParticlesWithShapeForGroup(
 		const b2Shape* shape,
 		const b2ParticleGroupDef& groupDef, const b2Transform& xf);
-	void CreateParticlesWithShapesForGroup(
-		const b2Shape* const* shapes, int32 shapeCount,
-		const b2ParticleGroupDef& groupDef, const b2Transform& xf);
 	int32 CloneParticle(int32 index, b2ParticleGroup* group);
 	void DestroyParticleGroup(b2ParticleGroup* group);
 
@@ -934,19 +1270,29 @@ private:
 	void AddContact(int32 a, int32 b,
 		b2GrowableBuffer<b2ParticleContact>& contacts) const;
 	void FindContacts_Reference(
+		const b2GrowableBuffer<Proxy>& proxies,
 		b2GrowableBuffer<b2ParticleContact>& contacts) const;
-	void ReorderForFindContact(FindContactInput* reordered,
+	void ReorderForFindContact(const b2GrowableBuffer<Proxy>& proxies,
+		                       FindContactInput* reordered,
 		                       int alignedCount) const;
 	void GatherChecksOneParticle(
+		const b2GrowableBuffer<Proxy>& proxies,
 		const uint32 bound,
 		const int startIndex,
 		const int particleIndex,
 		int* nextUncheckedIndex,
 		b2GrowableBuffer<FindContactCheck>& checks) const;
-	void GatherChecks(b2GrowableBuffer<FindContactCheck>& checks) const;
+	void GatherChecks(const b2GrowableBuffer<Proxy>& proxies,
+		b2GrowableBuffer<FindContactCheck>& checks) const;
 	void FindContacts_Simd(
+		const b2GrowableBuffer<Proxy>& proxies,
 		b2GrowableBuffer<b2ParticleContact>& contacts) const;
 	void FindContacts(
+		const b2GrowableBuffer<Proxy>& proxies,
+		b2GrowableBuffer<b2ParticleContact>& contacts) const;
+	bool NeighborListNeedsRebuild() const;
+	void RebuildNeighborList();
+	void FindContactsFromNeighborList(
 		b2GrowableBuffer<b2ParticleContact>& contacts) const;
 	static void UpdateProxyTags(
 		const uint32* const tags,
@@ -966,20 +1312,49 @@ private:
 		b2ParticlePairSet* particlePairs) const;
 	void NotifyContactListenerPostContact(b2ParticlePairSet& particlePairs);
 	void UpdateContacts(bool exceptZombie);
+	bool CanSleep() const;
+	void UpdateSleep(const b2TimeStep& step);
+	bool IsParticleAsleep(int32 index) const;
+	void RemoveSleepingContacts(b2GrowableBuffer<b2ParticleContact>& contacts);
+	void RestoreSleepingContacts();
+	void SolveSleep();
 	void NotifyBodyContactListenerPreContact(
 		FixtureParticleSet* fixtureSet) const;
 	void NotifyBodyContactListenerPostContact(FixtureParticleSet& fixtureSet);
 	void UpdateBodyContacts();
+	const StaticField* GetStaticField(const b2Fixture* fixture,
+									  int32 childIndex);
+	void SampleStaticField(StaticField* field);
+	void ComputeStaticFieldDistance(const StaticField& field,
+									const b2Vec2& p, float32* distance,
+									b2Vec2* normal) const;
+	void DestroyStaticFields(const b2Fixture* fixture);
+	void DestroyBodyContacts(const b2Fixture* fixture);
+	void UpdateBodyImpulses();
+	void AddBodyImpulse(int32 bodyContact, const b2Vec2& impulse,
+						const b2Vec2& point, bool wake);
+	b2Vec2 GetBodyContactVelocity(int32 bodyContact,
+								  const b2Vec2& point) const;
+	void ApplyBodyImpulses();
+	void ReorderParticlesSpatially();
 
 	void Solve(const b2TimeStep& step);
+	void ParallelForParticles(RangeFunction function, const b2TimeStep& step);
+	void ParallelForContacts(RangeFunction function, const b2TimeStep& step);
+	void ColorContacts();
 	void SolveCollision(const b2TimeStep& step);
 	void LimitVelocity(const b2TimeStep& step);
 	void SolveGravity(const b2TimeStep& step);
 	void SolveBarrier(const b2TimeStep& step);
 	void SolveStaticPressure(const b2TimeStep& step);
-	void ComputeWeight();
+	void ComputeWeight(const b2TimeStep& step);
+	void ComputeContactWeights(const b2TimeStep& step, int32 begin, int32 end);
 	void SolvePressure(const b2TimeStep& step);
+	void ComputePressures(const b2TimeStep& step, int32 begin, int32 end);
+	void SolveContactPressures(
+		const b2TimeStep& step, int32 begin, int32 end);
 	void SolveDamping(const b2TimeStep& step);
+	void SolveContactDamping(const b2TimeStep& step, int32 begin, int32 end);
 	void SolveRigidDamping();
 	void SolveExtraDamping();
 	void SolveWall();
@@ -987,16 +1362,32 @@ private:
 	void SolveElastic(const b2TimeStep& step);
 	void SolveSpring(const b2TimeStep& step);
 	void SolveTensile(const b2TimeStep& step);
-	void SolveViscous();
+	void AccumulateTensileNormals(
+		const b2TimeStep& step, int32 begin, int32 end);
+	void SolveContactTensions(const b2TimeStep& step, int32 begin, int32 end);
+	void SolveViscous(const b2TimeStep& step);
+	void SolveContactViscosity(
+		const b2TimeStep& step, int32 begin, int32 end);
+	void IntegratePositions(const b2TimeStep& step, int32 begin, int32 end);
 	void SolveRepulsive(const b2TimeStep& step);
 	void SolvePowder(const b2TimeStep& step);
 	void SolveSolid(const b2TimeStep& step);
 	void SolveForce(const b2TimeStep& step);
 	void SolveColorMixing();
 	void SolveZombie();
+	bool NeedsZombieCompaction() const;
+	/// Add the particles of every emitter for this step.
+	void EmitParticles(const b2TimeStep& step);
+	/// Reset the particle at index to a fresh particle of the emitter, as
+	/// though it had been destroyed and created again.
+	void RecycleParticle(int32 index, const b2ParticleEmitter& emitter,
+						 const b2Vec2& position, const b2Vec2& velocity);
+	void UpdateProfileCounts();
 	/// Destroy all particles which have outlived their lifetimes set by
 	/// SetParticleLifetime().
 	void SolveLifetimes(const b2TimeStep& step);
+	void QueueExpiration(int32 index, int32 expirationTime);
+	void SortIndexByExpirationTime();
 	void RotateBuffer(int32 start, int32 mid, int32 end);
 
 	float32 GetCriticalVelocity(const b2TimeStep& step) const;
@@ -1080,6 +1471,8 @@ private:
 
 	int32 m_count;
 	int32 m_internalAllocatedCapacity;
+	/// Capacity asked for with Reserve(), which ShrinkBuffers() keeps.
+	int32 m_reservedCapacity;
 	/// Allocator for b2ParticleHandle instances.
 	b2SlabAllocator<b2ParticleHandle> m_handleAllocator;
 	/// Maps particle indicies to  handles.
@@ -1109,6 +1502,12 @@ private:
 	/// used in SolveSolid(). It will be reallocated on subsequent
 	/// CreateParticle() calls.
 	float32* m_depthBuffer;
+	/// When b2ParticleSystemDef::allowSleep is set, m_sleepTimeBuffer holds
+	/// how long each particle's region has been settled and
+	/// m_sleepStateBuffer whether the particle sleeps this step. Both are
+	/// allocated and filled in UpdateSleep().
+	float32* m_sleepTimeBuffer;
+	uint8* m_sleepStateBuffer;
 	UserOverridableBuffer<b2ParticleColor> m_colorBuffer;
 	b2ParticleGroup** m_groupBuffer;
 	UserOverridableBuffer<void*> m_userDataBuffer;
@@ -1134,15 +1533,70 @@ private:
 	/// Time elapsed in 32:32 fixed point.  Each non-fractional unit of time
 	/// corresponds to b2ParticleSystemDef::lifetimeGranularity seconds.
 	int64 m_timeElapsed;
-	/// Whether the expiration time buffer has been modified and needs to be
-	/// resorted.
+	/// Whether the expiration time buffer has been modified and
+	/// m_indexByExpirationTimeBuffer needs to be resorted before use.
 	bool m_expirationTimeBufferRequiresSorting;
+	/// Timing wheel of particles with finite lifetimes. Slot t &
+	/// (k_expirationWheelSize - 1) heads a list of m_expirationEntryBuffer
+	/// entries, so queueing a lifetime is O(1) and SolveLifetimes() only
+	/// visits the slots of the time that passed.
+	int32 m_expirationWheel[k_expirationWheelSize];
+	b2GrowableBuffer<ExpirationEntry> m_expirationEntryBuffer;
+	/// Head of the list of unused m_expirationEntryBuffer entries.
+	int32 m_freeExpirationEntry;
+	/// Quantized time up to which the wheel has been expired.
+	int32 m_expiredTime;
+	/// m_timestamp when DestroyOldestParticle() last sorted
+	/// m_indexByExpirationTimeBuffer.
+	int32 m_expirationSortTimestamp;
 
 	int32 m_groupCount;
 	b2ParticleGroup* m_groupList;
 
+	int32 m_emitterCount;
+	b2ParticleEmitter* m_emitterList;
+
 	b2ParticleSystemDef m_def;
 
+	/// Optional job system used by Solve().
+	b2TaskScheduler* m_taskScheduler;
+	/// m_contactBuffer[m_contactColorOffsets[c]] to
+	/// m_contactBuffer[m_contactColorOffsets[c + 1]] share no particles.
+	/// The last range holds the contacts that could not be colored.
+	/// Populated in ColorContacts() when m_taskScheduler is set.
+	int32 m_contactColorOffsets[k_maxContactColors + 2];
+	int32 m_contactColorCount;
+	/// Pairs within m_particleDiameter + m_def.neighborListSkin of each
+	/// other, and the particle positions, at the last RebuildNeighborList().
+	/// Cleared whenever particle indices are permuted.
+	b2GrowableBuffer<NeighborPair> m_neighborPairBuffer;
+	b2GrowableBuffer<b2Vec2> m_neighborPositionBuffer;
+	bool m_neighborListValid;
+	/// Particles asleep in the current step; zero outside Solve().
+	int32 m_sleepingCount;
+	/// Contacts between two sleeping particles, moved out of
+	/// m_contactBuffer by UpdateSleep() for the rest of the step.
+	b2GrowableBuffer<b2ParticleContact> m_sleepingContactBuffer;
+	/// Particles ordered by sleep region, kept between steps.
+	b2GrowableBuffer<Proxy> m_sleepRegionBuffer;
+	/// Proxies of the particles that take part in the contact search while
+	/// some particles sleep.
+	b2GrowableBuffer<Proxy> m_awakeProxyBuffer;
+	/// One entry per body in m_bodyContactBuffer, and the entry of each body
+	/// contact. Rebuilt by UpdateBodyContacts().
+	b2GrowableBuffer<BodyImpulse> m_bodyImpulseBuffer;
+	b2GrowableBuffer<int32> m_bodyContactImpulseBuffer;
+	/// Steps solved since the last ReorderParticlesSpatially().
+	int32 m_stepsSinceSpatialReorder;
+	/// See GetParticleIndexGeneration().
+	uint32 m_indexGeneration;
+	/// Particles flagged b2_zombieParticle since the last SolveZombie().
+	int32 m_zombieCount;
+	/// Sampled static fixtures, ordered by fixture and child index.
+	b2GrowableBuffer<StaticField> m_staticFieldBuffer;
+
+	b2ParticleProfile m_profile;
+
 	b2World* m_world;
 	b2ParticleSystem* m_prev;
 	b2ParticleSystem* m_next;
@@ -1155,6 +1609,19 @@ inline void b2ParticleContact::SetIndices(int32 a, int32 b)
 	indexB = (b2ParticleIndex)b;
 }
 
+#ifdef B2_USE_COMPACT_PARTICLES
+inline void b2ParticleContact::SetNormal(const b2Vec2& n)
+{
+	// Round to nearest without branching on the sign: offset the value so
+	// that it is positive, truncate, then take the offset back off. The
+	// clamp keeps a degenerate normal in range.
+	normalX = (int16)((int32)(b2Clamp(n.x, -1.0f, 1.0f) * 0x7FFF +
+							  0x8000 + 0.5f) - 0x8000);
+	normalY = (int16)((int32)(b2Clamp(n.y, -1.0f, 1.0f) * 0x7FFF +
+							  0x8000 + 0.5f) - 0x8000);
+}
+#endif
+
 
 inline bool b2ParticleContact::operator==(
 	const b2ParticleContact& rhs) const
@@ -1163,7 +1630,7 @@ inline bool b2ParticleContact::operator==(
 		&& indexB == rhs.indexB
 		&& flags == rhs.flags
 		&& weight == rhs.weight
-		&& normal == rhs.normal;
+		&& GetNormal() == rhs.GetNormal();
 }
 
 // The reciprocal sqrt function differs between SIMD and non-SIMD, but they
@@ -1177,7 +1644,7 @@ inline bool b2ParticleContact::ApproximatelyEqual(
 		&& indexB == rhs.indexB
 		&& flags == rhs.flags
 		&& b2Abs(weight - rhs.weight) < MAX_WEIGHT_DIFF
-		&& (normal - rhs.normal).Length() < MAX_NORMAL_DIFF;
+		&& (GetNormal() - rhs.GetNormal()).Length() < MAX_NORMAL_DIFF;
 }
 
 inline b2ParticleGroup* b2ParticleSystem::GetParticleGroupList()
@@ -1195,16 +1662,58 @@ inline int32 b2ParticleSystem::GetParticleGroupCount() const
 	return m_groupCount;
 }
 
+inline b2ParticleEmitter* b2ParticleSystem::GetParticleEmitterList()
+{
+	return m_emitterList;
+}
+
+inline const b2ParticleEmitter* b2ParticleSystem::GetParticleEmitterList()
+	const
+{
+	return m_emitterList;
+}
+
+inline int32 b2ParticleSystem::GetParticleEmitterCount() const
+{
+	return m_emitterCount;
+}
+
 inline int32 b2ParticleSystem::GetParticleCount() const
 {
 	return m_count;
 }
 
+inline uint32 b2ParticleSystem::GetParticleIndexGeneration() const
+{
+	return m_indexGeneration;
+}
+
 inline void b2ParticleSystem::SetPaused(bool paused)
 {
 	m_paused = paused;
 }
 
+inline void b2ParticleSystem::SetTaskScheduler(b2TaskScheduler* scheduler)
+{
+	m_taskScheduler = scheduler;
+}
+
+inline b2TaskScheduler* b2ParticleSystem::GetTaskScheduler() const
+{
+	return m_taskScheduler;
+}
+
+inline bool b2ParticleSystem::IsParticleAsleep(int32 index) const
+{
+	return m_sleepingCount > 0 &&
+		m_sleepStateBuffer[index] != e_particleAwake;
+}
+
+inline const b2ParticleProfile& b2ParticleSystem::GetProfile() const
+{
+	return m_profile;
+}
+
 inline bool b2ParticleSystem::GetPaused() const
 {
 	return m_paused;
@@ -1285,6 +1794,7 @@ inline void b2ParticleSystem::SetRadius(float32 radius)
 	m_particleDiameter = 2 * radius;
 	m_squaredDiameter = m_particleDiameter * m_particleDiameter;
 	m_inverseDiameter = 1 / m_particleDiameter;
+	m_neighborListValid = false;
 }
 
 inline void b2ParticleSystem::SetDensity(float32 density)
@@ -0,0 +1,156 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#ifndef B2_TAG_SORT_H
+#define B2_TAG_SORT_H
+
+#include <Box2D/Common/b2Settings.h>
+#include <Box2D/Common/b2Math.h>
+#include <algorithm>
+#include <string.h>
+
+// Sorts for arrays of items with a uint32 'tag' member and an operator< that
+// compares tags, such as the particle system's proxies.
+
+/// Below this many items, std::sort beats b2RadixSortByTag().
+#define b2_minRadixSortCount 256
+
+/// Sort 'items' by tag with a least-significant-digit radix sort, using
+/// 'temp' (of the same size) as scratch space. Digits that are the same for
+/// every item, usually the high bits of a particle's row, are skipped.
+template <typename T>
+void b2RadixSortByTag(T* items, T* temp, int32 count)
+{
+	static const uint32 k_radixBits = 11;
+	static const uint32 k_radixSize = 1u << k_radixBits;
+	static const uint32 k_radixMask = k_radixSize - 1;
+	static const int32 k_radixPasses = 3; // ceil(32 / k_radixBits)
+
+	if (count == 0)
+	{
+		return;
+	}
+	int32 histograms[k_radixPasses][k_radixSize];
+	memset(histograms, 0, sizeof(histograms));
+	for (int32 i = 0; i < count; i++)
+	{
+		const uint32 tag = items[i].tag;
+		histograms[0][tag & k_radixMask]++;
+		histograms[1][(tag >> k_radixBits) & k_radixMask]++;
+		histograms[2][tag >> (2 * k_radixBits)]++;
+	}
+
+	T* source = items;
+	T* destination = temp;
+	for (int32 pass = 0; pass < k_radixPasses; pass++)
+	{
+		const uint32 shift = pass * k_radixBits;
+		int32* const offsets = histograms[pass];
+		if (offsets[(source[0].tag >> shift) & k_radixMask] == count)
+		{
+			continue;
+		}
+		int32 offset = 0;
+		for (uint32 digit = 0; digit < k_radixSize; digit++)
+		{
+			const int32 digitCount = offsets[digit];
+			offsets[digit] = offset;
+			offset += digitCount;
+		}
+		for (int32 i = 0; i < count; i++)
+		{
+			const T& item = source[i];
+			destination[offsets[(item.tag >> shift) & k_radixMask]++] = item;
+		}
+		b2Swap(source, destination);
+	}
+	if (source != items)
+	{
+		memcpy(items, source, sizeof(T) * count);
+	}
+}
+
+/// Sort 'items', which are expected to be nearly sorted, using 'temp' (of
+/// the same size) as scratch space. Items that are out of order with their
+/// neighbors are moved to 'temp', sorted and merged back into the remaining,
+/// sorted items. Returns false, leaving 'items' in an arbitrary order, if
+/// more than 'maxMoved' of them are out of order. 'maxMoved' must be at most
+/// half of 'count'.
+template <typename T>
+bool b2ResortByTag(T* items, T* temp, int32 count, int32 maxMoved)
+{
+	b2Assert(2 * maxMoved <= count);
+	int32 kept = 0;
+	int32 moved = 0;
+	uint32 lastTag = 0;
+	for (int32 i = 0; i < count; i++)
+	{
+		const T& item = items[i];
+		// Keep the item if it fits after the previous kept item and isn't
+		// ahead of its successor; the kept items stay sorted.
+		if (item.tag >= lastTag &&
+			(i + 1 == count || item.tag <= items[i + 1].tag))
+		{
+			lastTag = item.tag;
+			items[kept++] = item;
+		}
+		else
+		{
+			if (moved == maxMoved)
+			{
+				// Put the moved items back so no item gets lost.
+				memcpy(items + kept, temp, sizeof(T) * moved);
+				return false;
+			}
+			temp[moved++] = item;
+		}
+	}
+	if (moved == 0)
+	{
+		return true;
+	}
+
+	// 'maxMoved' is at most half of 'count', so the rest of 'temp' is big
+	// enough for radix sorting the moved items.
+	if (moved < b2_minRadixSortCount)
+	{
+		std::sort(temp, temp + moved);
+	}
+	else
+	{
+		b2RadixSortByTag(temp, temp + moved, moved);
+	}
+
+	// Merge from the back, so the kept items are never overwritten before
+	// they are read.
+	int32 a = kept - 1;
+	int32 b = moved - 1;
+	for (int32 out = count - 1; b >= 0; out--)
+	{
+		if (a >= 0 && temp[b].tag < items[a].tag)
+		{
+			items[out] = items[a--];
+		}
+		else
+		{
+			items[out] = temp[b--];
+		}
+	}
+	return true;
+}
+
+#endif
@@ -2,12 +2,29 @@
 layout (location = 0) in vec2 aPos;
 layout (location = 1) in vec2 a_TexCoord;
 
+// Per-instance data for batched bodies, only read when u_Instanced is set
+layout (location = 2) in vec4 a_Instance;      // xy = position, z = angle, w = half-size
+layout (location = 3) in vec3 a_InstanceColor;
+
 out vec2 v_TexCoord;
+out vec3 v_Color;
 
 uniform mat4 u_Model;
 uniform mat4 u_Projection;
+uniform vec3 u_Color;
+uniform bool u_Instanced;
 
 void main() {
-    gl_Position = u_Projection * u_Model * vec4(aPos, 0.0, 1.0);
+    if (u_Instanced) {
+        float c = cos(a_Instance.z);
+        float s = sin(a_Instance.z);
+        vec2 local = aPos * a_Instance.w;
+        vec2 world = vec2(c * local.x - s * local.y, s * local.x + c * local.y) + a_Instance.xy;
+        gl_Position = u_Projection * vec4(world, 0.0, 1.0);
+        v_Color = a_InstanceColor;
+    } else {
+        gl_Position = u_Projection * u_Model * vec4(aPos, 0.0, 1.0);
+        v_Color = u_Color;
+    }
     v_TexCoord = a_TexCoord;
 }
@@ -0,0 +1,668 @@
+// Headless physics benchmark. Builds b2World scenes that mirror the
+// interactive modes in Realtime (shape piles, water, the solar system and
+// brush strokes), steps them without a window and prints the timings as JSON
+// so runs can be compared between commits:
+//
+//   physics_benchmark [--scenario pile|dambreak|fill|solar|brush|fountain|all] [--scale N]
+//                     [--steps N] [--warmup N] [--seed N] [--threads N]
+//                     [--neighbor-skin F] [--sleep 0|1] [--sleep-velocity F]
+//                     [--static-fields 0|1] [--reorder N] [--zombie-fraction F]
+//                     [--shrink 0|1] [--check-sleep 1]
+//
+// Everything is seeded, so the same arguments always build the same scenes.
+//
+// --check-sleep 1 runs a correctness check instead of the timings: it lets
+// the water in a tank fall asleep, destroys the tank's floor and exits with
+// 1 unless all of the water wakes and falls out.
+
+#include <Box2D/Box2D.h>
+
+#include "utils/forcefield.h"
+#include "utils/threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// Same world layout as Realtime::initializeGL: 10 units wide, 4:3 view
+const float WORLD_WIDTH = 10.0f;
+const float WORLD_HEIGHT = 7.5f;
+const float TIME_STEP = 1.0f / 60.0f;
+const int VELOCITY_ITERATIONS = 6;
+const int POSITION_ITERATIONS = 2;
+
+struct Options {
+    std::string scenario = "all";
+    int scale = 1;
+    int steps = 600;
+    int warmup = 60;
+    unsigned seed = 1;
+    int threads = 0;
+    float neighborSkin = 0.0f;  // b2ParticleSystemDef::neighborListSkin
+    bool sleep = false;         // b2ParticleSystemDef::allowSleep
+    float sleepVelocity = b2ParticleSystemDef().sleepVelocity; // b2ParticleSystemDef::sleepVelocity
+    bool staticFields = false;  // b2ParticleSystemDef::staticDistanceFields
+    int reorder = 0;            // b2ParticleSystemDef::spatialReorderInterval
+    float zombieFraction = 0.0f; // b2ParticleSystemDef::zombieCompactionFraction
+    bool shrink = false;        // b2ParticleSystemDef::shrinkBuffers
+    bool checkSleep = false;
+};
+
+// Box2D heap accounting. Every block gets a small header holding its size so
+// frees can be subtracted; the header keeps the block max-aligned.
+struct AllocStats {
+    int64_t current = 0;
+    int64_t peak = 0;
+};
+AllocStats allocStats;
+const size_t ALLOC_HEADER = alignof(std::max_align_t) > sizeof(int64_t)
+    ? alignof(std::max_align_t) : sizeof(int64_t);
+
+void *trackedAlloc(int32 size, void *) {
+    char *block = static_cast<char *>(std::malloc(ALLOC_HEADER + size));
+    *reinterpret_cast<int64_t *>(block) = size;
+    allocStats.current += size;
+    allocStats.peak = std::max(allocStats.peak, allocStats.current);
+    return block + ALLOC_HEADER;
+}
+
+void trackedFree(void *mem, void *) {
+    char *block = static_cast<char *>(mem) - ALLOC_HEADER;
+    allocStats.current -= *reinterpret_cast<int64_t *>(block);
+    std::free(block);
+}
+
+// Peak resident set size of the whole process so far, in KiB
+long peakRssKiB() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+    }
+    return 0;
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// A scene plus whatever per-step forces its interactive mode applies
+struct Scene {
+    std::unique_ptr<b2World> world;
+    b2ParticleSystem *particleSystem = nullptr;
+    std::function<void()> beforeStep;
+};
+
+b2Body *createGround(b2World &world) {
+    b2BodyDef groundDef;
+    groundDef.position.Set(0.0f, -WORLD_HEIGHT / 2.0f - 1.0f);
+    b2Body *ground = world.CreateBody(&groundDef);
+
+    b2PolygonShape groundBox;
+    groundBox.SetAsBox(WORLD_WIDTH, 1.0f);
+    ground->CreateFixture(&groundBox, 0.0f);
+    return ground;
+}
+
+// Same radius and damping as the particle system Realtime creates, with the
+// library defaults for everything else. Realtime also turns on allowSleep,
+// staticDistanceFields and shrinkBuffers (--sleep, --static-fields and
+// --shrink here) and caps the system at 5000 particles, which the benchmark
+// doesn't so the larger scales aren't cut off
+b2ParticleSystem *createParticleSystem(b2World &world, const Options &options) {
+    b2ParticleSystemDef particleSystemDef;
+    particleSystemDef.radius = 0.05f;
+    particleSystemDef.dampingStrength = 0.2f;
+    particleSystemDef.neighborListSkin = options.neighborSkin;
+    particleSystemDef.allowSleep = options.sleep;
+    particleSystemDef.sleepVelocity = options.sleepVelocity;
+    particleSystemDef.staticDistanceFields = options.staticFields;
+    particleSystemDef.spatialReorderInterval = options.reorder;
+    particleSystemDef.zombieCompactionFraction = options.zombieFraction;
+    particleSystemDef.shrinkBuffers = options.shrink;
+    return world.CreateParticleSystem(&particleSystemDef);
+}
+
+// Same as Realtime::createPhysicsObject
+b2Body *createShape(b2World &world, float x, float y, bool circle, float halfSize) {
+    b2BodyDef bodyDef;
+    bodyDef.type = b2_dynamicBody;
+    bodyDef.position.Set(x, y);
+    b2Body *body = world.CreateBody(&bodyDef);
+
+    b2PolygonShape box;
+    b2CircleShape disc;
+    b2FixtureDef fixtureDef;
+    if (circle) {
+        disc.m_radius = halfSize;
+        fixtureDef.shape = &disc;
+    } else {
+        box.SetAsBox(halfSize, halfSize);
+        fixtureDef.shape = &box;
+    }
+    fixtureDef.density = 1.0f;
+    fixtureDef.friction = 0.3f;
+    body->CreateFixture(&fixtureDef);
+    return body;
+}
+
+// Same as a water click in Realtime::mousePressEvent
+void createWaterBlock(b2ParticleSystem *particleSystem, float x, float y) {
+    b2PolygonShape particleBox;
+    particleBox.SetAsBox(0.5f, 0.5f, b2Vec2(x, y), 0);
+
+    b2ParticleGroupDef groupDef;
+    groupDef.shape = &particleBox;
+    groupDef.flags = b2_waterParticle;
+    groupDef.color.Set(0, 0, 155, 255);
+    particleSystem->CreateParticleGroup(groupDef);
+}
+
+// Boxes and circles of mixed sizes dropped in a column over the ground
+Scene buildPile(const Options &options, std::mt19937 &rng) {
+    Scene scene;
+    scene.world.reset(new b2World(b2Vec2(0.0f, -9.8f)));
+    scene.particleSystem = createParticleSystem(*scene.world, options);
+    createGround(*scene.world);
+
+    std::uniform_real_distribution<float> x(-WORLD_WIDTH / 2.5f, WORLD_WIDTH / 2.5f);
+    std::uniform_real_distribution<float> size(0.1f, 0.4f);
+    const int count = 200 * options.scale;
+    for (int i = 0; i < count; i++) {
+        // Stack the spawn points so nothing starts overlapping too badly
+        const float y = -WORLD_HEIGHT / 2.0f + 0.5f + 0.25f * i;
+        createShape(*scene.world, x(rng), y, i % 2 == 1, size(rng));
+    }
+    return scene;
+}
+
+// Water blocks released together over the ground, plus a few boxes
+Scene buildDamBreak(const Options &options, std::mt19937 &rng) {
+    Scene scene;
+    scene.world.reset(new b2World(b2Vec2(0.0f, -9.8f)));
+    scene.particleSystem = createParticleSystem(*scene.world, options);
+    createGround(*scene.world);
+
+    const int blocks = 8 * options.scale;
+    const int columns = 4;
+    for (int i = 0; i < blocks; i++) {
+        createWaterBlock(scene.particleSystem,
+                         -WORLD_WIDTH / 2.0f + 0.6f + (i % columns) * 1.05f,
+                         -WORLD_HEIGHT / 2.0f + 0.6f + (i / columns) * 1.05f);
+    }
+
+    std::uniform_real_distribution<float> x(0.0f, WORLD_WIDTH / 2.5f);
+    for (int i = 0; i < 5 * options.scale; i++) {
+        createShape(*scene.world, x(rng), 0.5f * i, false, 0.2f);
+    }
+    return scene;
+}
+
+// One large dam-break group filled from a list of shapes: a tall box, a
+// circle rounding its top corner and a thin tilted slab. Most of the cost of
+// building this scene is the shape fill, which build_ms reports
+Scene buildFill(const Options &options, std::mt19937 &) {
+    Scene scene;
+    scene.world.reset(new b2World(b2Vec2(0.0f, -9.8f)));
+    scene.particleSystem = createParticleSystem(*scene.world, options);
+    createGround(*scene.world);
+
+    const float halfWidth = WORLD_WIDTH / 5.0f;
+    const float halfHeight = 0.75f * options.scale;
+    const b2Vec2 center(-WORLD_WIDTH / 2.0f + halfWidth, -WORLD_HEIGHT / 2.0f + halfHeight);
+    b2PolygonShape column;
+    column.SetAsBox(halfWidth, halfHeight, center, 0.0f);
+    b2CircleShape corner;
+    corner.m_p = center + b2Vec2(halfWidth, halfHeight);
+    corner.m_radius = halfWidth / 2.0f;
+    b2PolygonShape slab;
+    slab.SetAsBox(WORLD_WIDTH / 4.0f, 0.1f, center + b2Vec2(halfWidth, 0.0f), 0.3f);
+    const b2Shape *shapes[] = {&column, &corner, &slab};
+
+    b2ParticleGroupDef groupDef;
+    groupDef.shapes = shapes;
+    groupDef.shapeCount = 3;
+    groupDef.flags = b2_waterParticle;
+    groupDef.color.Set(0, 0, 155, 255);
+    scene.particleSystem->CreateParticleGroup(groupDef);
+    return scene;
+}
+
+// The orbit mode from Realtime::initializeSolarSystem: a static sun and
+// rings of planets held in orbit by the same ORBIT force field as
+// Realtime::stepPhysics
+Scene buildSolar(const Options &options, std::mt19937 &rng) {
+    Scene scene;
+    scene.world.reset(new b2World(b2Vec2(0.0f, 0.0f)));
+    scene.particleSystem = createParticleSystem(*scene.world, options);
+
+    {
+        b2BodyDef sunDef;
+        sunDef.type = b2_staticBody;
+        b2Body *sun = scene.world->CreateBody(&sunDef);
+
+        b2CircleShape sunShape;
+        sunShape.m_radius = 0.25f;
+        b2FixtureDef fixtureDef;
+        fixtureDef.shape = &sunShape;
+        fixtureDef.density = 0.0f;
+        fixtureDef.friction = 0.0f;
+        sun->CreateFixture(&fixtureDef);
+    }
+
+    const float angularSpeeds[7] = {0.4345f, 0.1700f, 0.1047f, 0.0557f, 0.00883f, 0.00355f, 0.001247f};
+    // Like Realtime, planets store their index in planetSpeeds, plus one,
+    // as user data
+    auto planetSpeeds = std::make_shared<std::vector<float>>();
+    std::uniform_real_distribution<float> phase(0.0f, 2.0f * b2_pi);
+    for (int i = 0; i < 7; i++) {
+        const float radius = 1.5f + i * 0.5f;
+        // More planets per ring as the scale goes up, spread around it
+        for (int j = 0; j < 4 * options.scale; j++) {
+            const float angle = phase(rng);
+            b2Body *body = createShape(*scene.world, radius * std::cos(angle), radius * std::sin(angle), true, 0.1f);
+            planetSpeeds->push_back(angularSpeeds[i]);
+            body->SetUserData(reinterpret_cast<void*>(planetSpeeds->size()));
+        }
+    }
+
+    auto forceFields = std::make_shared<ForceFieldSolver>();
+    forceFields->orbitAngularSpeed = [planetSpeeds](const b2Body *body) {
+        const size_t index = reinterpret_cast<size_t>(body->GetUserData());
+        return index > 0 && index <= planetSpeeds->size() ? (*planetSpeeds)[index - 1] : 0.0f;
+    };
+
+    ForceField orbit;
+    orbit.type = ForceField::Type::ORBIT;
+    orbit.orbitSpeedScale = 0.8f;
+    b2World *world = scene.world.get();
+    b2ParticleSystem *particleSystem = scene.particleSystem;
+    scene.beforeStep = [forceFields, orbit, world, particleSystem] {
+        forceFields->apply(*world, particleSystem, orbit);
+    };
+    return scene;
+}
+
+// Random-walk brush strokes built the way Realtime::mouseMoveEvent builds
+// them (one static body per stroke, an edge per segment), with water and
+// shapes falling onto them
+Scene buildBrush(const Options &options, std::mt19937 &rng) {
+    Scene scene;
+    scene.world.reset(new b2World(b2Vec2(0.0f, -9.8f)));
+    scene.particleSystem = createParticleSystem(*scene.world, options);
+    createGround(*scene.world);
+
+    const float brushThickness = 0.1f;
+    std::uniform_real_distribution<float> x(-WORLD_WIDTH / 2.5f, WORLD_WIDTH / 2.5f);
+    std::uniform_real_distribution<float> y(-WORLD_HEIGHT / 2.0f, 0.0f);
+    std::uniform_real_distribution<float> turn(-0.5f, 0.5f);
+    const int strokes = 8 * options.scale;
+    for (int i = 0; i < strokes; i++) {
+        b2BodyDef bodyDef;
+        bodyDef.type = b2_staticBody;
+        b2Body *brush = scene.world->CreateBody(&bodyDef);
+
+        b2Vec2 point(x(rng), y(rng));
+        float heading = turn(rng) * b2_pi;
+        for (int segment = 0; segment < 20; segment++) {
+            heading += turn(rng);
+            const b2Vec2 next = point + brushThickness * b2Vec2(std::cos(heading), std::sin(heading));
+
+            b2EdgeShape edge;
+            edge.Set(point, next);
+            b2FixtureDef fixtureDef;
+            fixtureDef.shape = &edge;
+            fixtureDef.density = 0.0f;
+            fixtureDef.friction = 0.3f;
+            brush->CreateFixture(&fixtureDef);
+            point = next;
+        }
+    }
+
+    for (int i = 0; i < options.scale; i++) {
+        createWaterBlock(scene.particleSystem, x(rng), 2.0f + 1.05f * i);
+    }
+    for (int i = 0; i < 20 * options.scale; i++) {
+        createShape(*scene.world, x(rng), 1.0f + 0.25f * i, i % 2 == 0, 0.15f);
+    }
+    return scene;
+}
+
+// The fountain toggled with F in Realtime::keyPressEvent, run long enough
+// that it recycles its oldest drops
+Scene buildFountain(const Options &options, std::mt19937 &) {
+    Scene scene;
+    scene.world.reset(new b2World(b2Vec2(0.0f, -9.8f)));
+    scene.particleSystem = createParticleSystem(*scene.world, options);
+    createGround(*scene.world);
+
+    b2CircleShape nozzle;
+    nozzle.m_radius = 0.2f;
+    b2ParticleEmitterDef emitterDef;
+    emitterDef.shape = &nozzle;
+    emitterDef.position.Set(0.0f, -WORLD_HEIGHT / 2.0f + 0.5f);
+    emitterDef.velocity.Set(0.0f, 8.0f);
+    emitterDef.emitRate = 300.0f * options.scale;
+    emitterDef.capacity = 1000 * options.scale;
+    emitterDef.flags = b2_waterParticle;
+    emitterDef.color.Set(0, 0, 155, 255);
+    scene.particleSystem->CreateParticleEmitter(emitterDef);
+    return scene;
+}
+
+struct ScenarioInfo {
+    const char *name;
+    Scene (*build)(const Options &, std::mt19937 &);
+};
+const ScenarioInfo scenarios[] = {
+    {"pile", buildPile},
+    {"dambreak", buildDamBreak},
+    {"fill", buildFill},
+    {"solar", buildSolar},
+    {"brush", buildBrush},
+    {"fountain", buildFountain},
+};
+
+void runScenario(const ScenarioInfo &info, const Options &options, ThreadPool *pool, bool first) {
+    allocStats.peak = allocStats.current;
+    std::mt19937 rng(options.seed);
+    b2Timer build;
+    Scene scene = info.build(options, rng);
+    const float buildMs = build.GetMilliseconds();
+    if (pool) {
+        scene.particleSystem->SetTaskScheduler(pool);
+    }
+
+    auto step = [&] {
+        if (scene.beforeStep) {
+            scene.beforeStep();
+        }
+        scene.world->Step(TIME_STEP, VELOCITY_ITERATIONS, POSITION_ITERATIONS);
+    };
+    for (int i = 0; i < options.warmup; i++) {
+        step();
+    }
+
+    std::vector<float> times;
+    times.reserve(options.steps);
+    b2Stat stats;
+    b2Stat particleStats;
+    int rebuilds = 0;
+    b2Timer total;
+    for (int i = 0; i < options.steps; i++) {
+        b2Timer timer;
+        step();
+        times.push_back(timer.GetMilliseconds());
+        stats.Record(times.back());
+        particleStats.Record(scene.particleSystem->GetProfile().solve);
+        rebuilds += scene.particleSystem->GetProfile().neighborListRebuilds;
+    }
+    const float totalMs = total.GetMilliseconds();
+
+    std::sort(times.begin(), times.end());
+    const float median = times.empty() ? 0.0f : times[times.size() / 2];
+    const float p95 = times.empty() ? 0.0f : times[std::min(times.size() - 1, times.size() * 95 / 100)];
+
+    std::printf("%s    {\n", first ? "" : ",\n");
+    std::printf("      \"name\": \"%s\",\n", info.name);
+    std::printf("      \"bodies\": %d,\n", scene.world->GetBodyCount());
+    std::printf("      \"particles\": %d,\n", scene.particleSystem->GetParticleCount());
+    std::printf("      \"body_contacts\": %d,\n", scene.world->GetContactCount());
+    std::printf("      \"particle_contacts\": %d,\n", scene.particleSystem->GetContactCount());
+    std::printf("      \"build_ms\": %.3f,\n", buildMs);
+    std::printf("      \"total_ms\": %.3f,\n", totalMs);
+    std::printf("      \"ms_per_step\": {\"mean\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"min\": %.4f, \"max\": %.4f},\n",
+                stats.GetMean(), median, p95, stats.GetMin(), stats.GetMax());
+    std::printf("      \"particle_ms_per_step\": %.4f,\n", particleStats.GetMean());
+    std::printf("      \"neighbor_list_rebuilds_per_step\": %.3f,\n", float(rebuilds) / options.steps);
+    std::printf("      \"sleeping_particles\": %d,\n", scene.particleSystem->GetProfile().sleepingCount);
+    std::printf("      \"steps_per_second\": %.2f,\n", totalMs > 0.0f ? options.steps * 1000.0f / totalMs : 0.0f);
+    const int particles = scene.particleSystem->GetParticleCount();
+    const int particleBytes = scene.particleSystem->ComputeMemoryUsage();
+    std::printf("      \"particle_system_bytes\": %d,\n", particleBytes);
+    std::printf("      \"bytes_per_particle\": %.1f,\n", particles > 0 ? float(particleBytes) / particles : 0.0f);
+    std::printf("      \"peak_box2d_bytes\": %lld,\n", static_cast<long long>(allocStats.peak));
+    std::printf("      \"peak_rss_kib\": %ld\n", peakRssKiB());
+    std::printf("    }");
+}
+
+// Top of the tank's floor in buildTank
+const float TANK_FLOOR = -WORLD_HEIGHT / 2.0f;
+
+// A dam break in a closed tank for --check-sleep: water blocks against the
+// left wall of a static U-shaped container, so the water settles instead of
+// spreading off the ground. Larger scales widen the tank rather than deepen
+// the water, which keeps the water at most two blocks deep so it settles.
+// The floor is a body of its own so --check-sleep can destroy it
+Scene buildTank(const Options &options, std::mt19937 &) {
+    Scene scene;
+    scene.world.reset(new b2World(b2Vec2(0.0f, -9.8f)));
+    scene.particleSystem = createParticleSystem(*scene.world, options);
+
+    const int blocks = 2 * options.scale;
+    const int columns = std::max(4, options.scale);
+    b2BodyDef tankDef;
+    b2Body *floor = scene.world->CreateBody(&tankDef);
+    b2Body *tank = scene.world->CreateBody(&tankDef);
+    const float halfWidth = 0.5f * (columns + 1);
+    b2PolygonShape wall;
+    wall.SetAsBox(halfWidth + 0.2f, 0.1f, b2Vec2(0.0f, TANK_FLOOR - 0.1f), 0.0f);
+    floor->CreateFixture(&wall, 0.0f);
+    wall.SetAsBox(0.1f, WORLD_HEIGHT / 2.0f, b2Vec2(-halfWidth - 0.1f, 0.0f), 0.0f);
+    tank->CreateFixture(&wall, 0.0f);
+    wall.SetAsBox(0.1f, WORLD_HEIGHT / 2.0f, b2Vec2(halfWidth + 0.1f, 0.0f), 0.0f);
+    tank->CreateFixture(&wall, 0.0f);
+
+    for (int i = 0; i < blocks; i++) {
+        createWaterBlock(scene.particleSystem,
+                         -halfWidth + 0.5f + (i % columns) * 1.0f,
+                         TANK_FLOOR + 0.5f + (i / columns) * 1.0f);
+    }
+    return scene;
+}
+
+// --check-sleep raises sleepVelocity to this so the water in the tank falls
+// asleep within the warmup and steps instead of jittering at the walls, and
+// then lets the water fall for SLEEP_CHECK_FALL_SECONDS after destroying the
+// floor
+const float SLEEP_CHECK_VELOCITY = 1.0f;
+const float SLEEP_CHECK_FALL_SECONDS = 2.0f;
+
+// The tank's floor body, found by the point just under the water
+b2Body *findTankFloor(b2World &world) {
+    const b2Vec2 point(0.0f, TANK_FLOOR - 0.05f);
+    for (b2Body *body = world.GetBodyList(); body; body = body->GetNext()) {
+        for (b2Fixture *fixture = body->GetFixtureList(); fixture; fixture = fixture->GetNext()) {
+            if (fixture->TestPoint(point)) {
+                return body;
+            }
+        }
+    }
+    return nullptr;
+}
+
+// Settles the tank scene with allowSleep on, destroys the floor under the
+// sleeping water and steps on. The particle system drops its contacts with
+// the floor and wakes the water that rested on it, so within
+// SLEEP_CHECK_FALL_SECONDS no particle may be asleep or left above the
+// floor. Returns false otherwise, or if no water fell asleep to begin with.
+bool checkSleepAfterFloorDestroyed(const Options &options, ThreadPool *pool) {
+    std::mt19937 rng(options.seed);
+    Scene scene = buildTank(options, rng);
+    if (pool) {
+        scene.particleSystem->SetTaskScheduler(pool);
+    }
+    auto step = [&scene] {
+        scene.world->Step(TIME_STEP, VELOCITY_ITERATIONS, POSITION_ITERATIONS);
+    };
+    for (int i = 0; i < options.warmup + options.steps; i++) {
+        step();
+    }
+    const int sleepingBefore = scene.particleSystem->GetProfile().sleepingCount;
+
+    b2Body *floor = findTankFloor(*scene.world);
+    if (floor) {
+        scene.world->DestroyBody(floor);
+    }
+    const int fallSteps = static_cast<int>(SLEEP_CHECK_FALL_SECONDS / TIME_STEP);
+    for (int i = 0; i < fallSteps; i++) {
+        step();
+    }
+    const int sleepingAfter = scene.particleSystem->GetProfile().sleepingCount;
+
+    const int count = scene.particleSystem->GetParticleCount();
+    const b2Vec2 *positions = scene.particleSystem->GetPositionBuffer();
+    float highest = -b2_maxFloat;
+    for (int i = 0; i < count; i++) {
+        highest = std::max(highest, positions[i].y);
+    }
+    const bool passed = floor && sleepingBefore > 0 && sleepingAfter == 0 &&
+        highest < TANK_FLOOR;
+
+    std::printf("  \"check\": \"sleep_floor_destroyed\",\n");
+    std::printf("  \"scenario\": \"tank\",\n");
+    std::printf("  \"particles\": %d,\n", count);
+    std::printf("  \"sleeping_before\": %d,\n", sleepingBefore);
+    std::printf("  \"sleeping_after\": %d,\n", sleepingAfter);
+    std::printf("  \"highest_after\": %.4f,\n", highest);
+    std::printf("  \"floor\": %.4f,\n", TANK_FLOOR);
+    std::printf("  \"passed\": %s\n", passed ? "true" : "false");
+    return passed;
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return false;
+        }
+        const char *value = argv[++i];
+        if (arg == "--scenario") {
+            options.scenario = value;
+        } else if (arg == "--scale") {
+            options.scale = std::max(1, std::atoi(value));
+        } else if (arg == "--steps") {
+            options.steps = std::max(1, std::atoi(value));
+        } else if (arg == "--warmup") {
+            options.warmup = std::max(0, std::atoi(value));
+        } else if (arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else if (arg == "--threads") {
+            options.threads = std::max(0, std::atoi(value));
+        } else if (arg == "--sleep") {
+            options.sleep = std::atoi(value) != 0;
+        } else if (arg == "--sleep-velocity") {
+            options.sleepVelocity = std::max(0.0f, static_cast<float>(std::atof(value)));
+        } else if (arg == "--static-fields") {
+            options.staticFields = std::atoi(value) != 0;
+        } else if (arg == "--reorder") {
+            options.reorder = std::max(0, std::atoi(value));
+        } else if (arg == "--zombie-fraction") {
+            options.zombieFraction = std::max(0.0f, static_cast<float>(std::atof(value)));
+        } else if (arg == "--shrink") {
+            options.shrink = std::atoi(value) != 0;
+        } else if (arg == "--check-sleep") {
+            options.checkSleep = std::atoi(value) != 0;
+        } else if (arg == "--neighbor-skin") {
+            options.neighborSkin = std::max(0.0f, static_cast<float>(std::atof(value)));
+        } else {
+            std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "usage: %s [--scenario pile|dambreak|fill|solar|brush|fountain|all] [--scale N] "
+                             "[--steps N] [--warmup N] [--seed N] [--threads N] "
+                             "[--neighbor-skin F] [--sleep 0|1] [--sleep-velocity F] "
+                             "[--static-fields 0|1] [--reorder N] [--zombie-fraction F] "
+                             "[--shrink 0|1] [--check-sleep 1]\n", argv[0]);
+        return 1;
+    }
+
+    bool known = options.scenario == "all";
+    for (const ScenarioInfo &info : scenarios) {
+        known = known || options.scenario == info.name;
+    }
+    if (!known) {
+        std::fprintf(stderr, "Unknown scenario %s\n", options.scenario.c_str());
+        return 1;
+    }
+
+    b2SetAllocFreeCallbacks(trackedAlloc, trackedFree, nullptr);
+
+    // Extra worker threads for the particle solver, like the GUI's pool
+    std::unique_ptr<ThreadPool> pool;
+    if (options.threads > 0) {
+        pool.reset(new ThreadPool(options.threads));
+    }
+
+    if (options.checkSleep) {
+        options.sleep = true;
+        options.sleepVelocity = std::max(options.sleepVelocity, SLEEP_CHECK_VELOCITY);
+    }
+
+    std::printf("{\n");
+    std::printf("  \"liquidfun_version\": \"%d.%d.%d\",\n", b2_liquidFunVersion.major,
+                b2_liquidFunVersion.minor, b2_liquidFunVersion.revision);
+    std::printf("  \"seed\": %u,\n  \"scale\": %d,\n  \"steps\": %d,\n  \"warmup\": %d,\n  \"threads\": %d,\n",
+                options.seed, options.scale, options.steps, options.warmup, options.threads);
+#ifdef B2_USE_COMPACT_PARTICLES
+    std::printf("  \"compact_particles\": true,\n");
+#else
+    std::printf("  \"compact_particles\": false,\n");
+#endif
+    std::printf("  \"contact_size\": %d,\n", static_cast<int>(sizeof(b2ParticleContact)));
+    std::printf("  \"neighbor_list_skin\": %.4f,\n", options.neighborSkin);
+    std::printf("  \"sleep\": %s,\n", options.sleep ? "true" : "false");
+    std::printf("  \"sleep_velocity\": %.4f,\n", options.sleepVelocity);
+    std::printf("  \"static_fields\": %s,\n", options.staticFields ? "true" : "false");
+    std::printf("  \"reorder_interval\": %d,\n", options.reorder);
+    std::printf("  \"zombie_compaction_fraction\": %.4f,\n", options.zombieFraction);
+    std::printf("  \"shrink_buffers\": %s,\n", options.shrink ? "true" : "false");
+    if (options.checkSleep) {
+        const bool passed = checkSleepAfterFloorDestroyed(options, pool.get());
+        std::printf("}\n");
+        return passed ? 0 : 1;
+    }
+    std::printf("  \"scenarios\": [\n");
+    bool first = true;
+    for (const ScenarioInfo &info : scenarios) {
+        if (options.scenario == "all" || options.scenario == info.name) {
+            runScenario(info, options, pool.get(), first);
+            first = false;
+        }
+    }
+    std::printf("\n  ]\n}\n");
+    return 0;
+}
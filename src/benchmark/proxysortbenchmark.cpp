@@ -0,0 +1,201 @@
+// Micro-benchmark for the particle proxy sorts in Box2D/Particle/b2TagSort.h.
+// Lays particles out on a jittered grid, tags them the way
+// b2ParticleSystem::UpdateProxies does and times std::sort, the radix sort
+// and the incremental re-sort (with its radix fallback, as SortProxies runs
+// it) for 1k to 64k particles. Prints the best time of each as JSON:
+//
+//   proxy_sort_benchmark [--reps N] [--seed N]
+//
+// Three cases per size:
+//   shuffled   proxies in no particular order, as after particles are created
+//   settling   sorted by the previous tags, then every particle moved up to
+//              0.005 diameters, about what water at rest moves per particle
+//              iteration
+//   splashing  the same with moves of up to 0.05 diameters (about 1 m/s for
+//              0.1 m particles)
+//
+// Exits with 1 if any sort disagrees with std::sort.
+
+#include <Box2D/Box2D.h>
+#include <Box2D/Particle/b2TagSort.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Same layout as b2ParticleSystem::Proxy
+struct Proxy {
+    int32 index;
+    uint32 tag;
+    friend bool operator<(const Proxy &a, const Proxy &b) {
+        return a.tag < b.tag;
+    }
+};
+
+// Same tag as computeTag() in b2ParticleSystem.cpp, for a position in
+// particle diameters: 12 bits of row, then 20 bits of fixed point column
+uint32 computeTag(float x, float y) {
+    const uint32 yTruncBits = 12;
+    const uint32 xTruncBits = 12;
+    const uint32 yShift = 32 - yTruncBits;
+    const uint32 xShift = 32 - yTruncBits - xTruncBits;
+    const uint32 xScale = 1u << xShift;
+    const uint32 yOffset = 1u << (yTruncBits - 1u);
+    const uint32 xOffset = xScale * (1u << (xTruncBits - 1u));
+    return (static_cast<uint32>(y + yOffset) << yShift) + static_cast<uint32>(xScale * x + xOffset);
+}
+
+struct Options {
+    int reps = 50;
+    unsigned seed = 1;
+};
+
+struct Case {
+    const char *name;
+    float move; // largest move since the previous sort, in diameters
+    bool shuffled;
+};
+const Case cases[] = {
+    {"shuffled", 0.0f, true},
+    {"settling", 0.005f, false},
+    {"splashing", 0.05f, false},
+};
+
+// Proxies for 'count' particles of a square block of water, spaced like
+// particle group fills (b2_particleStride diameters apart) and jittered so
+// the rows of particles don't line up with the rows of tags
+std::vector<Proxy> buildProxies(int count, const Case &info, std::mt19937 &rng) {
+    const int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+    std::uniform_real_distribution<float> jitter(-0.2f, 0.2f);
+    std::vector<b2Vec2> positions(count);
+    for (int i = 0; i < count; i++) {
+        positions[i].Set(b2_particleStride * (i % side) + jitter(rng),
+                         b2_particleStride * (i / side) + jitter(rng));
+    }
+
+    std::vector<Proxy> proxies(count);
+    for (int i = 0; i < count; i++) {
+        proxies[i].index = i;
+        proxies[i].tag = computeTag(positions[i].x, positions[i].y);
+    }
+    if (info.shuffled) {
+        std::shuffle(proxies.begin(), proxies.end(), rng);
+        return proxies;
+    }
+
+    // Sorted by the previous tags, retagged after everything moved
+    std::sort(proxies.begin(), proxies.end());
+    std::uniform_real_distribution<float> move(-info.move, info.move);
+    for (Proxy &proxy : proxies) {
+        const b2Vec2 &p = positions[proxy.index];
+        proxy.tag = computeTag(p.x + move(rng), p.y + move(rng));
+    }
+    return proxies;
+}
+
+bool sameTags(const std::vector<Proxy> &a, const std::vector<Proxy> &b) {
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].tag != b[i].tag) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Best time in microseconds of 'reps' runs of 'sort', each on a fresh copy
+// of 'input'; 'output' gets the last result
+template <typename Sort>
+float timeSort(const std::vector<Proxy> &input, std::vector<Proxy> &output, int reps, Sort sort) {
+    float best = 0.0f;
+    output.resize(input.size());
+    for (int rep = 0; rep < reps; rep++) {
+        std::copy(input.begin(), input.end(), output.begin());
+        b2Timer timer;
+        sort(output.data(), static_cast<int32>(output.size()));
+        const float us = timer.GetMilliseconds() * 1000.0f;
+        best = rep == 0 ? us : std::min(best, us);
+    }
+    return best;
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return false;
+        }
+        const char *value = argv[++i];
+        if (arg == "--reps") {
+            options.reps = std::max(1, std::atoi(value));
+        } else if (arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else {
+            std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "usage: %s [--reps N] [--seed N]\n", argv[0]);
+        return 1;
+    }
+
+    // b2ParticleSystem::SortProxies falls back to the radix sort when more
+    // than 1 / 8 of the proxies moved out of order
+    const int maxResortFraction = 8;
+    std::vector<Proxy> temp;
+    std::vector<Proxy> expected;
+    std::vector<Proxy> output;
+    bool correct = true;
+
+    std::printf("{\n");
+    std::printf("  \"seed\": %u,\n  \"reps\": %d,\n", options.seed, options.reps);
+    std::printf("  \"results\": [\n");
+    bool first = true;
+    for (int count = 1024; count <= 65536; count *= 2) {
+        temp.resize(count);
+        for (const Case &info : cases) {
+            std::mt19937 rng(options.seed);
+            const std::vector<Proxy> input = buildProxies(count, info, rng);
+
+            const float stdSortUs = timeSort(input, expected, options.reps, [](Proxy *proxies, int32 n) {
+                std::sort(proxies, proxies + n);
+            });
+            const float radixUs = timeSort(input, output, options.reps, [&](Proxy *proxies, int32 n) {
+                b2RadixSortByTag(proxies, temp.data(), n);
+            });
+            correct = correct && sameTags(output, expected);
+            bool resorted = true;
+            const float resortUs = timeSort(input, output, options.reps, [&](Proxy *proxies, int32 n) {
+                resorted = b2ResortByTag(proxies, temp.data(), n, n / maxResortFraction);
+                if (!resorted) {
+                    b2RadixSortByTag(proxies, temp.data(), n);
+                }
+            });
+            correct = correct && sameTags(output, expected);
+
+            std::printf("%s    {\"particles\": %d, \"case\": \"%s\", \"std_sort_us\": %.1f, "
+                        "\"radix_us\": %.1f, \"resort_us\": %.1f, \"resorted\": %s}",
+                        first ? "" : ",\n", count, info.name, stdSortUs, radixUs, resortUs,
+                        resorted ? "true" : "false");
+            first = false;
+        }
+    }
+    std::printf("\n  ],\n  \"correct\": %s\n}\n", correct ? "true" : "false");
+    return correct ? 0 : 1;
+}
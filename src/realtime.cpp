@@ -5,11 +5,44 @@
 #include <QCoreApplication>
 #include <QMouseEvent>
 #include <QKeyEvent>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include "settings.h"
 #include <glm/gtx/string_cast.hpp>
 #include <Box2D/Box2D.h>
 
+// Rows of the profiler overlay after the world step and particle solve, in
+// the order they're stored in Realtime::ProfileStats
+static const struct {
+    const char *name;
+    float32 b2ParticleProfile::*time;
+} particleProfileStages[] = {
+    {"emit",            &b2ParticleProfile::emit},
+    {"lifetimes",       &b2ParticleProfile::lifetimes},
+    {"zombie",          &b2ParticleProfile::zombie},
+    {"update flags",    &b2ParticleProfile::updateFlags},
+    {"reorder",         &b2ParticleProfile::reorder},
+    {"sleep",           &b2ParticleProfile::sleep},
+    {"contacts",        &b2ParticleProfile::updateContacts},
+    {"body contacts",   &b2ParticleProfile::updateBodyContacts},
+    {"weight",          &b2ParticleProfile::computeWeight},
+    {"depth",           &b2ParticleProfile::computeDepth},
+    {"reactive",        &b2ParticleProfile::reactive},
+    {"forces",          &b2ParticleProfile::forces},
+    {"pressure",        &b2ParticleProfile::pressure},
+    {"damping",         &b2ParticleProfile::damping},
+    {"elastic",         &b2ParticleProfile::elastic},
+    {"limit velocity",  &b2ParticleProfile::limitVelocity},
+    {"barrier",         &b2ParticleProfile::barrier},
+    {"collision",       &b2ParticleProfile::collision},
+    {"rigid",           &b2ParticleProfile::rigid},
+    {"integrate",       &b2ParticleProfile::integrate},
+};
+
 // ================== Project 5: Lights, Camera
 QString texturePaths[7] = {
     ":/resources/planetText/venus.png",
@@ -40,11 +73,18 @@ Realtime::Realtime(QWidget *parent)
     m_elapsedTimer.start();
 
     // If you must use this function, do not edit anything above this
+
+    m_profileLabel = new QLabel(this);
+    m_profileLabel->setStyleSheet("QLabel { color: white; background: rgba(0, 0, 0, 160);"
+                                  " font-family: monospace; padding: 4px; }");
+    m_profileLabel->move(8, 8);
+    m_profileLabel->hide();
 }
 
 void Realtime::finish() {
-    // Stop the timer
+    // Stop the timer and the simulation
     killTimer(m_timer);
+    m_simulation.stop();
     makeCurrent();
 
     // Delete OpenGL resources
@@ -58,6 +98,13 @@ void Realtime::finish() {
         }
     }
 
+    // Delete the shared body meshes
+    glDeleteVertexArrays(1, &m_boxMeshVAO);
+    glDeleteBuffers(1, &m_boxMeshVBO);
+    glDeleteVertexArrays(1, &m_circleMeshVAO);
+    glDeleteBuffers(1, &m_circleMeshVBO);
+    glDeleteBuffers(1, &m_instanceVBO);
+
     // Delete shader programs
     glDeleteProgram(m_shaderProgram);
     glDeleteProgram(m_textureShader);
@@ -103,6 +150,7 @@ void Realtime::initializeGL() {
         ":/resources/shaders/2D.vert",
         ":/resources/shaders/2D.frag"
         );
+    initializeObjectMeshes();
 
     // Create Box2D world with gravity
     b2Vec2 gravity(0.0f, -9.8f);
@@ -123,10 +171,32 @@ void Realtime::initializeGL() {
         b2ParticleSystemDef particleSystemDef;
         particleSystemDef.radius = 0.05f; // Adjust for desired density
         particleSystemDef.dampingStrength = 0.2f;
+        // Water left alone settles, so let it stop costing anything
+        particleSystemDef.allowSleep = true;
+        // The ground and brush strokes never move, so sample them once
+        particleSystemDef.staticDistanceFields = true;
+        // Give memory back after the scene is cleared or the fountain drains
+        particleSystemDef.shrinkBuffers = true;
         m_particleSystem = m_world->CreateParticleSystem(&particleSystemDef);
         m_particleSystem->SetGravityScale(1.0f);
         m_particleSystem->SetMaxParticleCount(5000); // Limit particle count
+        // Only worth it with spare cores; coloring the contacts costs a bit
+        if (m_threadPool.threadCount() > 0) {
+            m_particleSystem->SetTaskScheduler(&m_threadPool);
+        }
     }
+    m_explosionStrength = settings.shapeParameter1;
+    m_orbitSpeedScale = 0.8 + settings.shapeParameter2/5;
+
+    // Bodies store their index in m_objects, plus one, as user data
+    m_forceFields.orbitAngularSpeed = [this](const b2Body *body) {
+        const size_t index = reinterpret_cast<size_t>(body->GetUserData());
+        return index > 0 && index <= m_objects.size() ? m_objects[index - 1].orbitAngularSpeed : 0.0f;
+    };
+
+    // From here on the world belongs to the simulation thread; the timer
+    // only drives repaints
+    m_simulation.start(1.0f / 60.0f, [this](float dt) { stepPhysics(dt); });
     m_timer = startTimer(16); // ~60FPS
 }
 void Realtime::setup2DProjection(int w, int h) {
@@ -167,9 +237,42 @@ void Realtime::paintGL() {
     float currentTime = m_elapsedTimer.elapsed() / 1000.0f;
     glUniform1f(timeLoc, currentTime);
 
-    int32 particleCount = m_particleSystem->GetParticleCount();
+    // Blend the two latest simulation snapshots by how far we are into the
+    // next step. Objects and particles are only matched up when nothing was
+    // added or removed in between. Particles are matched by index, so they
+    // also can't have been moved to other slots or recycled by the fountain
+    {
+        std::lock_guard<std::mutex> lock(m_snapshotMutex);
+        const WorldSnapshot &previous = *m_previousSnapshot;
+        const WorldSnapshot &current = *m_currentSnapshot;
+        const float sinceStep = std::chrono::duration<float>(
+            std::chrono::steady_clock::now() - current.time).count();
+        const float alpha = glm::clamp(sinceStep / m_simulation.stepSeconds(), 0.0f, 1.0f);
+
+        m_particleDrawBuffer.resize(current.particles.size());
+        if (previous.particles.size() == current.particles.size() &&
+            previous.sceneGeneration == current.sceneGeneration &&
+            previous.particleIndexGeneration == current.particleIndexGeneration) {
+            for (size_t i = 0; i < current.particles.size(); i++) {
+                m_particleDrawBuffer[i] = previous.particles[i] +
+                    alpha * (current.particles[i] - previous.particles[i]);
+            }
+        } else {
+            std::copy(current.particles.begin(), current.particles.end(), m_particleDrawBuffer.begin());
+        }
+
+        batchObjects(previous, current, alpha);
+
+        if (m_profileLabel->isVisible() &&
+            (!m_profileRefreshTimer.isValid() || m_profileRefreshTimer.elapsed() > 500)) {
+            updateProfileOverlay(current.profileStats, current.particleProfile);
+            m_profileRefreshTimer.start();
+        }
+    }
+
+    int32 particleCount = static_cast<int32>(m_particleDrawBuffer.size());
     if (particleCount > 0) {
-        const b2Vec2* positions = m_particleSystem->GetPositionBuffer();
+        const b2Vec2* positions = m_particleDrawBuffer.data();
 
         // Initialize VAO/VBO once
         if (!m_particleVAOInitialized) {
@@ -179,33 +282,29 @@ void Realtime::paintGL() {
             glGenBuffers(1, &m_particleVBO);
             glBindBuffer(GL_ARRAY_BUFFER, m_particleVBO);
 
-            // Setup position attribute
-            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+            // Positions are uploaded as tightly packed b2Vec2s, the same
+            // layout the particle system uses
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(b2Vec2), (void*)0);
             glEnableVertexAttribArray(0);
 
-            // Setup texCoord attribute with default values
-            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-            glEnableVertexAttribArray(1);
+            // Points don't need texture coordinates, so leave attribute 1
+            // disabled and feed it a constant instead
+            glDisableVertexAttribArray(1);
 
             glBindVertexArray(0);
             m_particleVAOInitialized = true;
         }
 
-        // Create a buffer that includes both position and default texture coordinates
-        std::vector<float> vertexData;
-        vertexData.reserve(particleCount * 4); // 4 floats per particle (2 for pos, 2 for texCoord)
-        for (int i = 0; i < particleCount; i++) {
-            // Position
-            vertexData.push_back(positions[i].x);
-            vertexData.push_back(positions[i].y);
-            // Default texture coordinates
-            vertexData.push_back(0.0f);
-            vertexData.push_back(0.0f);
-        }
-
-        // Update particle positions into VBO
+        // Update particle positions into VBO. Growing is geometric so the
+        // buffer is only reallocated a handful of times; otherwise orphan the
+        // old storage so the driver doesn't stall on last frame's draw
+        const GLsizeiptr uploadSize = particleCount * sizeof(b2Vec2);
         glBindBuffer(GL_ARRAY_BUFFER, m_particleVBO);
-        glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(float), vertexData.data(), GL_DYNAMIC_DRAW);
+        if (uploadSize > m_particleVBOCapacity) {
+            m_particleVBOCapacity = std::max<GLsizeiptr>(uploadSize, m_particleVBOCapacity * 2);
+        }
+        glBufferData(GL_ARRAY_BUFFER, m_particleVBOCapacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, uploadSize, positions);
 
         // Set uniforms and draw
         glm::mat4 particleModel = glm::mat4(1.0f);
@@ -213,52 +312,165 @@ void Realtime::paintGL() {
         glUniform3f(colorLoc, 0.0f, 0.0f, 1.0f);  // Blue color for water
 
         glBindVertexArray(m_particleVAO);
+        glVertexAttrib2f(1, 0.0f, 0.0f);
         glPointSize(5.0f);
         glUniform1i(planetTypeLoc, 99); // or some value that corresponds to no masking
 
         glDrawArrays(GL_POINTS, 0, particleCount);
         glBindVertexArray(0);
     }
-    for (auto &obj : m_objects) {
-        b2Vec2 pos = obj.body->GetPosition();
-        float angle = obj.body->GetAngle();
-
-        glm::mat4 model = glm::translate(glm::mat4(1.f), glm::vec3(pos.x, pos.y, 0.f));
-        model = glm::rotate(model, angle, glm::vec3(0.f, 0.f, 1.f));
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-        if (obj.hasTexture && obj.textureID != 0) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, obj.textureID);
-            glUniform1i(textureLoc, 0);
+    GLint instancedLoc = glGetUniformLocation(m_shaderProgram2D, "u_Instanced");
+    renderObjects(useTextureLoc, textureLoc, instancedLoc);
+
+    glUniform1i(planetTypeLoc, 99);
+    renderBrushStrokes();
+
+    glUseProgram(0);
+
+}
+// Unit meshes shared by every body; the instance data scales, rotates and
+// places them. Each mesh VAO also reads the instance buffer (attributes 2 and
+// 3, advanced once per instance).
+void Realtime::initializeObjectMeshes() {
+    // x, y, s, t
+    const GLfloat boxVerts[] = {
+        -1.0f, -1.0f, 0.0f, 0.0f,
+         1.0f, -1.0f, 1.0f, 0.0f,
+         1.0f,  1.0f, 1.0f, 1.0f,
+
+        -1.0f, -1.0f, 0.0f, 0.0f,
+         1.0f,  1.0f, 1.0f, 1.0f,
+        -1.0f,  1.0f, 0.0f, 1.0f
+    };
+
+    // Triangle fan: center vertex, then CIRCLE_SEGMENTS + 1 rim vertices
+    std::vector<GLfloat> circleVerts = {0.0f, 0.0f, 0.5f, 0.5f};
+    for (int i = 0; i <= CIRCLE_SEGMENTS; i++) {
+        float angle = (float)i / (float)CIRCLE_SEGMENTS * 2.0f * M_PI;
+        circleVerts.push_back(cos(angle));
+        circleVerts.push_back(sin(angle));
+        circleVerts.push_back(0.5f + cos(angle) * 0.5f);
+        circleVerts.push_back(0.5f + sin(angle) * 0.5f);
+    }
+
+    glGenBuffers(1, &m_instanceVBO);
+
+    auto setupMesh = [&](GLuint &vao, GLuint &vbo, const GLfloat *verts, GLsizeiptr bytes) {
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, bytes, verts, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)(2 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(1);
+
+        // Pointers into the instance buffer are set per batch in renderObjects
+        glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+        glEnableVertexAttribArray(2);
+        glVertexAttribDivisor(2, 1);
+        glEnableVertexAttribArray(3);
+        glVertexAttribDivisor(3, 1);
+
+        glBindVertexArray(0);
+    };
+    setupMesh(m_boxMeshVAO, m_boxMeshVBO, boxVerts, sizeof(boxVerts));
+    setupMesh(m_circleMeshVAO, m_circleMeshVBO, circleVerts.data(), circleVerts.size() * sizeof(GLfloat));
+}
+
+void Realtime::batchObjects(const WorldSnapshot &previous, const WorldSnapshot &current, float alpha) {
+    const std::vector<BodySnapshot> &bodies = current.bodies;
+    // Bodies are only ever appended until the scene is rebuilt, so the ones
+    // both snapshots have are the same bodies
+    const size_t blended = previous.sceneGeneration == current.sceneGeneration
+        ? std::min(previous.bodies.size(), bodies.size()) : 0;
+
+    // Group bodies by shape and texture. There are only ever a handful of
+    // batches, so a linear search for each body's batch is fine
+    m_objectBatches.clear();
+    m_objectBatchIndex.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); i++) {
+        const BodySnapshot &body = bodies[i];
+        size_t batch = 0;
+        while (batch < m_objectBatches.size() &&
+               (m_objectBatches[batch].isCircle != body.isCircle ||
+                m_objectBatches[batch].textureID != body.textureID)) {
+            batch++;
+        }
+        if (batch == m_objectBatches.size()) {
+            m_objectBatches.push_back({body.isCircle, body.textureID, 0, 0});
+        }
+        m_objectBatches[batch].count++;
+        m_objectBatchIndex[i] = static_cast<int>(batch);
+    }
+    int first = 0;
+    for (ObjectBatch &batch : m_objectBatches) {
+        batch.first = first;
+        first += batch.count;
+        batch.count = 0;
+    }
+
+    // Scatter the instances so each batch is contiguous
+    m_instanceData.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); i++) {
+        const BodySnapshot &body = bodies[i];
+        glm::vec2 position = body.position;
+        float angle = body.angle;
+        if (i < blended) {
+            position = glm::mix(previous.bodies[i].position, position, alpha);
+            angle = glm::mix(previous.bodies[i].angle, angle, alpha);
+        }
+        ObjectBatch &batch = m_objectBatches[m_objectBatchIndex[i]];
+        m_instanceData[batch.first + batch.count++] = {position, angle, body.halfSize, body.color};
+    }
+}
+
+void Realtime::renderObjects(GLint useTextureLoc, GLint textureLoc, GLint instancedLoc) {
+    if (m_instanceData.empty()) {
+        return;
+    }
+
+    // Same grow-then-orphan scheme as the particle buffer
+    const GLsizeiptr uploadSize = m_instanceData.size() * sizeof(ObjectInstance);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+    if (uploadSize > m_instanceVBOCapacity) {
+        m_instanceVBOCapacity = std::max<GLsizeiptr>(uploadSize, m_instanceVBOCapacity * 2);
+    }
+    glBufferData(GL_ARRAY_BUFFER, m_instanceVBOCapacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, uploadSize, m_instanceData.data());
+
+    glUniform1i(instancedLoc, 1);
+    glUniform1i(textureLoc, 0);
+    glActiveTexture(GL_TEXTURE0);
+    for (const ObjectBatch &batch : m_objectBatches) {
+        if (batch.textureID != 0) {
+            glBindTexture(GL_TEXTURE_2D, batch.textureID);
             glUniform1i(useTextureLoc, 1);
         } else {
-            glUniform3fv(colorLoc, 1, glm::value_ptr(obj.color));
             glUniform1i(useTextureLoc, 0);
         }
 
-        // // Set the object's color
-        // glUniform3fv(colorLoc, 1, glm::value_ptr(obj.color));
-
-        glBindVertexArray(obj.VAO);
-        if (obj.isCircle) {
-            // If it's a circle approximated by a triangle fan, draw with GL_TRIANGLE_FAN
-            // The first vertex is the center, and then the other vertices form the fan
-            // For a circle: num vertices = NUM_SEGMENTS + 1 (including center)
-            glDrawArrays(GL_TRIANGLE_FAN, 0, 27);
+        // GL 4.1 has no base instance, so point the instance attributes at
+        // this batch's slice of the buffer instead
+        glBindVertexArray(batch.isCircle ? m_circleMeshVAO : m_boxMeshVAO);
+        const GLsizeiptr offset = batch.first * sizeof(ObjectInstance);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(ObjectInstance),
+                              (void*)(offset + offsetof(ObjectInstance, position)));
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(ObjectInstance),
+                              (void*)(offset + offsetof(ObjectInstance, color)));
+        if (batch.isCircle) {
+            glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, CIRCLE_SEGMENTS + 2, batch.count);
         } else {
-            // Box is 6 vertices forming 2 triangles
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 6, batch.count);
         }
-        glBindVertexArray(0);
     }
-
-    glUniform1i(planetTypeLoc, 99);
-    renderBrushStrokes();
-
-    glUseProgram(0);
-
+    glBindVertexArray(0);
+    glUniform1i(useTextureLoc, 0);
+    glUniform1i(instancedLoc, 0);
 }
+
 void Realtime::resizeGL(int w, int h) {
     setup2DProjection(w, h);
     update();
@@ -293,19 +505,13 @@ void Realtime::settingsChanged() {
     m_camera.farPlane = settings.farPlane;
     m_camera.updateProjectionMatrix(width(), height());
 
-    // Check if tessellation parameters have changed
-    m_explosionStrength = settings.shapeParameter1;
-    static int prevParam2 = settings.shapeParameter2;
-
-    if (settings.shapeParameter1 != m_explosionStrength || settings.shapeParameter2 != prevParam2) {
-        m_explosionStrength = settings.shapeParameter1;
-        prevParam2 = settings.shapeParameter2;
-
-        // Regenerate shapes with new tessellation parameters
-        makeCurrent();
- // Re-initialize shapes with updated parameters
-        doneCurrent();
-    }
+    // Explosion strength and orbit speed are read by the simulation thread
+    const int explosionStrength = settings.shapeParameter1;
+    const float orbitSpeedScale = 0.8 + settings.shapeParameter2/5;
+    m_simulation.post([this, explosionStrength, orbitSpeedScale] {
+        m_explosionStrength = explosionStrength;
+        m_orbitSpeedScale = orbitSpeedScale;
+    });
 
     update(); // Request a repaint
 }
@@ -313,10 +519,8 @@ void Realtime::settingsChanged() {
 
 
 
-void Realtime::createPhysicsObject(float x, float y) {
-    // Make the OpenGL context current before creating VAOs and VBOs
-    makeCurrent();
-
+void Realtime::createPhysicsObject(float x, float y, ObjectShape shape, float halfSize, glm::vec3 color) {
+    // No GL work here: bodies are drawn from the shared meshes in renderObjects
     b2BodyDef bodyDef;
     bodyDef.type = b2_dynamicBody;
     bodyDef.position.Set(x, y);
@@ -324,9 +528,8 @@ void Realtime::createPhysicsObject(float x, float y) {
 
     PhysObject obj;
     obj.body = body;
-    obj.shape = m_currentShape;
-    obj.color = m_currentColor;
-    float halfSize = m_currentSize;
+    obj.shape = shape;
+    obj.color = color;
 
     if (obj.shape == ObjectShape::BOX) {
         obj.isCircle = false;
@@ -341,28 +544,6 @@ void Realtime::createPhysicsObject(float x, float y) {
         fixtureDef.friction = 0.3f;
         body->CreateFixture(&fixtureDef);
 
-        GLfloat verts[] = {
-            -halfSize, -halfSize,
-            halfSize, -halfSize,
-            halfSize,  halfSize,
-
-            -halfSize, -halfSize,
-            halfSize,  halfSize,
-            -halfSize,  halfSize
-        };
-
-        glGenVertexArrays(1, &obj.VAO);
-        glBindVertexArray(obj.VAO);
-
-        glGenBuffers(1, &obj.VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, obj.VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
-
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        glEnableVertexAttribArray(0);
-
-        glBindVertexArray(0);
-
     } else if (obj.shape == ObjectShape::CIRCLE) {
         obj.isCircle = true;
         obj.size = glm::vec2(halfSize);
@@ -375,51 +556,11 @@ void Realtime::createPhysicsObject(float x, float y) {
         fixtureDef.density = 1.0f;
         fixtureDef.friction = 0.3f;
         body->CreateFixture(&fixtureDef);
-
-        const int NUM_SEGMENTS = 24;
-        std::vector<GLfloat> circleVerts;
-
-        // Center vertex with texture coordinates
-        circleVerts.push_back(0.0f);  // x
-        circleVerts.push_back(0.0f);  // y
-        circleVerts.push_back(0.5f);  // s
-        circleVerts.push_back(0.5f);  // t
-
-        for (int i = 0; i <= NUM_SEGMENTS; i++) {
-            float angle = (float)i / (float)NUM_SEGMENTS * 2.0f * M_PI;
-            float xPos = halfSize * cos(angle);
-            float yPos = halfSize * sin(angle);
-            float s = 0.5f + (cos(angle) * 0.5f);  // Map to [0,1] range
-            float t = 0.5f + (sin(angle) * 0.5f);  // Map to [0,1] range
-
-            circleVerts.push_back(xPos);  // x
-            circleVerts.push_back(yPos);  // y
-            circleVerts.push_back(s);     // s
-            circleVerts.push_back(t);     // t
-        }
-
-        glGenVertexArrays(1, &obj.VAO);
-        glBindVertexArray(obj.VAO);
-
-        glGenBuffers(1, &obj.VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, obj.VBO);
-        glBufferData(GL_ARRAY_BUFFER, circleVerts.size() * sizeof(GLfloat), circleVerts.data(), GL_STATIC_DRAW);
-
-        // Position attribute (2 floats)
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        // Texture coordinate attribute (2 floats)
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)(2 * sizeof(GLfloat)));
-        glEnableVertexAttribArray(1);
-
-        glBindVertexArray(0);
     }
 
+    // Lets the orbit field find the body's PhysObject
+    body->SetUserData(reinterpret_cast<void*>(m_objects.size() + 1));
     m_objects.push_back(obj);
-
-    // After finishing creation, you can let paintGL handle the rest.
-    // No need to call doneCurrent() here, as QOpenGLWidget will handle context switching appropriately.
 }
 
 // ================== Project 6: Action!
@@ -450,7 +591,7 @@ void Realtime::keyPressEvent(QKeyEvent *event) {
         m_selectingOrbitCenter = true;
         m_selectingGravityCenter = false;
         m_selectingExplosionCenter = false;
-        m_world->SetGravity(b2Vec2(0.0f, 0.0f));
+        m_simulation.post([this] { m_world->SetGravity(b2Vec2(0.0f, 0.0f)); });
         std::cout << "Orbit mode activated. Click on the screen to make objects orbit." << std::endl;
         break;
     case Qt::Key_6:
@@ -478,6 +619,30 @@ void Realtime::keyPressEvent(QKeyEvent *event) {
     case Qt::Key_W:
         m_currentShape = ObjectShape::WATER;
         break;
+    case Qt::Key_F: {
+        // A fountain recycles its own oldest drops, so it can run forever
+        // without hitting the particle cap
+        const float worldHeight = m_worldHeight;
+        m_simulation.post([this, worldHeight] {
+            if (m_fountain) {
+                m_particleSystem->DestroyParticleEmitter(m_fountain);
+                m_fountain = nullptr;
+                return;
+            }
+            b2CircleShape nozzle;
+            nozzle.m_radius = 0.2f;
+            b2ParticleEmitterDef emitterDef;
+            emitterDef.shape = &nozzle;
+            emitterDef.position.Set(0.0f, -worldHeight / 2.0f + 0.5f);
+            emitterDef.velocity.Set(0.0f, 8.0f);
+            emitterDef.emitRate = 300.0f;
+            emitterDef.capacity = 2000;
+            emitterDef.flags = b2_waterParticle;
+            emitterDef.color.Set(0, 0, 155, 255);
+            m_fountain = m_particleSystem->CreateParticleEmitter(emitterDef);
+        });
+        break;
+    }
     case Qt::Key_L:
         m_brushMode = !m_brushMode;
 
@@ -485,6 +650,10 @@ void Realtime::keyPressEvent(QKeyEvent *event) {
     case Qt::Key_0:
         resetWorld();
         break;
+    case Qt::Key_P:
+        m_profileLabel->setVisible(!m_profileLabel->isVisible());
+        m_profileRefreshTimer.invalidate();
+        break;
 
     default:
         break;
@@ -512,52 +681,64 @@ GLuint loadTexture(const QString &filePath) {
     return texID;
 }
 void Realtime::resetWorld() {
-    // Delete all Box2D bodies and reset vectors
-    for (auto& obj : m_objects) {
-        m_world->DestroyBody(obj.body);
-    }
-    m_objects.clear();
-
-    // Clear all particles
-    if (m_particleSystem) {
-        m_particleSystem->DestroyParticle(0, false);
-    }
-
     // Clear all brush strokes (both visual and physical)
     m_allBrushStrokes.clear();
     m_currentStroke.clear();
+    m_mouseDown = false;
+    m_brushMode = false;
+    setCursor(Qt::ArrowCursor);
 
-    // Destroy all brush bodies
-    b2Body* body = m_world->GetBodyList();
-    while (body) {
-        b2Body* nextBody = body->GetNext(); // Get next before destroying current
-        if (body != m_groundBody) { // Don't destroy ground yet
-            m_world->DestroyBody(body);
+    const float worldWidth = m_worldWidth;
+    const float worldHeight = m_worldHeight;
+    m_simulation.post([this, worldWidth, worldHeight] {
+        // Delete all Box2D bodies and reset vectors
+        for (auto& obj : m_objects) {
+            m_world->DestroyBody(obj.body);
+        }
+        m_objects.clear();
+        m_sceneGeneration++;
+
+        // Clear all particles
+        if (m_particleSystem) {
+            for (int i = 0; i < m_particleSystem->GetParticleCount(); i++) {
+                m_particleSystem->DestroyParticle(i, false);
+            }
+            if (m_fountain) {
+                m_particleSystem->DestroyParticleEmitter(m_fountain);
+                m_fountain = nullptr;
+            }
         }
-        body = nextBody;
-    }
 
-    // Reset current brush pointer
-    m_currentBrush = nullptr;
+        // Destroy all brush bodies
+        b2Body* body = m_world->GetBodyList();
+        while (body) {
+            b2Body* nextBody = body->GetNext(); // Get next before destroying current
+            if (body != m_groundBody) { // Don't destroy ground yet
+                m_world->DestroyBody(body);
+            }
+            body = nextBody;
+        }
 
-    // Reset gravity and modes
-    m_world->SetGravity(b2Vec2(0.0f, -9.8f));
-    m_hasGravityCenter = false;
-    m_orbitMode = false;
-    m_brushMode = false;
-    setCursor(Qt::ArrowCursor);
+        // Reset current brush pointer
+        m_currentBrush = nullptr;
 
-    // Recreate ground
-    if (m_groundBody) {
-        m_world->DestroyBody(m_groundBody);
-    }
-    b2BodyDef groundDef;
-    groundDef.position.Set(0.0f, -m_worldHeight / 2.0f - 1.0f);
-    m_groundBody = m_world->CreateBody(&groundDef);
+        // Reset gravity and modes
+        m_world->SetGravity(b2Vec2(0.0f, -9.8f));
+        m_hasGravityCenter = false;
+        m_orbitMode = false;
 
-    b2PolygonShape groundBox;
-    groundBox.SetAsBox(m_worldWidth, 1.0f);
-    m_groundBody->CreateFixture(&groundBox, 0.0f);
+        // Recreate ground
+        if (m_groundBody) {
+            m_world->DestroyBody(m_groundBody);
+        }
+        b2BodyDef groundDef;
+        groundDef.position.Set(0.0f, -worldHeight / 2.0f - 1.0f);
+        m_groundBody = m_world->CreateBody(&groundDef);
+
+        b2PolygonShape groundBox;
+        groundBox.SetAsBox(worldWidth, 1.0f);
+        m_groundBody->CreateFixture(&groundBox, 0.0f);
+    });
 
     update();
 }
@@ -574,8 +755,10 @@ void Realtime::mousePressEvent(QMouseEvent *event) {
 
         if (settings.perPixelFilter) {
             // Set new gravity center
-            m_gravityCenter = glm::vec2(worldX, worldY);
-            m_hasGravityCenter = true;
+            m_simulation.post([this, worldX, worldY] {
+                m_gravityCenter = glm::vec2(worldX, worldY);
+                m_hasGravityCenter = true;
+            });
             m_selectingGravityCenter = false;
         }if (m_brushMode) {
             float x = ((float)event->pos().x() / width() - 0.5f) * m_worldWidth;
@@ -587,45 +770,57 @@ void Realtime::mousePressEvent(QMouseEvent *event) {
             m_mouseDown = true;
 
             // Create static body for the brush stroke
-            b2BodyDef bodyDef;
-            bodyDef.type = b2_staticBody;
-            m_currentBrush = m_world->CreateBody(&bodyDef);
+            m_simulation.post([this] {
+                b2BodyDef bodyDef;
+                bodyDef.type = b2_staticBody;
+                m_currentBrush = m_world->CreateBody(&bodyDef);
+            });
         }
 
         else if (settings.extraCredit2) {
-            m_explosionCenter = glm::vec2(worldX, worldY);
-            m_explosionMode = true;
+            m_simulation.post([this, worldX, worldY] {
+                m_explosionCenter = glm::vec2(worldX, worldY);
+                m_explosionMode = true;
+                m_hasGravityCenter = false;
+            });
             m_selectingExplosionCenter = false;
-            m_hasGravityCenter = false;
         }
 
         else if (m_selectingOrbitCenter) {
-            m_orbitCenter = glm::vec2(0.f);
-            m_orbitMode = true;
             m_selectingOrbitCenter = false;
-            m_hasGravityCenter = false;
-            if (m_groundBody) {
-                m_world->DestroyBody(m_groundBody);
-                m_groundBody = nullptr;
-                std::cout << "Ground body destroyed for orbit mode." << std::endl;
-            }
+            m_simulation.post([this] {
+                m_orbitCenter = glm::vec2(0.f);
+                m_orbitMode = true;
+                m_hasGravityCenter = false;
+                if (m_groundBody) {
+                    m_world->DestroyBody(m_groundBody);
+                    m_groundBody = nullptr;
+                    std::cout << "Ground body destroyed for orbit mode." << std::endl;
+                }
+            });
         }else if (m_currentShape == ObjectShape::WATER) {
-            makeCurrent();
-            // Define a box of particles at clicked position
-            b2PolygonShape particleBox;
-            float halfSize = 0.5f;
-            particleBox.SetAsBox(halfSize, halfSize, b2Vec2(worldX, worldY), 0);
-
-            b2ParticleGroupDef groupDef;
-            groupDef.shape = &particleBox;
-            groupDef.flags = b2_waterParticle; // Water-like particles
-            groupDef.color.Set(0, 0, 155, 255); // Blue color (only if rendering particle color)
-            m_particleSystem->CreateParticleGroup(groupDef);
+            m_simulation.post([this, worldX, worldY] {
+                // Define a box of particles at clicked position
+                b2PolygonShape particleBox;
+                float halfSize = 0.5f;
+                particleBox.SetAsBox(halfSize, halfSize, b2Vec2(worldX, worldY), 0);
+
+                b2ParticleGroupDef groupDef;
+                groupDef.shape = &particleBox;
+                groupDef.flags = b2_waterParticle; // Water-like particles
+                groupDef.color.Set(0, 0, 155, 255); // Blue color (only if rendering particle color)
+                m_particleSystem->CreateParticleGroup(groupDef);
+            });
         }
         
         else {
             // Create a new physics object
-            createPhysicsObject(worldX, worldY);
+            const ObjectShape shape = m_currentShape;
+            const float size = m_currentSize;
+            const glm::vec3 color = m_currentColor;
+            m_simulation.post([this, worldX, worldY, shape, size, color] {
+                createPhysicsObject(worldX, worldY, shape, size, color);
+            });
         }
     }
 }
@@ -637,111 +832,150 @@ void Realtime::mouseReleaseEvent(QMouseEvent *event) {
     if (!m_currentStroke.empty()) {
         m_allBrushStrokes.push_back(m_currentStroke);
     }
-    m_currentBrush = nullptr;
+    m_simulation.post([this] { m_currentBrush = nullptr; });
     m_mouseDown = false;
 
 }
 
 void Realtime::timerEvent(QTimerEvent *event) {
-    float timeStep = 1.0f / 60.0f;
+    update(); // request a repaint
+}
+
+// Runs on the simulation thread
+void Realtime::stepPhysics(float dt) {
     int32 velocityIterations = 6;
     int32 positionIterations = 2;
 
-    m_world->Step(timeStep, velocityIterations, positionIterations);
-
+    // Forces are consumed (and cleared) by the step, so apply them first
     if (m_hasGravityCenter) {
         // Apply radial gravity toward m_gravityCenter
-        for (auto &obj : m_objects) {
-            b2Body* body = obj.body;
-            if (body->GetType() == b2_dynamicBody) {
-                b2Vec2 bodyPos = body->GetPosition();
-                glm::vec2 dir = glm::vec2(m_gravityCenter.x - bodyPos.x, m_gravityCenter.y - bodyPos.y);
-                float distSq = dir.x * dir.x + dir.y * dir.y;
-                if (distSq > 0.0001f) {
-                    float dist = sqrt(distSq);
-                    // Normalized direction
-                    glm::vec2 norm = dir / dist;
-
-                    float mass = body->GetMass();
-                    glm::vec2 force = norm * (m_gravityStrength * mass);
-
-                    body->ApplyForceToCenter(b2Vec2(force.x *2, force.y*2), true);
-                }
-            }
-        }
+        ForceField field;
+        field.type = ForceField::Type::RADIAL;
+        field.center = b2Vec2(m_gravityCenter.x, m_gravityCenter.y);
+        field.strength = 2.0f * m_gravityStrength;
+        m_forceFields.apply(*m_world, m_particleSystem, field);
     }
 
     if (m_explosionMode) {
-        // Apply outward force from the click position
-        // glm::vec2 explosionCenter(worldX, worldY);
-        float explosionStrength = m_explosionStrength; // Adjust the strength of the explosion
+        // Apply outward force from the click position, scaled by inverse
+        // distance, to everything within the blast radius
+        ForceField field;
+        field.type = ForceField::Type::EXPLOSION;
+        field.center = b2Vec2(m_explosionCenter.x, m_explosionCenter.y);
+        field.radius = m_explosionRadius;
+        field.strength = m_explosionStrength;
+        m_forceFields.apply(*m_world, m_particleSystem, field);
+        m_explosionMode = false;
+    }
 
-        for (auto &obj : m_objects) {
-            b2Body* body = obj.body;
-            if (body->GetType() == b2_dynamicBody) {
-                b2Vec2 bodyPos = body->GetPosition();
-                glm::vec2 direction = glm::vec2(bodyPos.x - m_explosionCenter.x, bodyPos.y - m_explosionCenter.y);
+    if (m_orbitMode) {
+        ForceField field;
+        field.type = ForceField::Type::ORBIT;
+        field.center = b2Vec2(m_orbitCenter.x, m_orbitCenter.y);
+        field.orbitSpeedScale = m_orbitSpeedScale;
+        m_forceFields.apply(*m_world, m_particleSystem, field);
+    }
 
-                float distanceSq = direction.x * direction.x + direction.y * direction.y;
+    m_world->Step(dt, velocityIterations, positionIterations);
+    recordProfile();
 
-                // Avoid division by zero and apply force only within a certain range
-                if (distanceSq > 0.0001f && distanceSq < 10.0f) {
-                    float distance = sqrt(distanceSq);
-                    glm::vec2 normalizedDirection = direction / distance;
+    publishSnapshot();
+}
 
-                    // Scale force by explosion strength and inverse distance
-                    glm::vec2 force = normalizedDirection * (explosionStrength / distance);
+// Runs on the simulation thread
+void Realtime::recordProfile() {
+    static_assert(2 + sizeof(particleProfileStages) / sizeof(particleProfileStages[0]) == PROFILE_STAT_COUNT,
+                  "ProfileStats doesn't match the overlay rows");
 
-                    body->ApplyForceToCenter(b2Vec2(force.x, force.y), true);
-                }
-            }
-        }
-        m_explosionMode = false;
+    const b2ParticleProfile &profile = m_particleSystem->GetProfile();
+    m_profileAccumulator[0].Record(m_world->GetProfile().step);
+    m_profileAccumulator[1].Record(profile.solve);
+    for (int i = 2; i < PROFILE_STAT_COUNT; i++) {
+        m_profileAccumulator[i].Record(profile.*particleProfileStages[i - 2].time);
     }
 
-        if (m_orbitMode) {
-            for (auto &obj : m_objects) {
-                b2Body* body = obj.body;
-                if (body->GetType() == b2_dynamicBody) {
-                    b2Vec2 bodyPos = body->GetPosition();
-                    glm::vec2 pos(bodyPos.x, bodyPos.y);
-                    glm::vec2 diff = pos - m_orbitCenter;
-                    float dist = glm::length(diff);
-
-                    if (dist < 0.0001f) {
-                        continue;
-                    }
-
-                    glm::vec2 radialDir = diff / dist;
-                    glm::vec2 tangentialDir(-radialDir.y, radialDir.x);
+    if (++m_profileSteps == PROFILE_WINDOW_STEPS) {
+        m_profileWindow = m_profileAccumulator;
+        for (b2Stat &stat : m_profileAccumulator) {
+            stat.Clear();
+        }
+        m_profileSteps = 0;
+    }
+}
 
-                    float angularSpeed = obj.orbitAngularSpeed;
-                    float desiredSpeed = (0.8+settings.shapeParameter2/5)*angularSpeed * dist; // v = ω * r
+// Runs on the GUI thread with the snapshot lock held, so keep it cheap
+void Realtime::updateProfileOverlay(const ProfileStats &stats, const b2ParticleProfile &latest) {
+    if (stats[0].GetCount() == 0) {
+        return;
+    }
 
-                    b2Vec2 bVel = body->GetLinearVelocity();
-                    glm::vec2 vel(bVel.x, bVel.y);
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(3);
+    text << std::left << std::setw(18) << "ms over " << PROFILE_WINDOW_STEPS << " steps"
+         << "    mean      max\n";
+    auto row = [&](const char *name, const b2Stat &stat) {
+        text << std::left << std::setw(18) << name << std::right
+             << std::setw(9) << stat.GetMean() << std::setw(9) << stat.GetMax() << "\n";
+    };
+    row("world step", stats[0]);
+    row("particle solve", stats[1]);
+    for (int i = 2; i < PROFILE_STAT_COUNT; i++) {
+        // Stages that never ran are just noise
+        if (stats[i].GetMax() > 0.0f) {
+            row((std::string("  ") + particleProfileStages[i - 2].name).c_str(), stats[i]);
+        }
+    }
+    text << "\nparticles " << latest.particleCount
+         << "  contacts " << latest.contactCount
+         << "  body contacts " << latest.bodyContactCount
+         << "\npairs " << latest.pairCount
+         << "  triads " << latest.triadCount
+         << "  zombies removed " << latest.zombiesRemoved;
+    if (latest.sleepingCount > 0) {
+        text << "\nsleeping " << latest.sleepingCount;
+    }
+    if (latest.neighborListRebuilds > 0) {
+        text << "\nneighbor list rebuilds " << latest.neighborListRebuilds;
+    }
+    if (latest.particleCount > 0) {
+        text << "\nmemory " << latest.memoryUsage / 1024 << " KiB  "
+             << latest.memoryUsage / latest.particleCount << " B/particle";
+    }
 
-                    float tangentialComponent = glm::dot(vel, tangentialDir);
-                    float speedError = desiredSpeed - tangentialComponent;
+    m_profileLabel->setText(QString::fromStdString(text.str()));
+    m_profileLabel->adjustSize();
+}
 
-                    float tangentForceGain = 10.0f;
-                    glm::vec2 tangentForce = tangentialDir * speedError * tangentForceGain * body->GetMass();
-                    body->ApplyForceToCenter(b2Vec2(tangentForce.x, tangentForce.y), true);
+// Runs on the simulation thread. Only the simulation thread ever touches the
+// spare snapshot, so it's filled without the lock
+void Realtime::publishSnapshot() {
+    WorldSnapshot &snapshot = *m_spareSnapshot;
 
-                    float centripetalForceMagnitude = (desiredSpeed * desiredSpeed / dist) * body->GetMass();
-                    glm::vec2 centripetalForce = -radialDir * centripetalForceMagnitude;
-                    body->ApplyForceToCenter(b2Vec2(centripetalForce.x, centripetalForce.y), true);
-                }
-            }
-        }
+    snapshot.bodies.clear();
+    for (const PhysObject &obj : m_objects) {
+        const b2Vec2 pos = obj.body->GetPosition();
+        snapshot.bodies.push_back({glm::vec2(pos.x, pos.y), obj.body->GetAngle(), obj.size.x, obj.color,
+                                   obj.isCircle, obj.hasTexture ? obj.textureID : 0});
+    }
 
+    const int32 particleCount = m_particleSystem->GetParticleCount();
+    const b2Vec2* positions = m_particleSystem->GetPositionBuffer();
+    snapshot.particles.assign(positions, positions + particleCount);
 
+    snapshot.profileStats = m_profileWindow;
+    snapshot.particleProfile = m_particleSystem->GetProfile();
+    snapshot.sceneGeneration = m_sceneGeneration;
+    snapshot.particleIndexGeneration = m_particleSystem->GetParticleIndexGeneration();
+    snapshot.time = std::chrono::steady_clock::now();
 
-    update(); // request a repaint
+    std::lock_guard<std::mutex> lock(m_snapshotMutex);
+    m_spareSnapshot = m_previousSnapshot;
+    m_previousSnapshot = m_currentSnapshot;
+    m_currentSnapshot = &snapshot;
 }
 
 void Realtime::mouseMoveEvent(QMouseEvent *event) {
-    if (!m_brushMode || !m_currentBrush || !m_mouseDown) return;
+    if (!m_brushMode || !m_mouseDown) return;
 
     float x = ((float)event->pos().x() / width() - 0.5f) * m_worldWidth;
     float y = (0.5f - (float)event->pos().y() / height()) * m_worldHeight;
@@ -758,16 +992,22 @@ void Realtime::mouseMoveEvent(QMouseEvent *event) {
     // Create edge shape between last two points
     if (m_currentStroke.size() >= 2 ) {
         size_t last = m_currentStroke.size() - 1;
+        const b2Vec2 from = m_currentStroke[last-1];
+        const b2Vec2 to = m_currentStroke[last];
 
-        b2EdgeShape edge;
-        edge.Set(m_currentStroke[last-1], m_currentStroke[last]);
+        m_simulation.post([this, from, to] {
+            if (!m_currentBrush) return;
 
-        b2FixtureDef fixtureDef;
-        fixtureDef.shape = &edge;
-        fixtureDef.density = 0.0f;  // Static body
-        fixtureDef.friction = 0.3f;
+            b2EdgeShape edge;
+            edge.Set(from, to);
 
-        m_currentBrush->CreateFixture(&fixtureDef);
+            b2FixtureDef fixtureDef;
+            fixtureDef.shape = &edge;
+            fixtureDef.density = 0.0f;  // Static body
+            fixtureDef.friction = 0.3f;
+
+            m_currentBrush->CreateFixture(&fixtureDef);
+        });
     }
 
     update();
@@ -874,137 +1114,121 @@ void Realtime::clearScene() {
 }
 
 void Realtime::resetGravityCenter() {
-    m_gravityCenter = glm::vec2(0.0f);
-    m_hasGravityCenter = false;
     m_selectingGravityCenter = false;
-    m_orbitMode = false;
     m_selectingOrbitCenter = false;
-    m_world->SetGravity(b2Vec2(0.0f, -9.8f));
 
-    if (!m_groundBody) {
-        b2BodyDef groundDef;
-        groundDef.position.Set(0.0f, -m_worldHeight / 2.0f - 1.0f);
-        m_groundBody = m_world->CreateBody(&groundDef);
+    const float worldWidth = m_worldWidth;
+    const float worldHeight = m_worldHeight;
+    m_simulation.post([this, worldWidth, worldHeight] {
+        m_gravityCenter = glm::vec2(0.0f);
+        m_hasGravityCenter = false;
+        m_orbitMode = false;
+        m_world->SetGravity(b2Vec2(0.0f, -9.8f));
+
+        if (!m_groundBody) {
+            b2BodyDef groundDef;
+            groundDef.position.Set(0.0f, -worldHeight / 2.0f - 1.0f);
+            m_groundBody = m_world->CreateBody(&groundDef);
+
+            b2PolygonShape groundBox;
+            groundBox.SetAsBox(worldWidth, 1.0f);
+            m_groundBody->CreateFixture(&groundBox, 0.0f);
+        }
+    });
 
-        b2PolygonShape groundBox;
-        groundBox.SetAsBox(m_worldWidth, 1.0f);
-        m_groundBody->CreateFixture(&groundBox, 0.0f);
-    }
-    
     std::cout << "Gravity center reset." << std::endl;
 
     update();
 }
 
 void Realtime::initializeSolarSystem() {
-    // Clear and destroy existing objects
-    for (auto &obj : m_objects) {
-        m_world->DestroyBody(obj.body);
-    }
-    m_objects.clear();
-
-    if (m_groundBody) {
-        m_world->DestroyBody(m_groundBody);
-        m_groundBody = nullptr;
+    // Textures are GL objects, so load them here on the GUI thread (once)
+    // and hand the simulation just their ids
+    if (m_planetTextures[0] == 0) {
+        makeCurrent();
+        m_planetTextures[0] = loadTexture(":/resources/planetText/test.png");
+        for (int i = 0; i < 7; i++) {
+            m_planetTextures[i + 1] = loadTexture(texturePaths[i]);
+        }
+        doneCurrent();
     }
+    std::array<GLuint, 8> textures;
+    std::copy(std::begin(m_planetTextures), std::end(m_planetTextures), textures.begin());
 
-    // Set gravity to zero and enable orbit mode
-    m_world->SetGravity(b2Vec2(0.0f, 0.0f));
-    m_orbitCenter = glm::vec2(0.0f, 0.0f);
-    m_orbitMode = true;
-
-    // Create the sun
-    {
-        b2BodyDef sunDef;
-        sunDef.type = b2_staticBody;
-        sunDef.position.Set(0.0f, 0.0f);
-        b2Body* sunBody = m_world->CreateBody(&sunDef);
+    m_currentShape = ObjectShape::CIRCLE;
+    m_currentSize = 0.1f;
 
-        b2CircleShape sunShape;
-        sunShape.m_radius = 0.25f;
-        b2FixtureDef fixtureDef;
-        fixtureDef.shape = &sunShape;
-        fixtureDef.density = 0.0f;
-        fixtureDef.friction = 0.0f;
-        sunBody->CreateFixture(&fixtureDef);
-
-        PhysObject sunObj;
-        sunObj.body = sunBody;
-        sunObj.shape = ObjectShape::CIRCLE;
-        sunObj.color = glm::vec3(1.0f, 1.0f, 0.0f);
-        float halfSize = 0.25f;
-
-        const int NUM_SEGMENTS = 24;
-        std::vector<GLfloat> circleVerts;
-        circleVerts.push_back(0.0f);
-        circleVerts.push_back(0.0f);
-        for (int i = 0; i <= NUM_SEGMENTS; i++) {
-            float angle = (float)i / (float)NUM_SEGMENTS * 2.0f * M_PI;
-            float xPos = halfSize * cos(angle);
-            float yPos = halfSize * sin(angle);
-            circleVerts.push_back(xPos);
-            circleVerts.push_back(yPos);
+    m_simulation.post([this, textures] {
+        // Clear and destroy existing objects
+        for (auto &obj : m_objects) {
+            m_world->DestroyBody(obj.body);
         }
+        m_objects.clear();
+        m_sceneGeneration++;
 
-        glGenVertexArrays(1, &sunObj.VAO);
-        glBindVertexArray(sunObj.VAO);
-
-        glGenBuffers(1, &sunObj.VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, sunObj.VBO);
-        glBufferData(GL_ARRAY_BUFFER, circleVerts.size() * sizeof(GLfloat), circleVerts.data(), GL_STATIC_DRAW);
-
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        glEnableVertexAttribArray(0);
-
-        glBindVertexArray(0);
-        sunObj.isCircle = true;
-        sunObj.size = glm::vec2(halfSize);
-
-        QString sunTexturePath = ":/resources/planetText/test.png";
-        GLuint sunTexID = loadTexture(sunTexturePath);
-        if (sunTexID != 0) {
-            sunObj.textureID = sunTexID;
-            sunObj.hasTexture = true;
-        } else {
-            sunObj.hasTexture = false;
+        if (m_groundBody) {
+            m_world->DestroyBody(m_groundBody);
+            m_groundBody = nullptr;
         }
 
-        m_objects.push_back(sunObj);
-    }
+        // Set gravity to zero and enable orbit mode
+        m_world->SetGravity(b2Vec2(0.0f, 0.0f));
+        m_orbitCenter = glm::vec2(0.0f, 0.0f);
+        m_orbitMode = true;
+
+        // Create the sun
+        {
+            b2BodyDef sunDef;
+            sunDef.type = b2_staticBody;
+            sunDef.position.Set(0.0f, 0.0f);
+            b2Body* sunBody = m_world->CreateBody(&sunDef);
+
+            b2CircleShape sunShape;
+            sunShape.m_radius = 0.25f;
+            b2FixtureDef fixtureDef;
+            fixtureDef.shape = &sunShape;
+            fixtureDef.density = 0.0f;
+            fixtureDef.friction = 0.0f;
+            sunBody->CreateFixture(&fixtureDef);
+
+            PhysObject sunObj;
+            sunObj.body = sunBody;
+            sunObj.shape = ObjectShape::CIRCLE;
+            sunObj.color = glm::vec3(1.0f, 1.0f, 0.0f);
+            float halfSize = 0.25f;
+
+            sunObj.isCircle = true;
+            sunObj.size = glm::vec2(halfSize);
+
+            sunObj.textureID = textures[0];
+            sunObj.hasTexture = textures[0] != 0;
+
+            m_objects.push_back(sunObj);
+        }
 
-    // Assign realistic(ish) angular speeds (in rad/s) to planets:
-    // Example using 1 simulated year = 60 seconds scaling:
-    // Mercury, Venus, Earth, Mars, Jupiter, Saturn, Uranus
-    std::vector<float> angularSpeeds = {
-        0.4345f,  // Mercury
-        0.1700f,  // Venus
-        0.1047f,  // Earth
-        0.0557f,  // Mars
-        0.00883f, // Jupiter
-        0.00355f, // Saturn
-        0.001247f // Uranus
-    };
+        // Assign realistic(ish) angular speeds (in rad/s) to planets:
+        // Example using 1 simulated year = 60 seconds scaling:
+        // Mercury, Venus, Earth, Mars, Jupiter, Saturn, Uranus
+        std::vector<float> angularSpeeds = {
+            0.4345f,  // Mercury
+            0.1700f,  // Venus
+            0.1047f,  // Earth
+            0.0557f,  // Mars
+            0.00883f, // Jupiter
+            0.00355f, // Saturn
+            0.001247f // Uranus
+        };
 
-    m_currentShape = ObjectShape::CIRCLE;
-    m_currentSize = 0.1f;
-    float baseRadius = 1.5f;
-    for (int i = 0; i < 7; i++) {
-        float radius = baseRadius + i * 0.5f;
-        createPhysicsObject(radius, 0.0f);
-        if (!m_objects.empty()) {
+        float baseRadius = 1.5f;
+        for (int i = 0; i < 7; i++) {
+            float radius = baseRadius + i * 0.5f;
             float hue = (float)i / 7.0f;
-            m_objects.back().color = glm::vec3(hue, 0.5f, 1.0f - hue);
+            createPhysicsObject(radius, 0.0f, ObjectShape::CIRCLE, 0.1f, glm::vec3(hue, 0.5f, 1.0f - hue));
             m_objects.back().orbitAngularSpeed = angularSpeeds[i];
-
-            GLuint texID = loadTexture(texturePaths[i]);
-            if (texID != 0) {
-                m_objects.back().textureID = texID;
-                m_objects.back().hasTexture = true;
-            } else {
-                m_objects.back().hasTexture = false;
-            }
+            m_objects.back().textureID = textures[i + 1];
+            m_objects.back().hasTexture = textures[i + 1] != 0;
         }
-    }
+    });
 }
 
 
@@ -6,13 +6,21 @@
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <mutex>
 #include <unordered_map>
 #include <QElapsedTimer>
+#include <QLabel>
 #include <QOpenGLWidget>
 #include <QTime>
 #include <QTimer>
 #include "camera.h"
 #include "utils/sceneparser.h"
+#include "utils/forcefield.h"
+#include "utils/simulationthread.h"
+#include "utils/threadpool.h"
 
 #include <Box2D/Box2D.h>
 #include <Box2D/Particle/b2ParticleSystem.h>
@@ -26,8 +34,6 @@ enum class ObjectShape {
 };
 struct PhysObject {
     b2Body* body;
-    GLuint VAO;
-    GLuint VBO;
     glm::vec2 size;  // half-size for box, radius for circle
     bool isCircle;
     glm::vec3 color; // Store the object color here
@@ -99,9 +105,11 @@ private:
 
     bool m_autoStaticMode = false;
 
-    // Physics-related methods
+    // Physics-related methods. Everything that touches m_world runs on the
+    // simulation thread, either from stepPhysics or from a command posted to
+    // m_simulation
     void stepPhysics(float dt);
-    void createPhysicsObject(float x, float y);
+    void createPhysicsObject(float x, float y, ObjectShape shape, float halfSize, glm::vec3 color);
 
     // Member variables
     glm::mat4 m_model = glm::mat4(1.f);
@@ -146,6 +154,63 @@ private:
     float m_worldHeight;
     std::vector<PhysObject> m_objects;
 
+    // Batched body rendering: every box and every circle shares one unit
+    // mesh, and all bodies are drawn with one instanced call per
+    // (shape, texture) batch
+    struct ObjectInstance {
+        glm::vec2 position;
+        float angle;
+        float halfSize;
+        glm::vec3 color;
+    };
+    struct ObjectBatch {
+        bool isCircle;
+        GLuint textureID;
+        int first;
+        int count;
+    };
+    static constexpr int CIRCLE_SEGMENTS = 24;
+    void initializeObjectMeshes();
+    void renderObjects(GLint useTextureLoc, GLint textureLoc, GLint instancedLoc);
+
+    // What paintGL needs from the simulation, copied out after every step
+    struct BodySnapshot {
+        glm::vec2 position;
+        float angle;
+        float halfSize;
+        glm::vec3 color;
+        bool isCircle;
+        GLuint textureID;
+    };
+    // Step timings for the profiler overlay: the world step, the particle
+    // solve, then each b2ParticleProfile stage
+    static constexpr int PROFILE_STAT_COUNT = 22;
+    using ProfileStats = std::array<b2Stat, PROFILE_STAT_COUNT>;
+
+    struct WorldSnapshot {
+        std::vector<BodySnapshot> bodies;
+        std::vector<b2Vec2> particles;
+        ProfileStats profileStats;           // last completed window of steps
+        b2ParticleProfile particleProfile;   // counters from the latest step
+        int sceneGeneration = 0; // bumped whenever the bodies are rebuilt
+        uint32 particleIndexGeneration = 0; // b2ParticleSystem::GetParticleIndexGeneration()
+        std::chrono::steady_clock::time_point time;
+    };
+    void publishSnapshot();
+    void recordProfile();
+    void updateProfileOverlay(const ProfileStats &stats, const b2ParticleProfile &latest);
+    void batchObjects(const WorldSnapshot &previous, const WorldSnapshot &current, float alpha);
+
+    GLuint m_boxMeshVAO = 0;
+    GLuint m_boxMeshVBO = 0;
+    GLuint m_circleMeshVAO = 0;
+    GLuint m_circleMeshVBO = 0;
+    GLuint m_instanceVBO = 0;
+    GLsizeiptr m_instanceVBOCapacity = 0; // bytes allocated for m_instanceVBO
+    std::vector<ObjectInstance> m_instanceData; // reused every frame
+    std::vector<ObjectBatch> m_objectBatches;
+    std::vector<int> m_objectBatchIndex;
+
     void setup2DProjection(int w, int h);
 
     ObjectShape m_currentShape = ObjectShape::BOX;
@@ -162,6 +227,7 @@ private:
     bool m_explosionMode = false;
     int m_explosionStrength = 10;
     glm::vec2 m_explosionCenter = glm::vec2(0.0f, 0.0f);
+    float m_explosionRadius = std::sqrt(10.0f);
     glm::vec2 m_gravityCenter = glm::vec2(0.0f, 0.0f);
     float m_gravityStrength = 10.0f; // Adjust as needed
 
@@ -172,11 +238,18 @@ private:
     float m_orbitSpeed = 1.0f;  // angular velocity in rad/s
     float m_radiusTolerance = 0.1f; // tolerance for deciding if at orbit radius
 
+    ForceFieldSolver m_forceFields;
+
     void resetGravityCenter();
     void initializeSolarSystem();
+    GLuint m_planetTextures[8] = {}; // sun, then the planets; loaded once
+    float m_orbitSpeedScale = 0.8f;
+    int m_sceneGeneration = 0;
 
     b2ParticleSystem* m_particleSystem;
     b2ParticleSystemDef m_particleSystemDef;
+    b2ParticleEmitter* m_fountain = nullptr; // toggled with F
+    ThreadPool m_threadPool; // runs the particle solver stages across cores
     float m_particleRadius = 0.1f;
     const float m_waterDensity = 1.0f;
     void renderWaterParticles();
@@ -187,6 +260,7 @@ private:
     // For rendering particles
     GLuint m_particleVAO = 0;
     GLuint m_particleVBO = 0;
+    GLsizeiptr m_particleVBOCapacity = 0; // bytes allocated for m_particleVBO
     bool m_particleVAOInitialized = false;
     std::vector<b2Vec2> m_drawPoints;
 
@@ -199,5 +273,27 @@ private:
     bool m_justFinishStroke = false;
     std::vector<b2Vec2> m_currentStroke;
     std::vector<std::vector<b2Vec2>> m_allBrushStrokes;
+
+    // Snapshots published by the simulation thread. paintGL blends between
+    // the previous and current ones; the simulation fills the spare one
+    // without holding the lock and rotates the three when it publishes.
+    WorldSnapshot m_snapshots[3];
+    WorldSnapshot *m_previousSnapshot = &m_snapshots[0];
+    WorldSnapshot *m_currentSnapshot = &m_snapshots[1];
+    WorldSnapshot *m_spareSnapshot = &m_snapshots[2];
+    std::mutex m_snapshotMutex;
+    std::vector<b2Vec2> m_particleDrawBuffer; // interpolated positions, reused every frame
+
+    // Profiler overlay (P toggles it). The simulation thread collects stats
+    // over PROFILE_WINDOW_STEPS steps and publishes them with the snapshot
+    static constexpr int PROFILE_WINDOW_STEPS = 30;
+    ProfileStats m_profileAccumulator;
+    ProfileStats m_profileWindow;
+    int m_profileSteps = 0;
+    QLabel *m_profileLabel = nullptr;
+    QElapsedTimer m_profileRefreshTimer;
+
+    // Declared last so it stops before anything it steps is torn down
+    SimulationThread m_simulation;
 };
 
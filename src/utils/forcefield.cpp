@@ -0,0 +1,149 @@
+#include "forcefield.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Below this distance from the center a direction isn't meaningful
+const float MIN_DISTANCE_SQ = 0.0001f;
+
+}
+
+void ForceFieldSolver::apply(b2World &world, b2ParticleSystem *particleSystem, const ForceField &field) {
+    gather(world, particleSystem, field);
+
+    const float radiusSq = field.radius * field.radius;
+    for (b2Body *body : m_bodies) {
+        const b2Vec2 offset = body->GetPosition() - field.center;
+        const float distSq = offset.LengthSquared();
+        if (distSq < MIN_DISTANCE_SQ || (field.radius > 0.0f && distSq >= radiusSq)) {
+            continue;
+        }
+        const float dist = std::sqrt(distSq);
+        const b2Vec2 outward = (1.0f / dist) * offset;
+        const float mass = body->GetMass();
+
+        switch (field.type) {
+        case ForceField::Type::RADIAL:
+            body->ApplyForceToCenter(-field.strength * mass * outward, true);
+            break;
+        case ForceField::Type::EXPLOSION:
+            // Plain force, so heavier bodies get pushed less
+            body->ApplyForceToCenter((field.strength / dist) * outward, true);
+            break;
+        case ForceField::Type::VORTEX:
+            body->ApplyForceToCenter((field.strength * mass / dist) * b2Vec2(-outward.y, outward.x), true);
+            break;
+        case ForceField::Type::ORBIT: {
+            // Steer the tangential speed toward v = ω * r and supply the
+            // centripetal force for that speed
+            const float angularSpeed = orbitAngularSpeed ? orbitAngularSpeed(body) : 0.0f;
+            const float desiredSpeed = field.orbitSpeedScale * angularSpeed * dist;
+            const b2Vec2 tangent(-outward.y, outward.x);
+            const float speedError = desiredSpeed - b2Dot(body->GetLinearVelocity(), tangent);
+
+            const float tangentForceGain = 10.0f;
+            body->ApplyForceToCenter(speedError * tangentForceGain * mass * tangent, true);
+            body->ApplyForceToCenter(-(desiredSpeed * desiredSpeed / dist) * mass * outward, true);
+            break;
+        }
+        }
+    }
+
+    if (m_particleIndices.empty()) {
+        return;
+    }
+
+    // Particles get the force a unit-mass body would feel, scaled to their
+    // own mass, so water reacts on the same scale as the shapes around it
+    const b2Vec2 *positions = particleSystem->GetPositionBuffer();
+    // Same as b2ParticleSystem::GetParticleMass, which isn't public
+    const float stride = b2_particleStride * 2.0f * particleSystem->GetRadius();
+    const float particleMass = particleSystem->GetDensity() * stride * stride;
+    size_t kept = 0;
+    m_particleForces.resize(m_particleIndices.size());
+    for (int32 index : m_particleIndices) {
+        const b2Vec2 offset = positions[index] - field.center;
+        const float distSq = offset.LengthSquared();
+        if (distSq < MIN_DISTANCE_SQ || (field.radius > 0.0f && distSq >= radiusSq)) {
+            continue;
+        }
+        const float dist = std::sqrt(distSq);
+        const b2Vec2 outward = (1.0f / dist) * offset;
+
+        b2Vec2 force;
+        switch (field.type) {
+        case ForceField::Type::RADIAL:
+            force = -field.strength * particleMass * outward;
+            break;
+        case ForceField::Type::EXPLOSION:
+            force = (field.strength * particleMass / dist) * outward;
+            break;
+        case ForceField::Type::VORTEX:
+            force = (field.strength * particleMass / dist) * b2Vec2(-outward.y, outward.x);
+            break;
+        default:
+            continue;
+        }
+        m_particleIndices[kept] = index;
+        m_particleForces[kept] = force;
+        kept++;
+    }
+    particleSystem->ParticleApplyForces(m_particleIndices.data(), m_particleForces.data(),
+                                        static_cast<int32>(kept));
+}
+
+void ForceFieldSolver::gather(b2World &world, b2ParticleSystem *particleSystem, const ForceField &field) {
+    m_bodies.clear();
+    m_particleIndices.clear();
+    const bool wantParticles = particleSystem && field.affectsParticles &&
+                               field.type != ForceField::Type::ORBIT;
+
+    if (field.radius <= 0.0f) {
+        // Unbounded: everything is affected, so skip the queries
+        for (b2Body *body = world.GetBodyList(); body; body = body->GetNext()) {
+            if (body->GetType() == b2_dynamicBody) {
+                m_bodies.push_back(body);
+            }
+        }
+        if (wantParticles) {
+            const int32 count = particleSystem->GetParticleCount();
+            m_particleIndices.resize(count);
+            for (int32 i = 0; i < count; i++) {
+                m_particleIndices[i] = i;
+            }
+        }
+        return;
+    }
+
+    // One world query finds both the fixtures (broad-phase) and the
+    // particles (tag range lookup) in the field's bounding box
+    m_queryParticleSystem = wantParticles ? particleSystem : nullptr;
+    b2AABB aabb;
+    aabb.lowerBound = field.center - b2Vec2(field.radius, field.radius);
+    aabb.upperBound = field.center + b2Vec2(field.radius, field.radius);
+    world.QueryAABB(this, aabb);
+
+    // Bodies with several fixtures are reported once per fixture
+    std::sort(m_bodies.begin(), m_bodies.end());
+    m_bodies.erase(std::unique(m_bodies.begin(), m_bodies.end()), m_bodies.end());
+}
+
+bool ForceFieldSolver::ReportFixture(b2Fixture *fixture) {
+    b2Body *body = fixture->GetBody();
+    if (body->GetType() == b2_dynamicBody) {
+        m_bodies.push_back(body);
+    }
+    return true;
+}
+
+bool ForceFieldSolver::ReportParticle(const b2ParticleSystem *particleSystem, int32 index) {
+    B2_NOT_USED(particleSystem);
+    m_particleIndices.push_back(index);
+    return true;
+}
+
+bool ForceFieldSolver::ShouldQueryParticleSystem(const b2ParticleSystem *particleSystem) {
+    return particleSystem == m_queryParticleSystem;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <Box2D/Box2D.h>
+
+// A force centred on a point. Fields with a radius only visit the bodies and
+// particles inside it, found through the world's broad-phase and the particle
+// system's sorted proxies, so a small explosion in a big scene stays cheap.
+struct ForceField {
+    enum class Type {
+        RADIAL,    // constant pull toward the center (gravity center mode)
+        EXPLOSION, // push away from the center, falling off with distance
+        VORTEX,    // swirl around the center, falling off with distance
+        ORBIT      // steer bodies onto circular orbits (solar system mode)
+    };
+
+    Type type = Type::RADIAL;
+    b2Vec2 center = b2Vec2(0.0f, 0.0f);
+    float radius = 0.0f; // area of effect; 0 means the whole world
+    float strength = 0.0f;
+    float orbitSpeedScale = 1.0f; // ORBIT only: multiplies each body's angular speed
+    bool affectsParticles = true; // ORBIT never moves particles
+};
+
+// Applies force fields to a world. Keeps its scratch buffers between calls
+// so applying a field doesn't allocate once they've grown.
+class ForceFieldSolver : private b2QueryCallback
+{
+public:
+    // ORBIT fields ask this for each dynamic body's angular speed (rad/s)
+    std::function<float(const b2Body *)> orbitAngularSpeed;
+
+    // Call before b2World::Step; forces are cleared by the step
+    void apply(b2World &world, b2ParticleSystem *particleSystem, const ForceField &field);
+
+private:
+    void gather(b2World &world, b2ParticleSystem *particleSystem, const ForceField &field);
+
+    bool ReportFixture(b2Fixture *fixture) override;
+    bool ReportParticle(const b2ParticleSystem *particleSystem, int32 index) override;
+    bool ShouldQueryParticleSystem(const b2ParticleSystem *particleSystem) override;
+
+    const b2ParticleSystem *m_queryParticleSystem = nullptr;
+    std::vector<b2Body *> m_bodies;
+    std::vector<int32> m_particleIndices;
+    std::vector<b2Vec2> m_particleForces;
+};
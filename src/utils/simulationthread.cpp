@@ -0,0 +1,68 @@
+#include "simulationthread.h"
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+void SimulationThread::start(float stepSeconds, StepFunction step) {
+    stop();
+    m_stepSeconds = stepSeconds;
+    m_step = std::move(step);
+    m_stop.store(false);
+    m_thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    m_stop.store(true);
+    m_thread.join();
+    runCommands();
+}
+
+void SimulationThread::post(Command command) {
+    if (!isRunning()) {
+        command();
+        return;
+    }
+    const unsigned head = m_head.load(std::memory_order_relaxed);
+    // Only full if the simulation is badly stalled; wait for it to drain
+    while (head - m_tail.load(std::memory_order_acquire) >= QUEUE_CAPACITY) {
+        std::this_thread::yield();
+    }
+    m_queue[head % QUEUE_CAPACITY] = std::move(command);
+    m_head.store(head + 1, std::memory_order_release);
+}
+
+void SimulationThread::runCommands() {
+    unsigned tail = m_tail.load(std::memory_order_relaxed);
+    const unsigned head = m_head.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+        Command &command = m_queue[tail % QUEUE_CAPACITY];
+        command();
+        command = nullptr;
+        m_tail.store(tail + 1, std::memory_order_release);
+    }
+}
+
+void SimulationThread::run() {
+    using Clock = std::chrono::steady_clock;
+    const auto step = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<float>(m_stepSeconds));
+
+    auto nextStep = Clock::now();
+    while (!m_stop.load()) {
+        int steps = 0;
+        while (Clock::now() >= nextStep && steps < MAX_CATCH_UP_STEPS) {
+            runCommands();
+            m_step(m_stepSeconds);
+            nextStep += step;
+            steps++;
+        }
+        if (steps == MAX_CATCH_UP_STEPS && Clock::now() >= nextStep) {
+            nextStep = Clock::now();
+        }
+        std::this_thread::sleep_until(nextStep);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+// Runs a fixed-timestep simulation on its own thread, independent of how fast
+// the GUI repaints. Other threads never touch the simulated state directly;
+// they post commands which the simulation thread runs between steps.
+class SimulationThread
+{
+public:
+    using Command = std::function<void()>;
+    using StepFunction = std::function<void(float dt)>;
+
+    SimulationThread() = default;
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread &) = delete;
+    SimulationThread &operator=(const SimulationThread &) = delete;
+
+    // Calls step(stepSeconds) on the simulation thread at a fixed rate
+    void start(float stepSeconds, StepFunction step);
+    // Runs any commands still queued, then joins the thread
+    void stop();
+
+    bool isRunning() const { return m_thread.joinable(); }
+    float stepSeconds() const { return m_stepSeconds; }
+
+    // Queue a command to run on the simulation thread before its next step.
+    // Must only be called from one thread (the GUI thread). Runs the command
+    // right away if the simulation isn't running.
+    void post(Command command);
+
+private:
+    void run();
+    void runCommands();
+
+    // If the simulation falls further behind than this it drops the time
+    // instead of trying to catch up
+    static constexpr int MAX_CATCH_UP_STEPS = 5;
+
+    // Single-producer single-consumer ring; m_head is written only by post()
+    // and m_tail only by the simulation thread
+    static constexpr unsigned QUEUE_CAPACITY = 256;
+    std::array<Command, QUEUE_CAPACITY> m_queue;
+    std::atomic<unsigned> m_head{0};
+    std::atomic<unsigned> m_tail{0};
+
+    StepFunction m_step;
+    float m_stepSeconds = 1.0f / 60.0f;
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+};
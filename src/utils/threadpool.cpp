@@ -0,0 +1,101 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+int ThreadPool::defaultThreadCount() {
+    const int cores = static_cast<int>(std::thread::hardware_concurrency());
+    return std::max(0, cores - 1);
+}
+
+ThreadPool::ThreadPool(int threadCount) {
+    m_workers.reserve(std::max(0, threadCount));
+    for (int i = 0; i < threadCount; i++) {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread &worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(b2RangeTask *task, int32 count, int32 grainSize) {
+    if (count <= 0) {
+        return;
+    }
+    // Aim for a few chunks per thread so faster threads can pick up slack
+    const int threads = threadCount() + 1;
+    const int chunkSize = std::max<int>(std::max<int>(grainSize, 1),
+                                        (count + threads * 4 - 1) / (threads * 4));
+    if (m_workers.empty() || chunkSize >= count) {
+        task->Execute(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = task;
+        m_count = count;
+        m_chunkSize = chunkSize;
+        m_nextIndex.store(0);
+        m_remaining.store(count);
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    runChunks();
+
+    // Wait for the chunks other threads claimed, and for every worker to let
+    // go of this job before the next one overwrites it
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] {
+        return m_remaining.load() == 0 && m_busyWorkers == 0;
+    });
+    m_task = nullptr;
+}
+
+void ThreadPool::runChunks() {
+    for (;;) {
+        const int begin = m_nextIndex.fetch_add(m_chunkSize);
+        if (begin >= m_count) {
+            return;
+        }
+        const int end = std::min(begin + m_chunkSize, m_count);
+        m_task->Execute(begin, end);
+        if (m_remaining.fetch_sub(end - begin) == end - begin) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::workerLoop() {
+    uint64_t seenGeneration = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] {
+                return m_stop || (m_task && m_generation != seenGeneration);
+            });
+            if (m_stop) {
+                return;
+            }
+            seenGeneration = m_generation;
+            m_busyWorkers++;
+        }
+
+        runChunks();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busyWorkers--;
+        }
+        m_done.notify_all();
+    }
+}
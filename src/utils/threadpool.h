@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Box2D/Common/b2TaskScheduler.h>
+
+// Small fork-join pool used to run the particle solver on several cores.
+// ParallelFor splits the range into chunks which the worker threads (and the
+// calling thread) claim from a shared counter until none are left.
+class ThreadPool : public b2TaskScheduler
+{
+public:
+    // threadCount is the number of extra worker threads; the thread calling
+    // ParallelFor always helps out as well.
+    explicit ThreadPool(int threadCount = defaultThreadCount());
+    ~ThreadPool() override;
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void ParallelFor(b2RangeTask *task, int32 count, int32 grainSize) override;
+
+    int threadCount() const { return static_cast<int>(m_workers.size()); }
+
+    static int defaultThreadCount();
+
+private:
+    void workerLoop();
+    void runChunks();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    // Current job, written under m_mutex while no worker is busy.
+    b2RangeTask *m_task = nullptr;
+    int m_count = 0;
+    int m_chunkSize = 1;
+    uint64_t m_generation = 0;
+    int m_busyWorkers = 0;
+    bool m_stop = false;
+
+    std::atomic<int> m_nextIndex{0};
+    std::atomic<int> m_remaining{0};
+};